@@ -13,3 +13,4 @@
 #pragma once
 
 #include <sdb/sdb_fmt_io.hxx>
+#include <sdb/sdb_cursor.hpp>
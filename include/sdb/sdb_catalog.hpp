@@ -0,0 +1,85 @@
+// vim:ts=2:sw=2:et
+//-----------------------------------------------------------------------------
+/// \file  sdb_catalog.hpp
+//------------------------------------------------------------------------------
+/// \brief Metadata catalog sidecar of an SDB database root
+///
+/// Opening a file parses its Header, StreamsMeta and CandlesMeta with dozens
+/// of small reads before any sample is available, which dominates startup
+/// time when thousands of files are opened in bulk.  A MetaCatalog caches the
+/// parsed metadata of every file under one database root in a single
+/// sequentially-readable sidecar file.  Entries are keyed by file path, size
+/// and mtime; a stale or missing entry falls back to in-file parsing, after
+/// which the fresh metadata is added back to the catalog.
+//------------------------------------------------------------------------------
+// Copyright (c) 2015 Omnibius, LLC
+// Author:  Serge Aleynikov <saleyn@gmail.com>
+// Created: 2015-10-15
+//------------------------------------------------------------------------------
+#pragma once
+
+#include <sdb/sdb_fmt.hpp>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+
+namespace sdb {
+
+//------------------------------------------------------------------------------
+/// Catalog of cached file metadata (one catalog file per database root)
+//------------------------------------------------------------------------------
+struct MetaCatalog {
+  static constexpr uint32_t    MAGIC()   { return 0x43424453; } // "SDBC"
+  static constexpr uint32_t    VERSION() { return 2;          }
+  /// Name of the catalog file inside the database root directory
+  static constexpr const char* FILENAME(){ return ".sdb-catalog"; }
+
+  //----------------------------------------------------------------------------
+  /// Cached metadata of one SDB file
+  //----------------------------------------------------------------------------
+  struct Entry {
+    time_t      m_mtime = 0;  ///< File mtime at caching time
+    int64_t     m_size  = 0;  ///< File size  at caching time
+    Header      m_header;
+    StreamsMeta m_streams_meta;
+    CandlesMeta m_candles_meta;
+  };
+
+  /// Load the catalog of database root \a a_root_dir (missing catalog file
+  /// results in an empty catalog; a corrupt one is discarded)
+  explicit MetaCatalog(std::string const& a_root_dir);
+
+  /// Look up cached metadata of \a a_path, checking that the file's current
+  /// size and mtime still match the cached entry
+  /// @return pointer to the entry or nullptr on miss
+  Entry const* Find(std::string const& a_path) const;
+
+  /// Insert or replace the cached metadata of \a a_path.
+  /// Key stamps (size/mtime) are taken from the file's current state.
+  void Update
+  (
+    std::string const& a_path,
+    Header      const& a_header,
+    StreamsMeta const& a_streams_meta,
+    CandlesMeta const& a_candles_meta
+  );
+
+  /// Write the catalog back to its sidecar file if any entries changed.
+  /// The file is replaced atomically (write to temp + rename).
+  void Save();
+
+  bool   Dirty() const { return m_dirty;          }
+  size_t Count() const { return m_entries.size(); }
+
+  /// Find() / Update() are safe to call concurrently from multiple threads
+  /// opening different files; Save() must not race with Update().
+private:
+  std::string                            m_catalog_file;
+  std::unordered_map<std::string, Entry> m_entries;
+  bool                                   m_dirty = false;
+  mutable std::mutex                     m_mutex;
+
+  void Load();
+};
+
+} // namespace sdb
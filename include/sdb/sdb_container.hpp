@@ -0,0 +1,789 @@
+// vim:ts=2:sw=2:et
+//-----------------------------------------------------------------------------
+/// \file  sdb_container.hpp
+//------------------------------------------------------------------------------
+/// \brief Multi-instrument container file
+///
+/// One SDB file per instrument-day makes a whole-exchange replay open
+/// thousands of file descriptors, scatter reads over thousands of inodes and
+/// pay the fixed header cost even for instruments with a handful of samples.
+/// A container packs many logical streams - one Header per instrument - into
+/// a single physical file.  Sample payloads use the regular SDB v2 stream
+/// encoding, chunked into self-contained data blocks (each block starts with
+/// an absolute SecondsSample and full prices, exactly like the blocks of a
+/// v2 file), framed with the owning instrument id and indexed by a directory
+/// of per-instrument block extents at the end of file.  A reader can open
+/// one instrument cheaply (seek straight to its extents) or replay all
+/// instruments in time order with one pass over the shared time spine.
+///
+/// Container v1 carries the Seconds, Quotes and Trade streams; per-file
+/// candles, book deltas and the other per-instrument streams remain the
+/// domain of standalone SDB files.
+//------------------------------------------------------------------------------
+// Copyright (c) 2015 Omnibius, LLC
+// Author:  Serge Aleynikov <saleyn@gmail.com>
+// Created: 2015-10-15
+//------------------------------------------------------------------------------
+#pragma once
+
+#include <sdb/sdb_fmt.hpp>
+#include <utxx/time_val.hpp>
+#include <utxx/timestamp.hpp>
+#include <utxx/endian.hpp>
+#include <utxx/error.hpp>
+#include <fcntl.h>
+#include <limits>
+#include <queue>
+#include <tuple>
+#include <vector>
+#include <cstdio>
+
+namespace sdb {
+
+//------------------------------------------------------------------------------
+/// Directory of a container file: one entry per logical instrument stream
+//------------------------------------------------------------------------------
+struct ContainerDir {
+  static constexpr uint32_t MAGIC()   { return 0x4D424453; } // "SDBM"
+  static constexpr uint32_t VERSION() { return 1;          }
+
+  /// Size of the fixed file preamble: magic, version, directory offset, date
+  static constexpr size_t   PREAMBLE_SIZE() { return 4+4+8+8; }
+  /// Position of the directory-offset field within the preamble
+  static constexpr long     DIR_OFF_POS()   { return 8;       }
+
+  //----------------------------------------------------------------------------
+  /// Extent of one data block belonging to an instrument.  Blocks are framed
+  /// in file as [InstrID:4][Size:4][payload]; m_file_offset points at the
+  /// framing header
+  //----------------------------------------------------------------------------
+  struct Extent {
+    uint64_t m_file_offset;  ///< Offset of the block's framing header
+    uint32_t m_size;         ///< Payload size in bytes
+    uint32_t m_first_sec;    ///< Secs since midnight of the first sample
+    uint32_t m_records;      ///< Number of samples in the block
+  };
+
+  using ExtentsVec = std::vector<Extent>;
+
+  //----------------------------------------------------------------------------
+  /// One logical instrument stream: its header and the blocks holding it
+  //----------------------------------------------------------------------------
+  struct Instr {
+    Header     m_header;
+    ExtentsVec m_extents;
+  };
+
+  using InstrVec = std::vector<Instr>;
+
+  /// UTC midnight shared by all instruments of the container
+  time_val const&  Midnight()    const { return m_date;               }
+  void             Date(time_val a)    { m_date = a;                  }
+
+  size_t           Count()       const { return m_instruments.size(); }
+  InstrVec&        Instruments()       { return m_instruments;        }
+  InstrVec const&  Instruments() const { return m_instruments;        }
+
+  /// Write the file preamble with an unlinked (zero) directory offset
+  void     WritePreamble(FILE* a_file, std::string const& a_filename);
+
+  /// Append the directory at the end of file and link it to the preamble
+  /// @return the directory's file offset
+  uint64_t Write(FILE* a_file, std::string const& a_filename);
+
+  /// Read the preamble and directory (throws when \a a_file is not a
+  /// container or wasn't closed cleanly, i.e. has no directory)
+  void     Read (FILE* a_file, std::string const& a_filename);
+
+private:
+  time_val m_date;
+  InstrVec m_instruments;
+};
+
+//------------------------------------------------------------------------------
+/// Writer of a multi-instrument container file.
+///
+/// Each instrument owns a small encode buffer with its own time/price chains
+/// (the same state a standalone writer keeps); a buffer is emitted as one
+/// framed data block when full and at Close().  Since every block begins
+/// with an absolute SecondsSample and full prices, blocks decode
+/// independently regardless of how the instruments interleave in file
+//------------------------------------------------------------------------------
+template <uint MaxDepth = 10>
+struct ContainerWriter {
+  /// Default data block payload size.  Smaller than a standalone writer's
+  /// buffer: with thousands of instruments in flight, smaller blocks keep
+  /// memory bounded and the physical block order closer to time order
+  static constexpr size_t DEF_BLOCK_SIZE() { return 64*1024; }
+
+  static constexpr int    NaN() { return std::numeric_limits<int>::lowest(); }
+
+  explicit ContainerWriter(size_t a_block_size = DEF_BLOCK_SIZE())
+    : m_block_size(a_block_size)
+  {
+    static_assert(MaxDepth < 128, "MaxDepth is too large");
+  }
+
+  ~ContainerWriter() { Close(); }
+
+  ContainerWriter(ContainerWriter const&)            = delete;
+  ContainerWriter& operator=(ContainerWriter const&) = delete;
+
+  bool             IsOpen()   const { return m_file != nullptr; }
+  std::string const& Filename() const { return m_filename;      }
+  time_val const&  Midnight() const { return m_dir.Midnight();  }
+  /// Number of instruments added so far
+  size_t           Count()    const { return m_dir.Count();     }
+
+  /// Create a container file for writing
+  /// @param a_date UTC date shared by all instruments of the container
+  void Open(std::string const& a_filename, time_val a_date, int a_perm = 0640);
+
+  /// Register an instrument and return its id (an index used to route
+  /// writes; also the instrument's position in the reader's directory)
+  int AddInstrument
+  (
+    std::string const& a_xchg,
+    std::string const& a_symbol,
+    std::string const& a_instr,
+    long               a_secid,
+    std::string const& a_tz_name,
+    int                a_tz_offset,
+    uint8_t            a_depth   = 5,
+    double             a_px_step = 0.0001,
+    uuid        const& a_uuid    = boost::uuids::random_generator()()
+  );
+
+  /// Write a book snapshot to the stream of instrument \a a_instr
+  /// (same argument conventions as BaseSDBFileIO::WriteQuotes())
+  template <PriceUnit PU, typename PxT>
+  void WriteQuotes
+  (
+    int a_instr, time_val a_ts,
+    PxLevels<MaxDepth, PxT>&& a_bids, size_t a_bid_cnt,
+    PxLevels<MaxDepth, PxT>&& a_asks, size_t a_ask_cnt
+  );
+
+  /// Write a trade to the stream of instrument \a a_instr
+  template <PriceUnit PU, typename PxT>
+  void WriteTrade
+  (
+    int       a_instr,
+    time_val  a_ts,
+    SideT     a_side,
+    PxT       a_px,
+    uint      a_qty,
+    AggrT     a_aggr     = AggrT::Undefined,
+    size_t    a_ord_id   = 0,
+    size_t    a_trade_id = 0
+  );
+
+  /// Emit all pending data blocks
+  void Flush();
+
+  /// Flush, append the directory and close the file
+  void Close();
+
+private:
+  //----------------------------------------------------------------------------
+  /// Encoder state of one logical instrument stream (mirrors the block/time/
+  /// price state a standalone BaseSDBFileIO writer keeps)
+  //----------------------------------------------------------------------------
+  struct InstrState {
+    std::vector<char> m_buf;
+    size_t            m_size          = 0;
+    uint              m_records       = 0;
+    uint              m_first_sec     = 0;
+    time_val          m_last_ts;
+    int               m_last_sec      = 0;
+    int               m_last_usec     = 0;
+    int               m_next_second   = 0;
+    PriceT            m_last_quote_px = NaN();
+    PriceT            m_last_trade_px = NaN();
+  };
+
+  std::string             m_filename;
+  FILE*                   m_file = nullptr;
+  size_t                  m_block_size;
+  ContainerDir            m_dir;
+  std::vector<InstrState> m_state;
+
+  InstrState& State(int a_instr) {
+    if (utxx::unlikely(a_instr < 0 || size_t(a_instr) >= m_state.size()))
+      UTXX_THROW_RUNTIME_ERROR
+        ("Invalid container instrument id ", a_instr, " in ", m_filename);
+    return m_state[a_instr];
+  }
+
+  /// Make sure the block buffer of \a a_instr has \a a_sz free bytes,
+  /// emitting the pending block when it is full
+  void EnsureSpace(int a_instr, size_t a_sz);
+
+  /// Normalize \a a_px to integer price steps of instrument \a a_hdr
+  template <PriceUnit PU, typename T>
+  static int NormalizePx(T a_px, Header const& a_hdr);
+
+  /// Write a SecondsSample into the block buffer when the second advanced
+  /// (updates the instrument's time state)
+  /// @return true when a new SecondsSample was written
+  bool WriteSeconds(InstrState& a_st, time_val a_now);
+
+  /// Emit the pending block of \a a_instr as one framed data block
+  void FlushBlock(int a_instr);
+};
+
+//------------------------------------------------------------------------------
+/// Reader of a multi-instrument container file.
+///
+/// ReadInstrument() decodes one logical stream by walking its extents;
+/// ReadAll() merges the extents of all instruments by block start time,
+/// replaying the whole container in time order (at block granularity) with
+/// a single forward pass over the file.  Visitors are invoked as
+/// a_fun(instr_id, sample) with the same sample types Read() delivers
+//------------------------------------------------------------------------------
+template <uint MaxDepth = 10>
+struct ContainerReader {
+  static constexpr int NaN() { return std::numeric_limits<int>::lowest(); }
+
+  ContainerReader() {}
+  explicit ContainerReader(std::string const& a_filename) { Open(a_filename); }
+
+  ~ContainerReader() { Close(); }
+
+  ContainerReader(ContainerReader const&)            = delete;
+  ContainerReader& operator=(ContainerReader const&) = delete;
+
+  /// Open a container file and read its directory
+  void Open(std::string const& a_filename);
+  void Close();
+
+  bool                IsOpen()   const { return m_file != nullptr; }
+  std::string const&  Filename() const { return m_filename;        }
+  time_val const&     Midnight() const { return m_dir.Midnight();  }
+
+  /// Number of instruments in the container
+  size_t              Count()    const { return m_dir.Count();     }
+
+  /// Header of instrument \a a_instr
+  Header const& Info(int a_instr) const
+    { return m_dir.Instruments()[a_instr].m_header; }
+
+  /// Block extents of instrument \a a_instr
+  ContainerDir::ExtentsVec const& Extents(int a_instr) const
+    { return m_dir.Instruments()[a_instr].m_extents; }
+
+  /// Time of the last delivered sample: seconds/microseconds since midnight
+  int LastSec()  const { return m_last_sec;  }
+  int LastUSec() const { return m_last_usec; }
+
+  /// Read all samples of instrument \a a_instr in time order
+  template <typename Visitor>
+  void ReadInstrument(int a_instr, Visitor a_fun);
+
+  /// Read all instruments merged by block start time: one forward file pass
+  template <typename Visitor>
+  void ReadAll(Visitor a_fun);
+
+private:
+  std::string       m_filename;
+  FILE*             m_file = nullptr;
+  ContainerDir      m_dir;
+  std::vector<char> m_buf;
+  int               m_last_sec  = 0;
+  int               m_last_usec = 0;
+
+  /// Read the framed block of \a a_ext into m_buf and decode it
+  template <typename Visitor>
+  void ReadExtent(int a_instr, ContainerDir::Extent const& a_ext,
+                  Visitor& a_fun);
+
+  /// Decode one self-contained block payload
+  template <typename Visitor>
+  void DecodeBlock(int a_instr, const char* a_buf, size_t a_sz,
+                   Visitor& a_fun);
+};
+
+//==============================================================================
+// ContainerWriter implementation
+//==============================================================================
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void ContainerWriter<MaxDepth>::
+Open(std::string const& a_filename, time_val a_date, int a_perm)
+{
+  if (utxx::unlikely(m_file))
+    UTXX_THROW_RUNTIME_ERROR("Container ", m_filename, " is already open");
+
+  int fd = ::open(a_filename.c_str(), O_RDWR|O_CREAT|O_TRUNC, a_perm);
+  if (fd < 0)
+    UTXX_THROW_IO_ERROR(errno, "Cannot create container ", a_filename);
+
+  m_filename = a_filename;
+  m_file     = fdopen(fd, "w+");
+  if (!m_file)
+    UTXX_THROW_IO_ERROR(errno, "Cannot open container ", a_filename);
+
+  // All instruments share the file's UTC midnight
+  m_dir.Date(utxx::time_val(utxx::secs(a_date.sec() - a_date.sec() % 86400)));
+  m_dir.WritePreamble(m_file, m_filename);
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+int ContainerWriter<MaxDepth>::
+AddInstrument
+(
+  std::string const& a_xchg,
+  std::string const& a_symbol,
+  std::string const& a_instr,
+  long               a_secid,
+  std::string const& a_tz_name,
+  int                a_tz_offset,
+  uint8_t            a_depth,
+  double             a_px_step,
+  uuid        const& a_uuid
+)
+{
+  if (utxx::unlikely(!m_file))
+    UTXX_THROW_RUNTIME_ERROR("Container file not open");
+  if (utxx::unlikely(a_depth > MaxDepth))
+    UTXX_THROW_RUNTIME_ERROR
+      ("Instrument depth ", int(a_depth), " exceeds max supported depth ",
+       MaxDepth, " of container ", m_filename);
+
+  ContainerDir::Instr instr;
+  instr.m_header.Set(VERSION(), a_xchg, a_symbol, a_instr, a_secid,
+                     m_dir.Midnight(), a_tz_name, a_tz_offset,
+                     a_depth, a_px_step, a_uuid);
+  m_dir.Instruments().emplace_back(std::move(instr));
+  m_state.emplace_back();
+  return int(m_state.size()) - 1;
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+template <PriceUnit PU, typename T>
+int ContainerWriter<MaxDepth>::
+NormalizePx(T a_px, Header const& a_hdr)
+{
+  return PU == PriceUnit::DoubleVal
+      ? (int)(double(a_px) / a_hdr.PxStep()  + 0.5)
+      : PU == PriceUnit::PrecisionVal
+      ? (int)(int(a_px)    / a_hdr.PxScale() + 0.5)
+      : PU == PriceUnit::PriceSteps
+      ? a_px
+      : throw std::logic_error
+              ("Undefined price unit " UTXX_FILE_SRC_LOCATION);
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void ContainerWriter<MaxDepth>::
+EnsureSpace(int a_instr, size_t a_sz)
+{
+  auto& s = m_state[a_instr];
+  if (s.m_buf.empty())
+    // Slack past the block size: samples never straddle block boundaries,
+    // so the buffer must fit the last sample that started below the limit
+    s.m_buf.resize(m_block_size + a_sz);
+  else if (s.m_size + a_sz > s.m_buf.size())
+    FlushBlock(a_instr);
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+bool ContainerWriter<MaxDepth>::
+WriteSeconds(InstrState& a_st, time_val a_now)
+{
+  auto midnight_ns = a_now - m_dir.Midnight();
+  int  usec        = midnight_ns.usec(); // Microsecs
+  a_st.m_last_sec  = midnight_ns.sec();  // Seconds since midnight
+  a_st.m_last_ts   = a_now;
+  a_st.m_last_usec = usec;
+
+  if (a_st.m_next_second == 0 || a_st.m_last_sec >= a_st.m_next_second) {
+    if (!a_st.m_size)
+      a_st.m_first_sec = a_st.m_last_sec; // First sample of a new data block
+    auto p = &a_st.m_buf[a_st.m_size];
+    SecondsSample(a_st.m_last_sec).Encode(p);
+    a_st.m_size          = p - &a_st.m_buf[0];
+    a_st.m_records++;
+    a_st.m_next_second   = a_st.m_last_sec + 1;
+    a_st.m_last_quote_px = NaN();
+    a_st.m_last_trade_px = NaN();
+    return true;
+  }
+
+  return false;
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+template <PriceUnit PU, typename PxT>
+void ContainerWriter<MaxDepth>::
+WriteQuotes
+(
+  int a_instr, time_val a_ts,
+  PxLevels<MaxDepth, PxT>&& a_bids, size_t a_bid_cnt,
+  PxLevels<MaxDepth, PxT>&& a_asks, size_t a_ask_cnt
+)
+{
+  if (utxx::unlikely(a_bid_cnt > MaxDepth || a_ask_cnt > MaxDepth))
+    UTXX_THROW_RUNTIME_ERROR("Invalid bid/ask counts: ",a_bid_cnt,' ',a_ask_cnt);
+
+  auto& s   = State(a_instr);
+  auto& hdr = m_dir.Instruments()[a_instr].m_header;
+
+  // Start with the first price level (see BaseSDBFileIO::WriteQuotes())
+  PxT  first_px;
+  int  qty;
+  PxLevel<PxT>* pb, *pb_end;
+  PxLevel<PxT>* pa, *pa_end;
+
+  if (utxx::likely(a_bid_cnt > 0)) {
+    auto&  b = a_bids[a_bid_cnt-1];
+    first_px = NormalizePx<PU>(b.m_px, hdr);
+    qty      = b.m_qty;
+    pb       = &b;
+    pb_end   = pb-- - a_bid_cnt;
+    pa       = &a_asks[0];
+    pa_end   = pa + a_ask_cnt;
+  } else if (utxx::likely(a_ask_cnt > 0)) {
+    auto&  a = a_asks[a_ask_cnt-1];
+    first_px = NormalizePx<PU>(a.m_px, hdr);
+    qty      = a.m_qty;
+    pb       = &a_bids[0];
+    pb_end   = --pb;
+    pa       = &a;
+    pa_end   = pa++ + a_ask_cnt;
+  } else
+    return;
+
+  if (utxx::unlikely(a_ts < s.m_last_ts))
+    UTXX_THROW_RUNTIME_ERROR
+      ("Attempt to write an out-of-order timestamp=",
+       utxx::timestamp::to_string(a_ts, utxx::DATE_TIME_WITH_USEC),
+       " of instrument ", hdr.Instrument(), " to container ", m_filename);
+
+  using QuoteSampleT = QuoteSample<MaxDepth*2, PriceT>;
+
+  // Reserve space before any encoding state is read: a block flush here
+  // resets the time/price chains so that blocks decode independently
+  EnsureSpace(a_instr, 16 + QuoteSampleT::MAX_SIZE());
+
+  int  prev_usec  = s.m_last_usec;
+  bool sec_chng   = WriteSeconds(s, a_ts);
+  auto ts         = sec_chng ? s.m_last_usec : (s.m_last_usec - prev_usec);
+  bool delta      = s.m_last_quote_px != NaN();
+
+  auto  book = typename QuoteSampleT::PxLevelsT();
+  auto  q    = &book[0];
+  q->m_px    = delta ? first_px - s.m_last_quote_px : first_px;
+  q->m_qty   = qty;
+
+  s.m_last_quote_px = first_px;
+  auto      prev_px = first_px;
+
+  // Remaining bids (descending order input, stored ascending)
+  for (++q; pb != pb_end; --pb, ++q) {
+    auto px  = NormalizePx<PU>(pb->m_px, hdr);
+    q->m_px  = px - prev_px;
+    q->m_qty = pb->m_qty;
+    prev_px  = px;
+  }
+
+  // Asks (ascending order)
+  for (; pa != pa_end; ++pa, ++q) {
+    auto px  = NormalizePx<PU>(pa->m_px, hdr);
+    q->m_px  = px - prev_px;
+    q->m_qty = pa->m_qty;
+    prev_px  = px;
+  }
+
+  QuoteSampleT qt(delta, ts, std::move(book), a_bid_cnt, a_ask_cnt);
+
+  auto p = &s.m_buf[s.m_size];
+  qt.Encode(p);
+  s.m_size = p - &s.m_buf[0];
+  s.m_records++;
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+template <PriceUnit PU, typename PxT>
+void ContainerWriter<MaxDepth>::
+WriteTrade
+(
+  int       a_instr,
+  time_val  a_ts,
+  SideT     a_side,
+  PxT       a_px,
+  uint      a_qty,
+  AggrT     a_aggr,
+  size_t    a_ord_id,
+  size_t    a_trade_id
+)
+{
+  auto& s   = State(a_instr);
+  auto& hdr = m_dir.Instruments()[a_instr].m_header;
+
+  if (utxx::unlikely(a_ts < s.m_last_ts))
+    UTXX_THROW_RUNTIME_ERROR
+      ("Attempt to write an out-of-order timestamp=",
+       utxx::timestamp::to_string(a_ts, utxx::DATE_TIME_WITH_USEC),
+       " of instrument ", hdr.Instrument(), " to container ", m_filename);
+
+  // Reserved before the price/time chains are read (see WriteQuotes())
+  EnsureSpace(a_instr, 16 + TradeSample::MAX_SIZE());
+
+  int  prev_usec  = s.m_last_usec;
+  bool sec_chng   = WriteSeconds(s, a_ts);
+  auto ts         = sec_chng ? s.m_last_usec : (s.m_last_usec - prev_usec);
+
+  bool delta      = s.m_last_trade_px != NaN();
+  auto px         = NormalizePx<PU>(a_px, hdr);
+  auto px_inc     = delta ? (px - s.m_last_trade_px) : px;
+
+  s.m_last_trade_px = px;
+
+  TradeSample tr(delta, ts, a_side, px_inc, a_qty, a_aggr, a_ord_id, a_trade_id);
+
+  auto p = &s.m_buf[s.m_size];
+  tr.Encode(p);
+  s.m_size = p - &s.m_buf[0];
+  s.m_records++;
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void ContainerWriter<MaxDepth>::
+FlushBlock(int a_instr)
+{
+  auto& s = m_state[a_instr];
+  if (!s.m_size)
+    return;
+
+  char  hdr[8];
+  char* p = hdr;
+  utxx::put32le(p, uint32_t(a_instr));
+  utxx::put32le(p, uint32_t(s.m_size));
+
+  auto pos = ftell(m_file);
+  if (fwrite(hdr, 1, sizeof(hdr), m_file) != sizeof(hdr) ||
+      fwrite(&s.m_buf[0], 1, s.m_size, m_file) != s.m_size)
+    UTXX_THROW_IO_ERROR
+      (errno, "Error writing data block to container ", m_filename);
+
+  m_dir.Instruments()[a_instr].m_extents.emplace_back(
+    ContainerDir::Extent{uint64_t(pos), uint32_t(s.m_size),
+                         s.m_first_sec,  s.m_records});
+
+  s.m_size    = 0;
+  s.m_records = 0;
+  // Force the next block to start with an absolute SecondsSample and full
+  // (non-delta) prices, so blocks can be decoded independently
+  s.m_next_second   = 0;
+  s.m_last_quote_px = NaN();
+  s.m_last_trade_px = NaN();
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void ContainerWriter<MaxDepth>::
+Flush()
+{
+  for (size_t i = 0; i < m_state.size(); ++i)
+    FlushBlock(int(i));
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void ContainerWriter<MaxDepth>::
+Close()
+{
+  if (!m_file)
+    return;
+
+  Flush();
+  m_dir.Write(m_file, m_filename);
+
+  ::fclose(m_file);
+  m_file = nullptr;
+  m_dir  = ContainerDir();
+  m_state.clear();
+}
+
+//==============================================================================
+// ContainerReader implementation
+//==============================================================================
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void ContainerReader<MaxDepth>::
+Open(std::string const& a_filename)
+{
+  if (utxx::unlikely(m_file))
+    UTXX_THROW_RUNTIME_ERROR("Container ", m_filename, " is already open");
+
+  m_filename = a_filename;
+  m_file     = ::fopen(a_filename.c_str(), "r");
+  if (!m_file)
+    UTXX_THROW_IO_ERROR(errno, "Cannot open container ", a_filename);
+
+  try   { m_dir.Read(m_file, m_filename); }
+  catch (...) { Close(); throw; }
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void ContainerReader<MaxDepth>::
+Close()
+{
+  if (!m_file)
+    return;
+  ::fclose(m_file);
+  m_file = nullptr;
+  m_dir  = ContainerDir();
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+template <typename Visitor>
+void ContainerReader<MaxDepth>::
+ReadInstrument(int a_instr, Visitor a_fun)
+{
+  if (utxx::unlikely(a_instr < 0 || size_t(a_instr) >= m_dir.Count()))
+    UTXX_THROW_RUNTIME_ERROR
+      ("Invalid container instrument id ", a_instr, " in ", m_filename);
+
+  for (auto& ext : m_dir.Instruments()[a_instr].m_extents)
+    ReadExtent(a_instr, ext, a_fun);
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+template <typename Visitor>
+void ContainerReader<MaxDepth>::
+ReadAll(Visitor a_fun)
+{
+  // Merge the per-instrument extent lists by block start time.  Each list is
+  // already time-ordered, so a min-heap of (first_sec, instr, extent index)
+  // yields all blocks of the container in global time order
+  using HeapItem = std::tuple<uint32_t, int, size_t>;
+  std::priority_queue<HeapItem, std::vector<HeapItem>,
+                      std::greater<HeapItem>> heap;
+
+  for (size_t i = 0; i < m_dir.Count(); ++i)
+    if (!m_dir.Instruments()[i].m_extents.empty())
+      heap.emplace(m_dir.Instruments()[i].m_extents[0].m_first_sec,
+                   int(i), size_t(0));
+
+  while (!heap.empty()) {
+    auto item  = heap.top();
+    heap.pop();
+    auto instr = std::get<1>(item);
+    auto idx   = std::get<2>(item);
+    auto& exts = m_dir.Instruments()[instr].m_extents;
+
+    ReadExtent(instr, exts[idx], a_fun);
+
+    if (++idx < exts.size())
+      heap.emplace(exts[idx].m_first_sec, instr, idx);
+  }
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+template <typename Visitor>
+void ContainerReader<MaxDepth>::
+ReadExtent(int a_instr, ContainerDir::Extent const& a_ext, Visitor& a_fun)
+{
+  if (fseek(m_file, long(a_ext.m_file_offset), SEEK_SET) < 0)
+    UTXX_THROW_IO_ERROR
+      (errno, "Cannot seek to data block of container ", m_filename);
+
+  char hdr[8];
+  if (fread(hdr, 1, sizeof(hdr), m_file) != sizeof(hdr))
+    UTXX_THROW_IO_ERROR
+      (errno, "Cannot read data block header of container ", m_filename);
+
+  const char* q  = hdr;
+  auto instr     = utxx::get32le(q);
+  auto sz        = utxx::get32le(q);
+  if (utxx::unlikely(instr != uint32_t(a_instr) || sz != a_ext.m_size))
+    UTXX_THROW_RUNTIME_ERROR
+      ("Corrupt data block framing at offset ", a_ext.m_file_offset,
+       " of container ", m_filename);
+
+  if (m_buf.size() < sz)
+    m_buf.resize(sz);
+  if (fread(&m_buf[0], 1, sz, m_file) != sz)
+    UTXX_THROW_IO_ERROR
+      (errno, "Cannot read data block of container ", m_filename);
+
+  DecodeBlock(a_instr, &m_buf[0], sz, a_fun);
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+template <typename Visitor>
+void ContainerReader<MaxDepth>::
+DecodeBlock(int a_instr, const char* a_buf, size_t a_sz, Visitor& a_fun)
+{
+  const char* p   = a_buf;
+  const char* end = a_buf + a_sz;
+
+  // Blocks are self-contained: the chains start from scratch in each one
+  PriceT last_quote_px = NaN();
+  PriceT last_trade_px = NaN();
+
+  while (p < end) {
+    auto x         = *(uint8_t*)p;
+    auto base      = (StreamBase*)&x;
+    bool is_delta  = base->Delta();
+    long n         = 0;
+
+    switch (base->Type()) {
+      case StreamType::Seconds: {
+        SecondsSample ss;
+        n = ss.Read(p, end - p);
+        if (n <= 0) break;
+        m_last_sec    = ss.Time();
+        m_last_usec   = 0;
+        last_quote_px = NaN();
+        last_trade_px = NaN();
+        a_fun(a_instr, ss);
+        break;
+      }
+      case StreamType::Quotes: {
+        QuoteSample<MaxDepth, PriceT> qs;
+        n = qs.Read(p, end - p, is_delta, last_quote_px);
+        if (n <= 0) break;
+        m_last_usec += qs.Time();
+        a_fun(a_instr, qs);
+        break;
+      }
+      case StreamType::Trade: {
+        TradeSample ts;
+        n = ts.Read(p, end - p, is_delta, last_trade_px);
+        if (n <= 0) break;
+        m_last_usec += ts.Time();
+        a_fun(a_instr, ts);
+        break;
+      }
+      default:
+        UTXX_THROW_RUNTIME_ERROR
+          ("Invalid stream type ", int(base->Type()),
+           " in container ", m_filename);
+    }
+
+    if (utxx::unlikely(n <= 0))
+      UTXX_THROW_RUNTIME_ERROR
+        ("Truncated data block of container ", m_filename);
+
+    p += n;
+  }
+}
+
+} // namespace sdb
@@ -0,0 +1,471 @@
+// vim:ts=2:sw=2:et
+//-----------------------------------------------------------------------------
+/// \file  sdb_cursor.hpp
+//------------------------------------------------------------------------------
+/// \brief Pull-based sample iterator over an SDB file
+///
+/// The visitor-based BaseSDBFileIO::Read() drives a whole file in one call,
+/// which makes merging N files by timestamp awkward.  An SDBCursor pulls one
+/// sample at a time instead:
+/// \code
+///   auto cur = file.Cursor();
+///   while (cur.Next())
+///     switch (cur.Type()) {
+///       case StreamType::Quotes: { auto& q = cur.AsQuote(); ... break; }
+///       case StreamType::Trade:  { auto& t = cur.AsTrade(); ... break; }
+///       default: break;
+///     }
+/// \endcode
+/// The per-file decoder state (timestamps, delta-price chains, book
+/// reconstruction) stays inside the underlying file object, so a k-way heap
+/// merge over hundreds of open files is a plain single-threaded loop with no
+/// per-sample allocation.
+///
+/// With Follow(true) the cursor tails a file that is still being written:
+/// Next() waits for growth at EOF and resumes decoding in place, so live
+/// consumers (intraday candles, book dashboards) see new samples with
+/// second-level latency without re-scanning the file.
+//------------------------------------------------------------------------------
+// Copyright (c) 2015 Omnibius, LLC
+// Author:  Serge Aleynikov <saleyn@gmail.com>
+// Created: 2015-10-15
+//------------------------------------------------------------------------------
+#pragma once
+
+#include <sdb/sdb_fmt_io.hxx>
+#include <cstring>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+namespace sdb {
+
+//------------------------------------------------------------------------------
+/// Pull-based cursor over the samples of a file opened for reading.
+/// Create with BaseSDBFileIO::Cursor().  Use one cursor at a time per file
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+struct SDBCursor {
+  using FileIO       = BaseSDBFileIO<MaxDepth>;
+  using QuoteSampleT = QuoteSample<MaxDepth, PriceT>;
+
+  explicit SDBCursor(FileIO& a_file);
+
+  SDBCursor(SDBCursor&& a_rhs);
+  ~SDBCursor();
+
+  SDBCursor(SDBCursor const&)            = delete;
+  SDBCursor& operator=(SDBCursor const&) = delete;
+
+  /// Enable/disable follow (tail) mode for a file still being written.
+  /// When enabled, Next() at the end of file waits for the file to grow
+  /// (inotify on Linux, periodic polling elsewhere) and resumes decoding
+  /// from the retained buffer position, preserving the delta-price state.
+  /// @param a_timeout_msec max time Next() blocks waiting for growth before
+  ///                       returning false (-1 = wait indefinitely).  After
+  ///                       a timeout the cursor stays usable - call Next()
+  ///                       again to keep following
+  void Follow(bool a_enable, int a_timeout_msec = -1) {
+    if (a_enable && (m_compressed || m_mmap))
+      UTXX_THROW_RUNTIME_ERROR
+        ("Follow mode requires an uncompressed file opened without mmap: ",
+         m_file->m_filename);
+    m_follow         = a_enable;
+    m_follow_timeout = a_timeout_msec;
+  }
+
+  /// Advance to the next sample
+  /// @return false at the end of file (in follow mode: when the writer
+  ///         closed the file, or the growth wait timed out)
+  bool Next();
+
+  /// Stream type of the current sample
+  StreamType      Type() const { return m_type;         }
+  /// Full timestamp of the current sample
+  time_val const& Time() const { return m_file->Time(); }
+
+  SecondsSample const& AsSeconds() const { Check(StreamType::Seconds);
+                                           return m_seconds; }
+  /// Current quote (a full book is reconstructed for BookDelta samples,
+  /// which therefore also report Type() == StreamType::Quotes)
+  QuoteSampleT  const& AsQuote()   const { Check(StreamType::Quotes);
+                                           return m_quote;   }
+  TradeSample   const& AsTrade()   const { Check(StreamType::Trade);
+                                           return m_trade;   }
+  OrderSample   const& AsOrder()   const { Check(StreamType::Order);
+                                           return m_order;   }
+  SummarySample const& AsSummary() const { Check(StreamType::Summary);
+                                           return m_summary; }
+  MessageSample const& AsMessage() const { Check(StreamType::Message);
+                                           return m_msg;     }
+
+private:
+  //----------------------------------------------------------------------------
+  /// Visitor capturing the decoded sample into the cursor
+  //----------------------------------------------------------------------------
+  struct Store {
+    SDBCursor& c;
+
+    bool operator()(SecondsSample const& a)
+      { c.m_type = StreamType::Seconds; c.m_seconds = a; return true; }
+    bool operator()(QuoteSampleT  const& a)
+      { c.m_type = StreamType::Quotes;  c.m_quote   = a; return true; }
+    bool operator()(TradeSample   const& a)
+      { c.m_type = StreamType::Trade;   c.m_trade   = a; return true; }
+    bool operator()(OrderSample   const& a)
+      { c.m_type = StreamType::Order;   c.m_order   = a; return true; }
+    bool operator()(SummarySample const& a)
+      { c.m_type = StreamType::Summary; c.m_summary = a; return true; }
+    bool operator()(MessageSample const& a)
+      { c.m_type = StreamType::Message; c.m_msg     = a; return true; }
+
+    template <typename T>
+    bool operator()(T const&)
+      { c.m_type = StreamType::INVALID; return true; }
+  };
+
+  void Check(StreamType a_tp) const {
+    assert(m_type == a_tp); (void)a_tp;
+  }
+
+  /// Refill the stdio read buffer
+  /// @return false when the file is exhausted
+  bool Refill();
+  /// Load the next compressed block into the decode window
+  /// @return false when there are no more blocks
+  bool NextBlock();
+  /// Block until the followed file grows
+  /// @return false on timeout
+  bool WaitForGrowth();
+  /// Follow mode: detect that the writer's Close() appended the seek table
+  /// at EOF and stop the data stream short of it
+  void ClampToSeekTbl();
+
+  FileIO*           m_file;
+
+  const char*       m_p          = nullptr; ///< Current decode window
+  const char*       m_end        = nullptr;
+
+  std::vector<char> m_buf;                  ///< stdio / decompressed data
+  size_t            m_rd         = 0;       ///< Read offset within m_buf
+  size_t            m_wr         = 0;       ///< Fill offset within m_buf
+  size_t            m_next_blk   = 0;       ///< Next compressed block index
+  long              m_data_left  = -1;      ///< Stream data bytes not yet read
+                                            ///< (-1: data runs to end of file)
+  bool              m_compressed = false;
+  bool              m_mmap       = false;
+  bool              m_eof        = false;
+
+  bool              m_follow     = false;   ///< Follow (tail) mode enabled
+  int               m_follow_timeout = -1;  ///< Growth wait timeout (msec)
+  bool              m_writer_done    = false; ///< Writer closed the file
+  int               m_inotify    = -1;      ///< inotify descriptor
+  int               m_watch      = -1;      ///< inotify watch descriptor
+  int               m_waited_msec    = 0;   ///< Accumulated polling wait
+
+  StreamType        m_type       = StreamType::INVALID;
+  SecondsSample     m_seconds;
+  QuoteSampleT      m_quote;
+  TradeSample       m_trade;
+  OrderSample       m_order;
+  SummarySample     m_summary;
+  MessageSample     m_msg;
+};
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+SDBCursor<MaxDepth>::SDBCursor(FileIO& a_file)
+  : m_file(&a_file)
+{
+  // Reset the per-file decoder state (see FileIO::Read())
+  a_file.m_last_quote_px = FileIO::NaN();
+  a_file.m_last_trade_px = FileIO::NaN();
+  a_file.m_last_order_px = FileIO::NaN();
+  a_file.m_rd_book_valid = false;
+
+  if (a_file.m_streams_meta.Compression() != StreamsMeta::CompressT::None) {
+    m_compressed = true;
+    return;                     // First block is loaded by the first Next()
+  }
+
+  if (a_file.m_mem) {
+    m_mmap   = true;
+    auto p   = a_file.m_mem + a_file.m_streams_meta.DataOffset();
+    // In v2 files the seek table follows the data section - don't decode it
+    auto end = a_file.m_mem +
+               (a_file.DataEnd() ? size_t(a_file.DataEnd()) : a_file.m_mem_size);
+
+    if (p + 4 > end)
+      UTXX_THROW_RUNTIME_ERROR
+        ("Can't read beginning of data marker ", a_file.m_filename);
+
+    auto q = p;
+    if (uint(utxx::get32le(q)) != BEGIN_STREAM_DATA())
+      UTXX_THROW_RUNTIME_ERROR
+        ("Invalid beginning of data marker: ", a_file.m_filename);
+    m_p   = q;
+    m_end = end;
+    return;
+  }
+
+  if (fseek(a_file.m_file, a_file.m_streams_meta.DataOffset(), SEEK_SET) < 0)
+    UTXX_THROW_IO_ERROR
+      (errno, "Can't find file data offset ",
+       a_file.m_streams_meta.DataOffset(), ": ", a_file.m_filename);
+
+  char buf[4];
+  if (fread(buf, 1, sizeof(buf), a_file.m_file) != sizeof(buf))
+    UTXX_THROW_IO_ERROR
+      (errno, "Can't read beginning of data marker ", a_file.m_filename);
+
+  if (uint(utxx::cast32le(buf)) != BEGIN_STREAM_DATA())
+    UTXX_THROW_RUNTIME_ERROR
+      ("Invalid beginning of data marker: ", a_file.m_filename);
+
+  // In v2 files the seek table follows the data section - don't decode it
+  if (a_file.DataEnd())
+    m_data_left = a_file.DataEnd() - ftell(a_file.m_file);
+
+  m_buf.resize(64*1024);
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+SDBCursor<MaxDepth>::SDBCursor(SDBCursor&& a_rhs)
+  : m_file      (a_rhs.m_file)
+  , m_p         (a_rhs.m_p)
+  , m_end       (a_rhs.m_end)
+  , m_buf       (std::move(a_rhs.m_buf))
+  , m_rd        (a_rhs.m_rd)
+  , m_wr        (a_rhs.m_wr)
+  , m_next_blk  (a_rhs.m_next_blk)
+  , m_data_left (a_rhs.m_data_left)
+  , m_compressed(a_rhs.m_compressed)
+  , m_mmap      (a_rhs.m_mmap)
+  , m_eof       (a_rhs.m_eof)
+  , m_follow    (a_rhs.m_follow)
+  , m_follow_timeout(a_rhs.m_follow_timeout)
+  , m_writer_done   (a_rhs.m_writer_done)
+  , m_inotify   (a_rhs.m_inotify)
+  , m_watch     (a_rhs.m_watch)
+  , m_type      (a_rhs.m_type)
+{
+  a_rhs.m_inotify = -1;
+  a_rhs.m_watch   = -1;
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+SDBCursor<MaxDepth>::~SDBCursor()
+{
+#ifdef __linux__
+  if (m_inotify >= 0)
+    ::close(m_inotify);
+#endif
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+bool SDBCursor<MaxDepth>::
+WaitForGrowth()
+{
+#ifdef __linux__
+  if (m_inotify < 0) {
+    m_inotify = inotify_init1(IN_CLOEXEC);
+    if (m_inotify < 0)
+      UTXX_THROW_IO_ERROR(errno, "Can't create inotify descriptor");
+    m_watch = inotify_add_watch
+      (m_inotify, m_file->m_filename.c_str(), IN_MODIFY | IN_CLOSE_WRITE);
+    if (m_watch < 0)
+      UTXX_THROW_IO_ERROR
+        (errno, "Can't watch file for changes: ", m_file->m_filename);
+  }
+
+  struct pollfd pfd = { m_inotify, POLLIN, 0 };
+  int rc = poll(&pfd, 1, m_follow_timeout);
+  if (rc == 0)
+    return false;                               // Timed out
+  if (rc < 0) {
+    if (errno == EINTR)
+      return true;
+    UTXX_THROW_IO_ERROR
+      (errno, "Error waiting for file changes: ", m_file->m_filename);
+  }
+
+  char buf[4096];
+  auto n = ::read(m_inotify, buf, sizeof(buf));
+  for (auto p = buf, e = buf + (n > 0 ? n : 0); p < e; ) {
+    auto ev = reinterpret_cast<struct inotify_event const*>(p);
+    if (ev->mask & IN_CLOSE_WRITE)
+      m_writer_done = true;
+    p += sizeof(struct inotify_event) + ev->len;
+  }
+  // Before consuming the bytes that arrived with this wakeup, check whether
+  // they include a close-time seek table the cursor must not decode
+  ClampToSeekTbl();
+  return true;
+#else
+  // No inotify on this platform - fall back to periodic polling
+  static const int POLL_MSEC = 50;
+  if (m_follow_timeout >= 0 && m_waited_msec >= m_follow_timeout)
+    return false;
+  std::this_thread::sleep_for(std::chrono::milliseconds(POLL_MSEC));
+  m_waited_msec += POLL_MSEC;
+  ClampToSeekTbl();
+  return true;
+#endif
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void SDBCursor<MaxDepth>::
+ClampToSeekTbl()
+{
+  // A live file with a seek table slot has SeekTblOffset == 0: the slot is
+  // only linked by the writer's Close(), which appends the table right after
+  // the last data block.  Until then the cursor reads to EOF (m_data_left is
+  // -1), so once the slot becomes non-zero the remaining data must be
+  // bounded - and any table bytes already buffered dropped - lest the table
+  // decode as fabricated samples.  A linked table also means the writer is
+  // done: Next() can return its final false instead of waiting for growth
+  if (m_data_left >= 0)
+    return;
+
+  auto& meta = m_file->m_streams_meta;
+  if (!meta.HasSeekTbl() || !meta.RereadSeekTblOffset(m_file->m_file))
+    return;
+
+  m_writer_done = true;
+
+  long dend = m_file->DataEnd();
+  long pos  = ftell(m_file->m_file);
+
+  if (pos <= dend)
+    m_data_left = dend - pos;
+  else {
+    // The buffer tail holds bytes of the appended table - trim them
+    m_wr       -= std::min(size_t(pos - dend), m_wr - m_rd);
+    m_data_left = 0;
+  }
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+bool SDBCursor<MaxDepth>::
+Refill()
+{
+  // Move the undecoded tail to the front and append more file data
+  if (m_rd) {
+    memmove(&m_buf[0], &m_buf[m_rd], m_wr - m_rd);
+    m_wr -= m_rd;
+    m_rd  = 0;
+  }
+
+  while (true) {
+    auto want = long(m_buf.size() - m_wr);
+    if (m_data_left >= 0)
+      want = std::min(want, m_data_left);  // Stop short of the seek table
+
+    auto n = want > 0 ? fread(&m_buf[m_wr], 1, want, m_file->m_file)
+                      : size_t(0);
+    if  (n > 0) {
+      m_wr += n;
+      if (m_data_left >= 0)
+        m_data_left -= n;
+      else if (m_follow)
+        // The writer may have closed between wakeups, in which case this
+        // read has picked up (part of) the appended seek table - trim it
+        ClampToSeekTbl();
+      m_waited_msec = 0;
+      return true;
+    }
+
+    if (!want || !m_follow || m_writer_done || !WaitForGrowth())
+      return false;
+
+    clearerr(m_file->m_file);           // fread() latched the EOF indicator
+  }
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+bool SDBCursor<MaxDepth>::
+NextBlock()
+{
+  if (m_next_blk >= m_file->m_streams_meta.Blocks().size())
+    return false;
+
+  auto rsz = m_file->DecompressBlock(m_next_blk++, m_buf);
+  m_p      = &m_buf[0];
+  m_end    = m_p + rsz;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+bool SDBCursor<MaxDepth>::
+Next()
+{
+  if (utxx::unlikely(m_eof))
+    return false;
+
+  Store store{*this};
+
+  //----------------------------------------------------------------------------
+  // Compressed and mmaped files decode out of a contiguous window
+  //----------------------------------------------------------------------------
+  if (m_compressed || m_mmap) {
+    while (true) {
+      long n = m_p < m_end
+             ? m_file->ReadSample(m_p, m_end - m_p, store) : 0;
+      if (n > 0) {
+        m_p += n;
+        return true;
+      }
+      // Truncated tail: mmap mode is done, compressed moves to the next block
+      if (!m_compressed || !NextBlock()) {
+        m_eof = true;
+        return false;
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Buffered stdio path
+  //----------------------------------------------------------------------------
+  while (true) {
+    long n = m_rd < m_wr
+           ? m_file->ReadSample(&m_buf[m_rd], m_wr - m_rd, store) : 0;
+
+    if (n > 0) {
+      m_rd += n;
+      return true;
+    }
+    if (n < 0)
+      UTXX_THROW_IO_ERROR
+        (errno, "Error reading from file ", m_file->m_filename);
+
+    if (!Refill()) {
+      // A follow-mode timeout is not final - Next() may be called again
+      m_eof = !m_follow || m_writer_done;
+      return false;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+// Factory (declared in sdb_fmt_io.hpp)
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+inline SDBCursor<MaxDepth> BaseSDBFileIO<MaxDepth>::
+Cursor()
+{
+  return SDBCursor<MaxDepth>(*this);
+}
+
+} // namespace sdb
@@ -39,6 +39,39 @@ inline char ToChar(AggrT a) {
   return s[int(a)];
 }
 
+/// Format a price given in integer price steps as the fixed-point decimal
+/// a_px/a_scale with \a a_precision fractional digits.  This avoids the
+/// float conversion and locale-aware ostream insertion on output hot paths.
+/// @return number of characters written (not NUL-terminated)
+inline int FormatPx(char* a_buf, long a_px, int a_scale, int a_precision)
+{
+  char* p = a_buf;
+  auto  v = a_px;
+
+  if (v < 0) { *p++ = '-'; v = -v; }
+
+  long whole = a_scale ? v / a_scale : v;
+  long frac  = a_scale ? v % a_scale : 0;
+
+  char tmp[24];
+  int  n = 0;
+  do    { tmp[n++] = char('0' + whole % 10); whole /= 10; } while (whole);
+  while (n) *p++ = tmp[--n];
+
+  if (a_precision > 0) {
+    *p++ = '.';
+    long pow10 = 1;
+    for (int i = 0; i < a_precision; ++i) pow10 *= 10;
+    // Rescale for non-power-of-10 scales (e.g. px_step=0.05 -> scale=20)
+    if (a_scale && a_scale != pow10)
+      frac = frac * pow10 / a_scale;
+    for (pow10 /= 10; pow10; pow10 /= 10)
+      *p++ = char('0' + (frac / pow10) % 10);
+  }
+
+  return p - a_buf;
+}
+
 inline const char* ToString(AggrT a) {
   static const char* s[] = {"Undef", "Aggr", "Pass"};
   return s[int(a)];
@@ -67,6 +100,28 @@ inline int uleb128_encode(uint64_t a_value, char*& a_buf) {
 /// File opening mode
 enum OpenMode  { Read, Write, Append };
 
+/// Method of reading the stream data section of a file
+enum ReadMode  {
+    StdIO     // Buffered stdio reads into an intermediate buffer
+  , UseMmap   // Zero-copy decoding directly out of a memory-mapped region
+  , Prefetch  // A prefetch thread reads large buffers ahead of the decoder
+              // (double-buffered), overlapping file I/O with decode work
+};
+
+/// Backpressure policy of the asynchronous writer when the I/O thread
+/// falls behind the encoding thread
+enum class BackPressureT {
+    Block     // Block the encoding thread until a buffer becomes free
+  , Drop      // Drop the block being flushed (count it in DroppedBlocks())
+};
+
+/// Output backend used for the stream data section of a file
+enum class WriteBackendT {
+    Buffered  // Buffered stdio writes through the page cache (default)
+  , Direct    // Aligned O_DIRECT writes bypassing the page cache
+              // (submitted through io_uring when compiled with liburing)
+};
+
 enum PriceUnit {
     DoubleVal     // Price expressed in floating decimal point (e.g. px=0.01)
   , PrecisionVal  // Adjusted value with precision (e.g. precision=2, px=100)
@@ -81,6 +136,7 @@ enum class StreamType : char {
   , Order
   , Summary
   , Message
+  , BookDelta // Incremental book update against the previous quote
   , INVALID
 };
 
@@ -93,8 +149,15 @@ std::string ToString(uuid const& a);
 //------------------------------------------------------------------------------
 // SDB data format constants
 //------------------------------------------------------------------------------
-/// SDB version
-static constexpr uint VERSION()           { return 1;          }
+/// SDB version written by this library.
+/// Version 2 widens the on-disk DataOffset fields of StreamsMeta and
+/// CandleHeader to 64 bits (lifting the 4GB cap on a stream data section)
+/// and records every data block of uncompressed files in the seek table
+/// together with a per-block sample count, so readers can decode block
+/// extents independently and in parallel (see BaseSDBFileIO::ReadBlock())
+static constexpr uint VERSION()           { return 2;          }
+/// Oldest SDB version this library can read
+static constexpr uint MIN_VERSION()       { return 1;          }
 /// SDB marker indicating beginning of stream data section
 static constexpr uint BEGIN_STREAM_DATA() { return 0xABBABABA; }
 
@@ -206,9 +269,30 @@ struct StreamsMeta {
 
   enum class CompressT {
     None,   // No compression
-    GZip    // Gzip compression
+    GZip,   // Gzip compression
+    Zstd    // Framed zstd block compression with a seek table
+  };
+
+  /// Uncompressed size of a data block used with CompressT::Zstd.
+  /// Samples never straddle block boundaries, and each block begins with an
+  /// absolute SecondsSample, so blocks can be decompressed independently.
+  static constexpr size_t COMP_BLOCK_SIZE() { return 256*1024; }
+
+  //----------------------------------------------------------------------------
+  /// Seek table entry describing one independently decodable data block.
+  /// For compressed files m_file_offset points at the block's framing header;
+  /// for uncompressed v2 files it points at the block's first sample and
+  /// m_raw_offset equals m_file_offset
+  //----------------------------------------------------------------------------
+  struct CompBlock {
+    uint64_t m_file_offset;  // Offset of the block in file
+    uint64_t m_raw_offset;   // Uncompressed offset within the stream data
+    uint32_t m_first_sec;    // Secs since midnight of the block's first sample
+    uint32_t m_records;      // Number of samples in the block (0 in v1 files)
   };
 
+  using CompBlocksVec = std::vector<CompBlock>;
+
   //----------------------------------------------------------------------------
   /// Stream Metadata
   //----------------------------------------------------------------------------
@@ -232,7 +316,7 @@ struct StreamsMeta {
   StreamsMeta
   (
     std::initializer_list<StreamType> a_streams,
-    uint32_t                          a_data_offset = 0,
+    uint64_t                          a_data_offset = 0,
     CompressT                         a_cmp         = CompressT::None
   )
     : m_compression(a_cmp)
@@ -245,7 +329,7 @@ struct StreamsMeta {
   StreamsMeta
   (
     StreamsVec&&                      a_streams,
-    uint32_t                          a_data_offset = 0,
+    uint64_t                          a_data_offset = 0,
     CompressT                         a_cmp         = CompressT::None
   )
     : m_compression(a_cmp)
@@ -253,27 +337,76 @@ struct StreamsMeta {
     , m_streams    (std::move(a_streams))
   {}
 
+  /// SDB format version of the file this metadata belongs to.  Governs the
+  /// width of the on-disk DataOffset field (32 bits in v1, 64 bits in v2)
+  /// and the seek table entry layout
+  uint          Version()         const { return m_version;         }
+  void          Version(uint a)         { m_version = a;            }
+
   /// Position in file of Beginning of Data Marker (BEGIN_STREAM_DATA)
-  uint          DataOffset()      const { return m_data_offset;     }
+  uint64_t      DataOffset()      const { return m_data_offset;     }
 
   /// Position in file of the DataOffset field
   uint          DataOffsetPos()   const { return m_data_offset_pos; }
 
   int           Count()           const { return m_streams.size();  }
 
+  StreamsVec const& Streams()     const { return m_streams;         }
+
+  CompressT     Compression()     const { return m_compression;     }
+  void          Compression(CompressT a){ m_compression = a;        }
+
+  /// True when the file has a seek table slot: always in v2 files, and only
+  /// for compressed files in v1
+  bool HasSeekTbl() const
+    { return m_version >= 2 || m_compression != CompressT::None; }
+
+  /// Position of the seek table in file (0 when the table hasn't been
+  /// written, e.g. the file wasn't closed cleanly).  The table follows the
+  /// last data block, so it also marks the end of the stream data section
+  uint64_t      SeekTblOffset()   const { return m_seek_tbl_off;    }
+  void          SeekTblOffset(uint64_t a) { m_seek_tbl_off = a;     }
+
+  /// Per-block seek table (compressed and v2 files)
+  CompBlocksVec const& Blocks()   const { return m_blocks;          }
+
+  void AddBlock(uint64_t a_file_off, uint64_t a_raw_off, uint32_t a_first_sec,
+                uint32_t a_records = 0) {
+    m_blocks.emplace_back(CompBlock{a_file_off,a_raw_off,a_first_sec,a_records});
+  }
+
   /// Read StreamsMeta from file
   /// This method must be called right after reading the file's header!
   void Read(FILE* a_file);
   /// Write StreamsMeta to file
   int  Write(FILE* a_file, int a_debug = 0);
   /// Update beginning of data offset in the StreamsMeta header
-  int  WriteDataOffset(FILE* a_file, uint a_data_offset);
+  int  WriteDataOffset(FILE* a_file, uint64_t a_data_offset);
+
+  /// Append the seek table at the end of file and link it to the header.
+  /// Must be called after the last data block has been written.
+  int  WriteSeekTbl(FILE* a_file);
+  /// Read the seek table (position in file is preserved)
+  void ReadSeekTbl (FILE* a_file);
+  /// Re-read the SeekTblOffset slot of a file opened for reading (position
+  /// in file is preserved).  A live file has a zero slot - it is only linked
+  /// by the writer's Close() - so a follower of a growing file polls it to
+  /// detect that the table has been appended at the end of the data
+  /// @return true when the slot is (now) non-zero
+  bool RereadSeekTblOffset(FILE* a_file);
+  /// Unlink the seek table from the header (the in-memory blocks are kept),
+  /// so that appended data can overwrite it and the table can be rewritten
+  int  ClearSeekTbl(FILE* a_file);
 
 private:
+  uint          m_version         = VERSION();
   CompressT     m_compression     = CompressT::None;
   uint          m_data_offset_pos = 0;
-  uint          m_data_offset     = 0;
+  uint64_t      m_data_offset     = 0;
+  uint64_t      m_seek_tbl_pos    = 0; ///< Position of the SeekTblOffset field
+  uint64_t      m_seek_tbl_off    = 0; ///< Position of the seek table in file
   StreamsVec    m_streams;
+  CompBlocksVec m_blocks;
 };
 
 
@@ -346,7 +479,7 @@ struct CandleHeader {
     uint16_t a_resolution,
     int      a_start_time,
     int      a_end_time,
-    uint32_t a_data_offset = 0
+    uint64_t a_data_offset = 0
   )
     : m_resolution (a_resolution)
     , m_start_time (a_start_time)
@@ -384,6 +517,11 @@ struct CandleHeader {
   void              LastUpdated(Candle* a)          { m_last_updated = a;   }
   Candle*           TimeToCandle(int a_ts);
 
+  /// Candle containing \a a_ts resolved through the cached current-bucket
+  /// window: the common case (same bucket as the previous call) is a pair
+  /// of compares, the division in TimeToCandle() runs only on rollover
+  Candle*           CachedCandle(int a_ts);
+
   /// Convert candle index \a a_idx to StartTime since UTC
   int               CandleToTime(uint a_idx) const;
 private:
@@ -391,6 +529,9 @@ private:
   int        m_start_time;
   size_t     m_data_offset;
   Candle*    m_last_updated = nullptr; // Last updated candle
+  int        m_cur_start    = 0;       // Time window of the cached bucket
+  int        m_cur_end      = 0;       // (the cache is empty when start==end)
+  int        m_cur_idx      = -1;      // Candle index of the cached bucket
   CandlesVec m_candles;
 
   static int CalcSize(int a_start_time, int a_end_time, uint16_t a_resolution);
@@ -415,6 +556,11 @@ struct CandlesMeta {
   CandleHeaderVec&        Headers()       { return m_candle_headers; }
   CandleHeaderVec const&  Headers() const { return m_candle_headers; }
 
+  /// SDB format version of the file this metadata belongs to (governs the
+  /// width of the on-disk CandleData offset field: 32 bits in v1, 64 in v2)
+  uint                    Version() const { return m_version;        }
+  void                    Version(uint a) { m_version = a;           }
+
   /// Read StreamsMeta from file.
   /// This method must be called right after reading the file's header!
   void Read(FILE* a_file);
@@ -441,6 +587,7 @@ struct CandlesMeta {
   /// @return true on success or false if there was a problem writing data
   bool CommitCandles(FILE* a_file);
 private:
+  uint            m_version = VERSION();
   CandleHeaderVec m_candle_headers;
 };
 
@@ -479,6 +626,9 @@ struct SecondsSample : public StreamBase {
   int  Time()             const { return m_time;      }
   void Time(int a_midsecs)      { m_time = a_midsecs; }
 
+  /// Encode the sample into \a a_buf and advance the pointer
+  int  Encode(char*& a_buf);
+
   int  Write(FILE* a_file);
 
   int  Read(const char* a_buf, size_t a_sz);
@@ -544,6 +694,15 @@ struct QuoteSample : public StreamBase {
   int              AskCount()   const { return m_ask_cnt; }
 
   PxLevelsT const& Levels()     const { return m_levels; }
+  PxLevelsT&       Levels()           { return m_levels; }
+
+  /// Reset time and level counts (used when the book is rebuilt in place,
+  /// e.g. by BookDeltaSample::Apply())
+  void Set(uint a_time, int a_bid_cnt, int a_ask_cnt) {
+    m_time    = a_time;
+    m_bid_cnt = a_bid_cnt;
+    m_ask_cnt = a_ask_cnt;
+  }
 
   PxLevelT  const* BestBid()    const { return &m_levels[m_bid_cnt-1]; }
   PxLevelT  const* BestAsk()    const { return &m_levels[m_bid_cnt];   }
@@ -554,6 +713,12 @@ struct QuoteSample : public StreamBase {
   static void  NextBid(PxLevelT const*& p) { --p; }
   static void  NextAsk(PxLevelT const*& p) { ++p; }
 
+  /// Max number of bytes Encode() may need
+  static constexpr size_t MAX_SIZE() { return 1024; }
+
+  /// Encode the sample into \a a_buf and advance the pointer
+  int   Encode(char*& a_buf);
+
   int   Write(FILE* a_file);
 
   int   Read(const char* a_buf, size_t a_sz, bool a_is_delta, PxT& a_last_px);
@@ -562,6 +727,93 @@ private:
   PxLevelsT m_levels;
   int       m_bid_cnt;
   int       m_ask_cnt;
+
+  /// Tag carrying a compile-time level count for the unrolled codec paths
+  template <uint N> struct DepthTag {};
+
+  /// Copy N levels between the level array and the batch codec's value
+  /// array, fully unrolled (Encode()/Read() tag-dispatch here when a sample
+  /// carries the full instantiated depth - the common full-snapshot case,
+  /// where the unrolling removes the per-level loop branch and lets small
+  /// depths stay in registers)
+  template <uint N>
+  static void GatherLevels (int64_t* a_v, PxLevelT const* a_p, DepthTag<N>);
+  static void GatherLevels (int64_t*,     PxLevelT const*,     DepthTag<0>) {}
+
+  /// Prefix-sum N delta-encoded levels starting at \a a_p, unrolled
+  template <uint N>
+  static void ScatterLevels(int64_t const* a_v, PxLevelT* a_p, PxT& a_last,
+                            DepthTag<N>);
+  static void ScatterLevels(int64_t const*, PxLevelT*, PxT&, DepthTag<0>) {}
+};
+
+//------------------------------------------------------------------------------
+/// Incremental book update: only the levels that changed since the previous
+/// quote are encoded as (index, price, qty) ops against the prior snapshot.
+/// A full QuoteSample is still written at every new second (and at compressed
+/// block boundaries) as a resync point, so seeking stays possible.
+/// Decoding applies the ops to the previously reconstructed book, yielding a
+/// complete QuoteSample for the visitor (see BaseSDBFileIO::ReadSample()).
+//------------------------------------------------------------------------------
+template <uint MaxDepth, typename PxT>
+struct BookDeltaSample : public StreamBase {
+  // Level counts are nibble-encoded, like in QuoteSample: depth caps at 15
+
+  using QuoteSampleT = QuoteSample<MaxDepth, PxT>;
+
+  /// One changed level: set level \a m_idx of its side to (m_px, m_qty).
+  /// On the wire m_px is relative to the prior snapshot's price at the same
+  /// index (absolute when the index is beyond the prior side's depth)
+  struct LevelOp {
+    uint8_t m_idx;
+    PxT     m_px;
+    int     m_qty;
+  };
+
+  BookDeltaSample() : StreamBase(true, StreamType::BookDelta) {}
+
+  /// Max number of bytes Encode() may need
+  static constexpr size_t MAX_SIZE() { return 1024; }
+
+  int  Time()     const { return m_time;    }
+  int  BidCount() const { return m_bid_cnt; }
+  int  AskCount() const { return m_ask_cnt; }
+  int  BidOps()   const { return m_bid_ops; }
+  int  AskOps()   const { return m_ask_ops; }
+
+  /// Decoded level ops: bid ops followed by ask ops (used by callers that
+  /// apply deltas to their own book representation, e.g. Query())
+  LevelOp const* Ops() const { return &m_ops[0]; }
+
+  /// Populate this sample with the difference between two books given in
+  /// stored level order (bids ascending by price, then asks ascending).
+  /// @return false when the books are identical (nothing to write)
+  bool Diff(QuoteSampleT const& a_prev, QuoteSampleT const& a_curr, uint a_ts);
+
+  /// Apply the ops of this sample to the previously reconstructed book
+  /// \a a_book, turning it into the full current snapshot
+  void Apply(QuoteSampleT& a_book) const;
+
+  /// Encode the sample into \a a_buf and advance the pointer
+  int  Encode(char*& a_buf);
+
+  int  Read(const char* a_buf, size_t a_sz);
+
+private:
+  uint    m_time    = 0;
+  int     m_bid_cnt = 0;                  ///< Level count of the new book
+  int     m_ask_cnt = 0;
+  int     m_bid_ops = 0;
+  int     m_ask_ops = 0;
+  std::array<LevelOp, MaxDepth*2> m_ops;  ///< Bid ops followed by ask ops
+
+  /// Diff one side given as subranges of the stored level arrays
+  void DiffSide
+  (
+    PxLevel<PxT> const* a_old, int a_old_cnt,
+    PxLevel<PxT> const* a_new, int a_new_cnt,
+    int&                a_ops
+  );
 };
 
 //------------------------------------------------------------------------------
@@ -646,6 +898,12 @@ struct TradeSample : public StreamBase {
 
   void      Set(FieldMask a, PriceT a_px, int a_qty, size_t a_tid, size_t a_oid);
 
+  /// Max number of bytes Encode() may need
+  static constexpr size_t MAX_SIZE() { return 128; }
+
+  /// Encode the sample into \a a_buf and advance the pointer
+  int       Encode(char*& a_buf);
+
   int       Write(FILE* a_file);
   int       Read (const char* a_buf, size_t  a_sz,
                   bool   a_is_delta, PriceT& a_last_px);
@@ -661,6 +919,180 @@ private:
   uint      m_qty;
 };
 
+//------------------------------------------------------------------------------
+/// Representation of an Order sample
+/// \see https://github.com/saleyn/sdb/wiki/Data-Format#order-stream
+//------------------------------------------------------------------------------
+struct OrderSample : public StreamBase {
+  enum class ActionT : char { Add, Modify, Delete };
+
+  struct FieldMask {
+    char action   : 2;
+    bool side     : 1;
+    bool has_px   : 1;
+    bool has_qty  : 1;
+    char _unused  : 3;
+
+    FieldMask()           { *(uint8_t*)this = 0; }
+    FieldMask(uint8_t a)  { *(uint8_t*)this = a; }
+    FieldMask(FieldMask const&) = default;
+    FieldMask(ActionT a_act, SideT a_sd, bool a_has_px, bool a_has_qty)
+      : action (char(a_act))
+      , side   (a_sd == SideT::Sell)
+      , has_px (a_has_px)
+      , has_qty(a_has_qty)
+      ,_unused (0)
+    {
+      static_assert(sizeof(FieldMask) == sizeof(uint8_t), "Invalid size");
+    }
+  };
+
+  OrderSample() {}
+  OrderSample(bool a_delta, FieldMask a_mask, uint a_ts, size_t a_order_id,
+              PriceT a_px, int a_qty)
+    : StreamBase(a_delta, StreamType::Order)
+    , m_mask    (a_mask)
+    , m_time    (a_ts)
+    , m_order_id(a_order_id)
+    , m_px      (a_px)
+    , m_qty     (a_qty)
+  {}
+
+  OrderSample(bool a_delta, uint a_ts, ActionT a_act, SideT a_sd,
+              size_t a_order_id, PriceT a_px, int a_qty)
+    : OrderSample(a_delta, FieldMask(a_act, a_sd,
+                  a_act != ActionT::Delete, a_qty != 0),
+                  a_ts, a_order_id, a_px, a_qty)
+  {}
+
+  uint      Time()     const { return m_time;                }
+  ActionT   Action()   const { return ActionT(m_mask.action);}
+  SideT     Side()     const { return SideT(m_mask.side);    }
+  bool      HasPx()    const { return m_mask.has_px;         }
+  bool      HasQty()   const { return m_mask.has_qty;        }
+  size_t    OrderID()  const { return m_order_id;            }
+  PriceT    Price()    const { return m_px;                  }
+  int       Qty()      const { return m_qty;                 }
+
+  /// Max number of bytes Encode() may need
+  static constexpr size_t MAX_SIZE() { return 64; }
+
+  /// Encode the sample into \a a_buf and advance the pointer
+  int       Encode(char*& a_buf);
+
+  int       Write(FILE* a_file);
+  int       Read (const char* a_buf, size_t  a_sz,
+                  bool   a_is_delta, PriceT& a_last_px);
+
+private:
+  FieldMask m_mask;
+  uint      m_time;
+  size_t    m_order_id;
+  PriceT    m_px;
+  int       m_qty;
+};
+
+inline char ToChar(OrderSample::ActionT a) {
+  static const char s[] = {'A','M','D'}; return s[int(a)];
+}
+
+//------------------------------------------------------------------------------
+/// Representation of a market/trading Summary sample
+/// \see https://github.com/saleyn/sdb/wiki/Data-Format#summary-stream
+//------------------------------------------------------------------------------
+struct SummarySample : public StreamBase {
+  struct FieldMask {
+    bool has_bid_qty  : 1;
+    bool has_ask_qty  : 1;
+    bool has_open_pos : 1;
+    bool has_risk     : 1;
+    char _unused      : 4;
+
+    FieldMask()           { *(uint8_t*)this = 0; }
+    FieldMask(uint8_t a)  { *(uint8_t*)this = a; }
+    FieldMask(FieldMask const&) = default;
+    FieldMask(bool a_has_bq, bool a_has_aq, bool a_has_pos, bool a_has_risk)
+      : has_bid_qty (a_has_bq)
+      , has_ask_qty (a_has_aq)
+      , has_open_pos(a_has_pos)
+      , has_risk    (a_has_risk)
+      ,_unused      (0)
+    {
+      static_assert(sizeof(FieldMask) == sizeof(uint8_t), "Invalid size");
+    }
+  };
+
+  SummarySample() {}
+  SummarySample(uint a_ts,
+                int  a_bid_qty      = -1,    int    a_ask_qty = -1,
+                bool a_has_open_pos = false, int    a_open_pos = 0,
+                bool a_has_risk     = false, double a_risk     = 0.0)
+    : StreamBase(false, StreamType::Summary)
+    , m_mask    (a_bid_qty >= 0, a_ask_qty >= 0, a_has_open_pos, a_has_risk)
+    , m_time    (a_ts)
+    , m_bid_qty (a_bid_qty)
+    , m_ask_qty (a_ask_qty)
+    , m_open_pos(a_open_pos)
+    , m_risk    (a_risk)
+  {}
+
+  uint      Time()       const { return m_time;               }
+  bool      HasBidQty()  const { return m_mask.has_bid_qty;   }
+  bool      HasAskQty()  const { return m_mask.has_ask_qty;   }
+  bool      HasOpenPos() const { return m_mask.has_open_pos;  }
+  bool      HasRisk()    const { return m_mask.has_risk;      }
+  int       BidQty()     const { return m_bid_qty;            }
+  int       AskQty()     const { return m_ask_qty;            }
+  int       OpenPos()    const { return m_open_pos;           }
+  double    Risk()       const { return m_risk;               }
+
+  /// Max number of bytes Encode() may need
+  static constexpr size_t MAX_SIZE() { return 64; }
+
+  /// Encode the sample into \a a_buf and advance the pointer
+  int       Encode(char*& a_buf);
+
+  int       Write(FILE* a_file);
+  int       Read (const char* a_buf, size_t a_sz);
+
+private:
+  FieldMask m_mask;
+  uint      m_time;
+  int       m_bid_qty;
+  int       m_ask_qty;
+  int       m_open_pos;
+  double    m_risk;
+};
+
+//------------------------------------------------------------------------------
+/// Representation of a free-form string Message sample
+/// \see https://github.com/saleyn/sdb/wiki/Data-Format#message-stream
+//------------------------------------------------------------------------------
+struct MessageSample : public StreamBase {
+  MessageSample() {}
+  MessageSample(uint a_ts, const char* a_msg, size_t a_sz)
+    : StreamBase(false, StreamType::Message)
+    , m_time    (a_ts)
+    , m_msg     (a_msg, a_sz)
+  {}
+
+  uint               Time() const { return m_time; }
+  std::string const& Msg()  const { return m_msg;  }
+
+  /// Number of bytes Encode() may need for this sample
+  size_t    Size() const { return m_msg.size() + 16; }
+
+  /// Encode the sample into \a a_buf and advance the pointer
+  int       Encode(char*& a_buf);
+
+  int       Write(FILE* a_file);
+  int       Read (const char* a_buf, size_t a_sz);
+
+private:
+  uint        m_time;
+  std::string m_msg;
+};
+
 } // namespace sdb
 
 #include <sdb/sdb_fmt.hxx> // Include implementation
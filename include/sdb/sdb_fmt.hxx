@@ -13,6 +13,9 @@
 #pragma once
 
 #include <sdb/sdb_fmt.hpp>
+#include <sdb/sdb_leb128.hpp>
+
+#include <algorithm>
 
 #include <utxx/time.hpp>
 #include <utxx/print.hpp>
@@ -35,6 +38,24 @@ TimeToCandle(int a_ts)
   return utxx::unlikely(invalid) ? nullptr : &m_candles[n];
 }
 
+//------------------------------------------------------------------------------
+inline Candle* CandleHeader::
+CachedCandle(int a_ts)
+{
+  if (utxx::likely(a_ts >= m_cur_start && a_ts < m_cur_end))
+    return &m_candles[m_cur_idx];     // Same bucket as the previous call
+
+  auto c = TimeToCandle(a_ts);
+  if (utxx::likely(c != nullptr)) {
+    // The cache holds an index, not a pointer, so copied headers (catalog
+    // entries, state trailers) never dereference another vector's storage
+    m_cur_idx   = int(c - &m_candles[0]);
+    m_cur_start = m_start_time + m_resolution * m_cur_idx;
+    m_cur_end   = m_cur_start  + m_resolution;
+  }
+  return c;
+}
+
 //------------------------------------------------------------------------------
 inline int CandleHeader::
 CandleToTime(uint a_idx) const
@@ -47,26 +68,71 @@ CandleToTime(uint a_idx) const
 // QuoteSample
 //==============================================================================
 template <uint MaxDepth, typename PxT>
+template <uint N>
+void QuoteSample<MaxDepth, PxT>::
+GatherLevels(int64_t* a_v, PxLevelT const* a_p, DepthTag<N>)
+{
+  a_v[0] = a_p->m_px;
+  a_v[1] = a_p->m_qty;
+  GatherLevels(a_v + 2, a_p + 1, DepthTag<N-1>());
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth, typename PxT>
+template <uint N>
+void QuoteSample<MaxDepth, PxT>::
+ScatterLevels(int64_t const* a_v, PxLevelT* a_p, PxT& a_last, DepthTag<N>)
+{
+  a_p->m_px  = PxT(a_v[0]) + a_last;
+  a_p->m_qty = int(a_v[1]);
+  a_last     = a_p->m_px;
+  ScatterLevels(a_v + 2, a_p + 1, a_last, DepthTag<N-1>());
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth, typename PxT>
 int QuoteSample<MaxDepth, PxT>::
-Write(FILE* a_file)
+Encode(char*& a_buf)
 {
   if (utxx::unlikely((m_bid_cnt || m_ask_cnt) == 0))
     return 0;
 
-  char  buf[1024];
-  char* p   = buf;
-  char* end = p + sizeof(buf);
-  StreamBase::Write(p);                       // Write stream header
-  p   += utxx::encode_uleb128<0>(m_time, p);  // Encode time since last second
-  *p++ = uint8_t(m_ask_cnt << 4 | m_bid_cnt); // Count of PxLevel's bids & asks
+  char* begin = a_buf;
+  char* end   = a_buf + MAX_SIZE();
+  StreamBase::Write(a_buf);                   // Write stream header
+  a_buf   += utxx::encode_uleb128<0>(m_time, a_buf); // Time since last second
+  *a_buf++ = uint8_t(m_ask_cnt << 4 | m_bid_cnt); // Counts of bids & asks
 
-  // Encode PxLevels
-  for (auto it = m_levels.begin(), e = it + BidCount() + AskCount(); it != e; ++it)
-    it->Encode(p, end); // Encode the Px,Qty
+  // Batch-encode the PxLevels' interleaved (Px,Qty) values.  A full-depth
+  // snapshot (the common case) takes the unrolled gather
+  int     n = BidCount() + AskCount();
+  int64_t vals[MaxDepth*4];
+  if (utxx::likely(n == int(MaxDepth)))
+    GatherLevels(vals, &m_levels[0], DepthTag<MaxDepth>());
+  else {
+    auto v = vals;
+    for (auto it = m_levels.begin(), e = it + n; it != e; ++it) {
+      *v++ = it->m_px;
+      *v++ = it->m_qty;
+    }
+  }
+
+  a_buf = encode_sleb128_batch(vals, 2*n, a_buf);
+
+  assert(a_buf <= end);
+  (void)end;
 
-  assert(p <= end);
+  return a_buf - begin;
+}
 
-  size_t sz = p - buf;
+//------------------------------------------------------------------------------
+template <uint MaxDepth, typename PxT>
+int QuoteSample<MaxDepth, PxT>::
+Write(FILE* a_file)
+{
+  char  buf[MAX_SIZE()];
+  char* p   = buf;
+  size_t sz = Encode(p);
   return (fwrite(buf, 1, sz, a_file) == sz) ? sz : -1;
 }
 
@@ -100,25 +166,200 @@ Read(const char* a_buf, size_t a_sz, bool a_is_delta, PxT& a_last_px)
   auto p = &m_levels[0];
   auto e = p + m_bid_cnt + m_ask_cnt;
 
-  // Decode the Px/Qty of the first price level
-  p->Decode(a_buf, end);
+  if (utxx::unlikely(p == e))
+    return a_buf - begin;
+
+  // Batch-decode the interleaved (Px,Qty) values of all levels
+  int64_t vals[MaxDepth*4];
+  a_buf = decode_sleb128_batch(a_buf, end, vals, 2*(m_bid_cnt + m_ask_cnt));
+
+  if (!a_buf)
+    return 0; // Need more data
+
+  auto v = vals;
+
+  p->m_px  = PxT(*v++);
+  p->m_qty = int(*v++);
 
   // If this is a delta quote, the price value is the diff between last known
   // price and current price, so:
   auto first_px = a_is_delta ? (p->m_px += a_last_px) : p->m_px;
   auto last_px  = first_px;
 
-  for (++p; p != e; ++p) {
-    p->Decode(a_buf, end);
-    p->m_px += last_px;
-    last_px  = p->m_px;
-    if (a_buf > end)
-      return 0; // Need more data
-  }
+  // Prefix-sum the remaining delta-encoded levels; full-depth snapshots
+  // (the common case) take the unrolled path
+  if (utxx::likely(m_bid_cnt + m_ask_cnt == int(MaxDepth)))
+    ScatterLevels(v, p+1, last_px, DepthTag<MaxDepth-1>());
+  else
+    for (++p; p != e; ++p) {
+      p->m_px  = PxT(*v++) + last_px;
+      p->m_qty = int(*v++);
+      last_px  = p->m_px;
+    }
 
   a_last_px = first_px;
 
   return a_buf - begin;
 }
 
+//==============================================================================
+// BookDeltaSample
+//==============================================================================
+template <uint MaxDepth, typename PxT>
+void BookDeltaSample<MaxDepth, PxT>::
+DiffSide
+(
+  PxLevel<PxT> const* a_old, int a_old_cnt,
+  PxLevel<PxT> const* a_new, int a_new_cnt,
+  int&                a_ops
+)
+{
+  auto* out = &m_ops[m_bid_ops + m_ask_ops];
+
+  for (int i = 0; i < a_new_cnt; ++i) {
+    bool had = i < a_old_cnt;
+    if (had && a_old[i].m_px == a_new[i].m_px && a_old[i].m_qty == a_new[i].m_qty)
+      continue;
+    out->m_idx = uint8_t(i);
+    out->m_px  = a_new[i].m_px - (had ? a_old[i].m_px : PxT());
+    out->m_qty = a_new[i].m_qty;
+    ++out;
+    ++a_ops;
+  }
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth, typename PxT>
+bool BookDeltaSample<MaxDepth, PxT>::
+Diff(QuoteSampleT const& a_prev, QuoteSampleT const& a_curr, uint a_ts)
+{
+  m_time    = a_ts;
+  m_bid_cnt = a_curr.BidCount();
+  m_ask_cnt = a_curr.AskCount();
+  m_bid_ops = 0;
+  m_ask_ops = 0;
+
+  DiffSide(&a_prev.Levels()[0],                  a_prev.BidCount(),
+           &a_curr.Levels()[0],                  a_curr.BidCount(), m_bid_ops);
+  DiffSide(&a_prev.Levels()[a_prev.BidCount()],  a_prev.AskCount(),
+           &a_curr.Levels()[a_curr.BidCount()],  a_curr.AskCount(), m_ask_ops);
+
+  // Counts alone can change without any level op (levels dropped off the top)
+  return m_bid_ops || m_ask_ops
+      || m_bid_cnt != a_prev.BidCount() || m_ask_cnt != a_prev.AskCount();
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth, typename PxT>
+void BookDeltaSample<MaxDepth, PxT>::
+Apply(QuoteSampleT& a_book) const
+{
+  int   obc = a_book.BidCount();
+  int   oac = a_book.AskCount();
+  auto& ol  = a_book.Levels();
+
+  typename QuoteSampleT::PxLevelsT nl = typename QuoteSampleT::PxLevelsT();
+
+  // Carry over the unchanged levels by side-relative index
+  for (int i = 0, e = std::min(m_bid_cnt, obc); i < e; ++i)
+    nl[i]             = ol[i];
+  for (int i = 0, e = std::min(m_ask_cnt, oac); i < e; ++i)
+    nl[m_bid_cnt + i] = ol[obc + i];
+
+  // Apply the level ops (prices on the wire are relative to the old book)
+  for (int i = 0; i < m_bid_ops; ++i) {
+    auto& op = m_ops[i];
+    auto  px = op.m_px + (op.m_idx < obc ? ol[op.m_idx].m_px       : PxT());
+    nl[op.m_idx].Set(px, op.m_qty);
+  }
+  for (int i = m_bid_ops, e = m_bid_ops + m_ask_ops; i < e; ++i) {
+    auto& op = m_ops[i];
+    auto  px = op.m_px + (op.m_idx < oac ? ol[obc + op.m_idx].m_px : PxT());
+    nl[m_bid_cnt + op.m_idx].Set(px, op.m_qty);
+  }
+
+  ol = nl;
+  a_book.Set(m_time, m_bid_cnt, m_ask_cnt);
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth, typename PxT>
+int BookDeltaSample<MaxDepth, PxT>::
+Encode(char*& a_buf)
+{
+  char* begin = a_buf;
+  StreamBase::Write(a_buf);                   // Write stream header
+  a_buf   += utxx::encode_uleb128<0>(m_time, a_buf); // Time since last second
+  *a_buf++ = uint8_t(m_ask_cnt << 4 | m_bid_cnt); // New counts of bids & asks
+  *a_buf++ = uint8_t(m_ask_ops << 4 | m_bid_ops); // Counts of level ops
+
+  for (int i = 0, e = m_bid_ops + m_ask_ops; i < e; ++i) {
+    auto& op = m_ops[i];
+    *a_buf++ = char(op.m_idx);
+    sleb128_encode(op.m_px,  a_buf);
+    sleb128_encode(op.m_qty, a_buf);
+  }
+
+  assert(a_buf - begin <= long(MAX_SIZE()));
+
+  return a_buf - begin;
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth, typename PxT>
+int BookDeltaSample<MaxDepth, PxT>::
+Read(const char* a_buf, size_t a_sz)
+{
+#ifndef NDEBUG
+  static constexpr uint8_t s_stream_id = uint8_t(StreamType::BookDelta);
+#endif
+
+  auto begin = a_buf;
+  auto end   = a_buf + a_sz;
+
+  // Must be this stream
+  assert((*a_buf & 0x7F) == s_stream_id);
+
+  a_buf++;
+  m_time = uleb128_decode(a_buf);
+
+  if (a_buf + 2 > end)
+    return 0;     // Not enough data
+
+  m_bid_cnt = *a_buf & 0x0F;
+  m_ask_cnt = (*a_buf++ >> 4) & 0x0F;
+  m_bid_ops = *a_buf & 0x0F;
+  m_ask_ops = (*a_buf++ >> 4) & 0x0F;
+
+  if (m_bid_cnt > int(MaxDepth) || m_ask_cnt > int(MaxDepth))
+    throw utxx::runtime_error("Too many price levels: ",m_bid_cnt,' ',m_ask_cnt);
+
+  // Bound the op counts before writing m_ops: a side never carries more ops
+  // than it has levels, so on untrusted input anything larger would overrun
+  // the m_ops array (MaxDepth*2 entries, while the nibbles can encode 15+15)
+  if (m_bid_ops > m_bid_cnt || m_ask_ops > m_ask_cnt)
+    throw utxx::runtime_error("Too many book delta ops: ",m_bid_ops,' ',m_ask_ops);
+
+  for (int i = 0, e = m_bid_ops + m_ask_ops; i < e; ++i) {
+    if (a_buf >= end)
+      return 0;   // Need more data
+    auto& op = m_ops[i];
+    op.m_idx = uint8_t(*a_buf++);
+
+    int64_t vals[2];
+    auto p = decode_sleb128_batch(a_buf, end, vals, 2);
+    if (!p)
+      return 0;   // Need more data
+    a_buf    = p;
+    op.m_px  = PxT(vals[0]);
+    op.m_qty = int(vals[1]);
+
+    auto cnt = i < m_bid_ops ? m_bid_cnt : m_ask_cnt;
+    if (op.m_idx >= cnt)
+      throw utxx::runtime_error("Invalid book delta level index: ", op.m_idx);
+  }
+
+  return a_buf - begin;
+}
+
 } // namespace sdb
@@ -13,6 +13,13 @@
 #pragma once
 
 #include <cstdint>
+#include <cassert>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/nil_generator.hpp>
 #include <boost/uuid/string_generator.hpp>
@@ -21,15 +28,26 @@
 #include <utxx/enum.hpp>
 #include <utxx/leb128.hpp>
 #include <stdio.h>
+#ifdef SDB_HAVE_URING
+#include <liburing.h>
+#endif
 #include <sdb/sdb_fmt.hpp>
+#include <sdb/sdb_catalog.hpp>
+#include <sdb/sdb_shmem_ring.hpp>
+#include <sdb/sdb_query.hpp>
+#include <sdb/sdb_stats.hpp>
 
 namespace sdb {
 
 //------------------------------------------------------------------------------
 /// SDB file read/write I/O operations handler
 //------------------------------------------------------------------------------
+template <uint MaxDepth>
+struct SDBCursor;
+
 template <uint MaxDepth = 10>
 struct BaseSDBFileIO {
+  template <uint MD> friend struct SDBCursor;
 
   //----------------------------------------------------------------------------
   // Public API
@@ -44,6 +62,10 @@ struct BaseSDBFileIO {
 
   static constexpr uint MAX_DEPTH()         { return MaxDepth;              }
 
+  /// Size of the internal encode buffer used on the write path
+  /// (an upper bound for the WrBufSize() override)
+  static constexpr size_t WR_BUF_SIZE()     { return 1024*1024;             }
+
   bool                IsOpen()        const { return m_file != nullptr;     }
 
   Header      const&  Info()          const { return m_header;              }
@@ -113,6 +135,13 @@ struct BaseSDBFileIO {
 
   /// Open existing file for reading
   void Open(std::string const& a_filename, int a_debug = 0);
+  /// Open existing file for reading using the given read mode.
+  /// When \a a_mode is ReadMode::UseMmap the stream data section is decoded
+  /// directly out of a memory-mapped region without intermediate copying.
+  /// ReadMode::Prefetch overlaps file I/O with decoding: a prefetch thread
+  /// fills large buffers ahead of the Read() visitor - the best choice for
+  /// full-file scans over high-latency storage.
+  void Open(std::string const& a_filename, ReadMode a_mode, int a_debug = 0);
   void Close();
 
   /// Write file header
@@ -130,7 +159,12 @@ struct BaseSDBFileIO {
     uuid        const& a_uuid    = boost::uuids::random_generator()()
   );
 
-  void WriteStreamsMeta(std::vector<StreamType>&& a_types);
+  /// Write streams metadata.
+  /// @param a_cmp when not CompressT::None the stream data section is written
+  ///              as framed compressed blocks with a seek table at EOF
+  void WriteStreamsMeta(std::vector<StreamType>&&  a_types,
+                        StreamsMeta::CompressT     a_cmp =
+                        StreamsMeta::CompressT::None);
 
   void WriteCandlesMeta(CandlesMeta&& a_meta);
 
@@ -166,6 +200,19 @@ struct BaseSDBFileIO {
     size_t    a_trade_id = 0
   );
 
+  /// Write an order action (add/modify/delete)
+  /// @return number of bytes written
+  template <PriceUnit PU, typename PxT>
+  void WriteOrder
+  (
+    time_val             a_ts,
+    OrderSample::ActionT a_action,
+    SideT                a_side,
+    size_t               a_order_id,
+    PxT                  a_px,
+    int                  a_qty
+  );
+
   /// Update the candle corresponding to \a a_ts time
   /// @param a_qty bought (a_qty > 0) or sold (a_qty < 0) quantity
   /// @return true on success or false if \a a_ts is outside of range
@@ -191,26 +238,157 @@ struct BaseSDBFileIO {
     double    a_risk           = 0.0
   );
 
-  /// Flush the unwritten data to file stream
-  void Flush()                 { if (m_file) ::fflush(m_file); }
+  /// Select the output backend of the stream data section.
+  /// WriteBackendT::Direct writes data blocks with aligned O_DIRECT I/O
+  /// (through io_uring with the given submission queue depth when compiled
+  /// with liburing), so capture traffic doesn't pollute the page cache and
+  /// stall on dirty-page writeback.  File metadata (header, stream/candle
+  /// meta, seek table) is still written through stdio at open/close time.
+  /// Only honored by Open<OpenMode::Write>; must be called before Open().
+  void WriteBackend(WriteBackendT a_backend, int a_queue_depth = 8);
+
+  /// Set the size of the encode buffer (default WR_BUF_SIZE()) used on the
+  /// write path.  Capping it keeps the aggregate arena footprint bounded
+  /// when thousands of writers are alive at once (see WriterPool).
+  /// Must be called before Open().
+  /// @param a_lazy when true the buffer isn't allocated at Open() time but
+  ///               on the first write (or by AttachWrBuf())
+  void WrBufSize(size_t a_sz, bool a_lazy = false) {
+    m_wr_cap  = std::min(std::max(a_sz, size_t(64*1024)), WR_BUF_SIZE());
+    m_wr_lazy = a_lazy;
+  }
+
+  /// True when this writer currently owns an encode buffer
+  bool HasWrBuf()  const { return !m_wr_buf.empty(); }
+  /// Number of encoded bytes not yet flushed out of the encode buffer
+  size_t WrPending() const { return m_wr_size;       }
+
+  /// Give this writer an encode buffer (e.g. recycled from a shared arena).
+  /// Only meaningful between a flush and the next write.
+  void AttachWrBuf(std::vector<char>&& a_buf) {
+    m_wr_buf = std::move(a_buf);
+    if (m_wr_buf.size() != m_wr_cap)
+      m_wr_buf.resize(m_wr_cap);
+  }
+
+  /// Take the encode buffer away from an idle writer so it can be recycled
+  /// by another one.  The buffer must be flushed (WrPending() == 0).
+  std::vector<char> DetachWrBuf() {
+    assert(m_wr_size == 0);
+    return std::move(m_wr_buf);
+  }
+
+  /// Enable asynchronous writing.  Samples are still encoded on the caller's
+  /// thread, but filled blocks are handed to a dedicated I/O thread over a
+  /// single-producer/single-consumer ring, so a slow disk doesn't stall the
+  /// encoding (e.g. market-data handling) thread.
+  /// Must be called before Open().
+  /// @param a_bp backpressure policy when the I/O thread falls behind
+  void AsyncWrite(bool a_enable, BackPressureT a_bp = BackPressureT::Block);
+
+  /// Number of blocks dropped by the async writer (BackPressureT::Drop)
+  size_t DroppedBlocks() const
+    { return m_dropped_blks.load(std::memory_order_relaxed); }
+
+  /// Attach a metadata catalog (see MetaCatalog) consulted by the read-mode
+  /// Open(): on a hit the Header, StreamsMeta and CandlesMeta are populated
+  /// from the catalog instead of being parsed out of the file; on a miss the
+  /// file is parsed as usual and the catalog is updated.
+  /// Must be called before Open(); the catalog must outlive this object.
+  void Catalog(MetaCatalog* a_catalog) { m_catalog = a_catalog; }
+
+  /// Tee every encoded sample into a shared-memory ring (see ShmemRing) so
+  /// that same-host consumers see the live stream at microsecond latency.
+  /// Samples are published in wire format as they are committed to the
+  /// write buffer - readers decode them with the regular Sample::Read()
+  /// routines.  Must be called before the first write; the ring must
+  /// outlive this object.  Pass nullptr to stop publishing
+  void Publish(ShmemRing* a_ring) { m_pub_ring = a_ring; }
+
+  /// Flush the unwritten data to file stream.
+  /// In async mode this is a drain barrier: it returns after the I/O thread
+  /// has written out all blocks encoded so far.
+  void Flush();
 
   /// Print candles to an output stream
   /// @param out output stream
   /// @param a_resolution output only cangles matching this resolution
   void PrintCandles(std::ostream& out, int a_resolution = -1) const;
 
+  /// Rebuild candles of \a a_resolution seconds by one streaming pass over
+  /// the trades of a file opened for reading.  The resolution doesn't have
+  /// to be among those configured at capture time.  The rebuilt header is
+  /// appended to the in-memory CandlesMeta, so PrintCandles() can serve it.
+  /// @return reference to the rebuilt candle header
+  CandleHeader& RecomputeCandles(int a_resolution);
+
   /// Read all samples from file and invoke \a a_fun callback for each record.
   /// @param a_fun functor (auto& record) -> bool.
   template <typename Visitor>
   void Read(Visitor a_fun);
 
+  /// Find the nearest indexed position preceding \a a_from using the
+  /// DataOffset index of the finest-resolution candles.
+  /// @return absolute file offset of a SecondsSample at/before \a a_from
+  long Seek(time_val a_from);
+
+  /// Create a pull-based cursor over the samples of a file opened for
+  /// reading (see SDBCursor in sdb_cursor.hpp):
+  /// \code
+  ///   auto cur = file.Cursor();
+  ///   while (cur.Next())
+  ///     if (cur.Type() == StreamType::Quotes) { auto& q = cur.AsQuote(); }
+  /// \endcode
+  /// The decoder state lives in this object, so use one cursor at a time
+  /// per file; many files can be merged by advancing one cursor each
+  SDBCursor<MaxDepth> Cursor();
+
+  /// Read samples with timestamps in the [\a a_from, \a a_to] interval and
+  /// invoke \a a_fun callback for each record.  Decoding starts at the
+  /// nearest preceding candle data offset (see Seek()) and resynchronizes
+  /// the decoder state at the next SecondsSample, so only the requested
+  /// window is decoded instead of the whole day.
+  template <typename Visitor>
+  void Read(time_val a_from, time_val a_to, Visitor a_fun);
+
+  /// Number of independently decodable data blocks (see the seek table in
+  /// StreamsMeta).  Non-zero for compressed files and for v2 files that
+  /// were closed cleanly; 0 means the file can only be read sequentially
+  size_t BlockCount() const { return m_streams_meta.Blocks().size(); }
+
+  /// Decode the samples of data block \a a_blk only, invoking \a a_fun for
+  /// each record.  Every block starts with an absolute-time SecondsSample
+  /// and full (non-delta) prices, so blocks can be processed out of order:
+  /// N threads, each with its own file object open on the same file, can
+  /// partition [0, BlockCount()) between themselves and scan in parallel
+  template <typename Visitor>
+  void ReadBlock(size_t a_blk, Visitor a_fun);
+
+  /// Run an aggregate query kernel (see sdb_query.hpp) over all samples of
+  /// a file opened for reading.  Unlike Read(), only the fields the kernel
+  /// consumes are decoded - no QuoteSample/TradeSample objects are
+  /// materialized - so reductions like VWAP or book imbalance run at close
+  /// to raw decode speed
+  template <typename Kernel>
+  void Query(Kernel& a_kernel);
+
+  /// I/O counters and latency histograms (see sdb_stats.hpp).  Populated
+  /// only when compiled with SDB_HAVE_STATS; all zeros otherwise
+  IOStats const& Stats() const { return m_stats; }
+  IOStats&       Stats()       { return m_stats; }
+
 private:
   static constexpr int NaN() { return std::numeric_limits<int>::lowest(); }
 
   FILE*       m_file          = nullptr;
   OpenMode    m_mode          = OpenMode::Read;
+  ReadMode    m_read_mode     = ReadMode::StdIO;
+  const char* m_mem           = nullptr; ///< Mmaped file (ReadMode::UseMmap)
+  size_t      m_mem_size      = 0;       ///< Size of the mmaped region
   int         m_debug         = 0;
   bool        m_existing      = false; ///< True when opened existing file
+  MetaCatalog* m_catalog      = nullptr; ///< Optional metadata cache (not owned)
+  ShmemRing*  m_pub_ring      = nullptr; ///< Optional live tee ring (not owned)
   std::string m_filename;
   Header      m_header;
   time_val    m_last_ts;            ///< Last timestmap written
@@ -220,9 +398,110 @@ private:
 
   int         m_last_quote_px = NaN();
   int         m_last_trade_px = NaN();
+  int         m_last_order_px = NaN();
+
+  /// Incremental quote encoding (see BookDeltaSample).  Enabled when
+  /// StreamType::BookDelta is among the declared/read streams of the file
+  bool        m_book_deltas   = false;
+  QuoteSample<MaxDepth, PriceT> m_wr_book; ///< Writer's last book snapshot
+  bool        m_wr_book_valid = false;
+  QuoteSample<MaxDepth, PriceT> m_rd_book; ///< Reader's reconstructed book
+  bool        m_rd_book_valid = false;
 
   StreamsMeta m_streams_meta;
   CandlesMeta m_candles_meta;
+  IOStats     m_stats;              ///< Updated only under SDB_HAVE_STATS
+
+  /// Samples are LEB128-encoded into this arena and flushed in large writes
+  /// rather than one fwrite per sample
+  std::vector<char> m_wr_buf;
+  size_t      m_wr_cap        = WR_BUF_SIZE(); ///< Encode buffer capacity
+  bool        m_wr_lazy       = false; ///< Don't allocate m_wr_buf at Open()
+  size_t      m_wr_size       = 0;  ///< Bytes currently in m_wr_buf
+  long        m_flushed_pos   = 0;  ///< File offset of m_wr_buf's first byte
+                                    ///< (uncompressed stream offset when the
+                                    ///< file is written with compression)
+
+  int         m_state_next_sec = 0; ///< Next data second to rewrite the
+                                    ///< append-resume state trailer at
+
+  std::vector<char> m_comp_buf;     ///< Scratch buffer for (de)compression
+  int         m_comp_level    = 3;  ///< Zstd compression level
+  uint        m_blk_first_sec = 0;  ///< First second in current data block
+  uint        m_wr_records    = 0;  ///< Samples committed to the current block
+  long        m_raw_written   = 0;  ///< Uncompressed bytes written by
+                                    ///< WriteBlock (I/O thread side)
+
+  /// Number of blocks in the async writer's SPSC ring (power of 2)
+  static constexpr size_t WR_RING_SIZE() { return 8; }
+
+  /// A filled encode buffer queued for the I/O thread
+  struct WrBlock {
+    std::vector<char> buf;
+    size_t            size      = 0;
+    uint              first_sec = 0;
+    uint              records   = 0;
+  };
+
+  //----------------------------------------------------------------------------
+  /// O_DIRECT writer of the stream data section (WriteBackendT::Direct).
+  /// Data is staged into sector-aligned buffers and only sector-aligned
+  /// prefixes are submitted, so concurrently in-flight writes never overlap;
+  /// the trailing partial sector is retained in memory, prepended to the
+  /// next write or flushed by Drain(), and the file is trimmed to its
+  /// logical size on Close()
+  //----------------------------------------------------------------------------
+  struct DirectWriter {
+    /// Sector alignment of O_DIRECT offsets, sizes and buffers
+    static constexpr size_t ALIGNMENT() { return 4096; }
+
+    ~DirectWriter() { Close(); }
+
+    bool IsOpen()     const { return m_fd >= 0; }
+    /// Logical offset of the next byte to be written
+    long Pos()        const { return m_pos;     }
+
+    void Open (std::string const& a_filename, int a_queue_depth, long a_pos);
+    void Write(const char* a_buf, size_t a_sz);
+    /// Wait for all submitted writes to complete and write out the
+    /// retained partial tail sector
+    void Drain();
+    /// Drain, trim the tail padding to the logical size and close
+    void Close();
+
+  private:
+    char* Acquire();                  ///< Get a free staging buffer
+    void  Submit (char* a_buf, size_t a_sz, long a_off);
+
+    std::string        m_filename;
+    int                m_fd   = -1;
+    long               m_pos  = 0;    ///< Logical end of written data
+    size_t             m_tail = 0;    ///< Length of trailing partial sector
+    char               m_tail_data[4096]; ///< Its content
+    std::vector<char*> m_bufs;        ///< Aligned staging buffers
+    std::vector<char*> m_free;        ///< Buffers not currently in flight
+#ifdef SDB_HAVE_URING
+    struct io_uring    m_ring;
+    int                m_inflight = 0;
+#endif
+  };
+
+  bool          m_async        = false;
+  BackPressureT m_backpressure = BackPressureT::Block;
+
+  WriteBackendT m_backend      = WriteBackendT::Buffered;
+  int           m_io_qd        = 8;   ///< io_uring submission queue depth
+  DirectWriter  m_dio;
+
+  std::array<WrBlock, WR_RING_SIZE()> m_wr_ring;
+  std::atomic<size_t> m_ring_head  {0};  ///< Next slot filled  by producer
+  std::atomic<size_t> m_ring_tail  {0};  ///< Next slot drained by I/O thread
+  std::atomic<size_t> m_dropped_blks{0};
+  bool                m_io_stop    = false;
+  std::thread         m_io_thread;
+  std::mutex          m_io_mutex;        ///< Used only to sleep/wake threads
+  std::condition_variable m_io_cv;
+  std::exception_ptr  m_io_error;        ///< First error raised on I/O thread
 
   enum class WriteStateT { Init, WrHeader, WrStreamsMeta, WrCandlesMeta, WrData };
 
@@ -235,9 +514,134 @@ private:
   template <OpenMode Mode>
   size_t DoOpen(std::string const& a_filename, int a_perm = 0640);
 
+  /// Decode a single sample at \a a_buf and invoke \a a_fun callback on it.
+  /// @return number of bytes consumed, or 0 if \a a_sz is insufficient
+  template <typename OnSample>
+  long   ReadSample(const char* a_buf, size_t a_sz, OnSample& a_fun);
+
+  /// Read a compressed stream data section block by block starting from
+  /// block \a a_first_blk; when \a a_stop is non-null, reading terminates
+  /// as soon as it becomes true
+  template <typename OnSample>
+  void   ReadCompressed(OnSample&   a_fun, size_t a_first_blk = 0,
+                        const bool* a_stop = nullptr);
+
+  /// Decompress block \a a_blk of a compressed file into \a a_raw
+  /// @return uncompressed size of the block
+  size_t DecompressBlock(size_t a_blk, std::vector<char>& a_raw);
+
+  /// Decode a single sample at \a a_buf for Query(), extracting only the
+  /// fields the kernel needs (book levels and trades; other streams are
+  /// skipped).  \a a_bk carries the flat book and the decoder price chains.
+  /// @return number of bytes consumed, or 0 if \a a_sz is insufficient
+  template <typename Kernel>
+  long   QuerySample(const char* a_buf, size_t a_sz, Kernel& a_kernel,
+                     QueryBook<MaxDepth>& a_bk);
+
+  /// Size of each prefetch buffer (ReadMode::Prefetch)
+  static constexpr size_t PREFETCH_BUF_SIZE() { return 4*1024*1024; }
+  /// Number of prefetch buffers in flight (power of 2)
+  static constexpr size_t PREFETCH_NBUFS()    { return 4;           }
+  /// Stitch chunk for samples straddling prefetch buffer boundaries
+  static constexpr size_t PREFETCH_STITCH()   { return 64*1024;     }
+
+  /// Decode the data section with a prefetch thread filling large buffers
+  /// ahead of the decoder, so file I/O and decode work overlap
+  template <typename OnSample>
+  void   ReadPrefetch(OnSample& a_fun);
+
   /// @return pair{IsNewSecondSinceMidnight, NowSecSinceMidnight}
   bool   WriteSeconds(time_val a_now);
 
+  /// Write an incremental book update when a base snapshot is available.
+  /// @return false when a full QuoteSample must be written instead (new
+  ///         second, no base snapshot, or a compressed block boundary)
+  template <PriceUnit PU, typename PxT>
+  bool   TryWriteBookDelta
+  (
+    time_val a_ts,
+    PxLevels<MaxDepth, PxT> const& a_bids, size_t a_bid_cnt,
+    PxLevels<MaxDepth, PxT> const& a_asks, size_t a_ask_cnt
+  );
+
+  /// Save the current book (normalized, in stored level order) as the base
+  /// snapshot for subsequent book deltas
+  template <PriceUnit PU, typename PxT>
+  void   CaptureWrBook
+  (
+    PxLevels<MaxDepth, PxT> const& a_bids, size_t a_bid_cnt,
+    PxLevels<MaxDepth, PxT> const& a_asks, size_t a_ask_cnt
+  );
+
+  /// Magic number of the append-resume state trailer file
+  static constexpr uint32_t STATE_MAGIC()        { return 0x53424453; } //"SDBS"
+  static constexpr int      STATE_VERSION()      { return 1; }
+  /// Min seconds of data time between state trailer rewrites
+  static constexpr int      STATE_UPDATE_SECS()  { return 5; }
+
+  /// Name of the sidecar file holding the append-resume state trailer
+  std::string StateFilename() const { return m_filename + ".state"; }
+
+  /// Rewrite the state trailer (atomically, best-effort) so that a later
+  /// Open<OpenMode::Append> can resume without replaying the whole file.
+  /// A no-op for compressed files and outside of the data-writing phase
+  void   WriteStateTrailer();
+
+  /// Try to recover the write state from the state trailer: restore the
+  /// timestamps, delta-price chains and candle accumulators, then replay
+  /// only the samples written after the last trailer rewrite.
+  /// @return false when the trailer is missing, invalid or stale, in which
+  ///         case the caller falls back to the full replay
+  bool   TryResumeFromTrailer(size_t a_file_size);
+
+  /// Decode samples from file offset \a a_from to the end of file with a
+  /// no-op visitor, leaving m_flushed_pos at the last complete sample
+  void   ReplayTail(long a_from);
+
+  /// Derive m_book_deltas from the stream types of m_streams_meta
+  void   SetBookDeltasFromMeta() {
+    m_book_deltas = false;
+    for (auto& s : m_streams_meta.Streams())
+      if (s.StreamID() == StreamType::BookDelta)
+        m_book_deltas = true;
+  }
+
+  /// Logical file offset of the next byte to be encoded (no ftell needed)
+  long   LogicalPos() const { return m_flushed_pos + long(m_wr_size); }
+  /// File offset one past the last stream data byte, or 0 when the data
+  /// section runs to the end of file.  In files with a seek table the table
+  /// follows the data, so sequential readers must not decode past it
+  long   DataEnd()    const { return long(m_streams_meta.SeekTblOffset()); }
+  /// Make sure the encode buffer has at least \a a_sz free bytes
+  void   EnsureWrSpace(size_t a_sz);
+  char*  WrPtr()            { return &m_wr_buf[m_wr_size];            }
+  void   WrCommit(char* a_p){
+    if (utxx::likely(a_p != WrPtr())) {
+      ++m_wr_records;
+      if (utxx::unlikely(m_pub_ring != nullptr))
+        m_pub_ring->Publish(WrPtr(), a_p - WrPtr());
+    }
+    m_wr_size = a_p - &m_wr_buf[0];
+  }
+  /// Write the content of the encode buffer to file (or, in async mode,
+  /// hand it off to the I/O thread)
+  void   FlushWrBuf();
+
+  /// Compress (when enabled) and write one data block to file.
+  /// Runs on the I/O thread in async mode
+  void   WriteBlock(const char* a_buf, size_t a_sz, uint a_first_sec,
+                    uint a_records);
+
+  /// Queue the current encode buffer for the I/O thread (async mode)
+  /// @return false if the block was dropped (BackPressureT::Drop)
+  bool   EnqueueWrBuf();
+  /// Main loop of the async writer's I/O thread
+  void   IoThreadLoop();
+  /// Wait until the I/O thread has drained the ring; rethrow its errors
+  void   WaitIoDrained();
+  /// Stop and join the I/O thread after draining the ring
+  void   StopIoThread();
+
   double NormalPxToDouble(int a_px) const { return a_px * m_header.PxStep(); }
 };
 
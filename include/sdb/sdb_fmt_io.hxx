@@ -23,7 +23,11 @@
 #include <utxx/scope_exit.hpp>
 #include <utxx/buffer.hpp>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
+#ifdef SDB_HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 namespace sdb {
 
@@ -136,14 +140,47 @@ void BaseSDBFileIO<MaxDepth>::Open
         UTXX_THROW_RUNTIME_ERROR("Instrument of file '", name, "' (",
                                   m_header.Instrument(), ") doesn't match '",
                                   a_instr, "'");
+      if (m_header.Version() < MIN_VERSION() || m_header.Version() > VERSION())
+        UTXX_THROW_RUNTIME_ERROR
+          ("SDB version ", m_header.Version(), " of file '", name,
+           "' not supported (expected: ", MIN_VERSION(), "..", VERSION(), ')');
+
+      m_streams_meta.Version(m_header.Version());
+      m_candles_meta.Version(m_header.Version());
       m_streams_meta.Read(m_file);
       m_candles_meta.Read(m_file);
+      SetBookDeltasFromMeta();
+
+      if (m_streams_meta.Compression() != StreamsMeta::CompressT::None)
+        UTXX_THROW_RUNTIME_ERROR
+          ("Cannot append to compressed file ", name);
+
+      // A cleanly closed v2 file carries a seek table after the last data
+      // block.  Keep its entries in memory (Close() rewrites the complete
+      // table), then unlink and truncate it so appended samples overwrite it
+      if (m_streams_meta.SeekTblOffset()) {
+        m_streams_meta.ReadSeekTbl(m_file);
+        auto dend = m_streams_meta.SeekTblOffset();
+        m_streams_meta.ClearSeekTbl(m_file);
+        fflush(m_file);
+        if (ftruncate(fileno(m_file), dend) < 0)
+          UTXX_THROW_IO_ERROR
+            (errno, "Cannot truncate seek table of file ", name);
+        size = dend;
+      }
+
+      // Recover the write state: in constant time from the state trailer
+      // when it is current, otherwise by replaying the file's samples
+      if (!TryResumeFromTrailer(size)) {
+        auto dummy = [](auto& sample) {};
+        Read(dummy);
 
-      // Read all samples till the end of the file
-      auto dummy = [](auto& sample) {};
-      Read(dummy);
+        // Subsequent writes are appended at the current end of file
+        m_flushed_pos = ftell(m_file);
+      }
 
-      m_existing = true;
+      m_written_state = WriteStateT::WrData;
+      m_existing      = true;
     }
   }
 
@@ -167,8 +204,39 @@ template <uint MaxDepth>
 inline void BaseSDBFileIO<MaxDepth>::
 Open(std::string const& a_name, int a_debug)
 {
-  m_debug  = a_debug;
-  int size = DoOpen<OpenMode::Read>(a_name.c_str(), 0640);
+  Open(a_name, ReadMode::StdIO, a_debug);
+}
+
+//------------------------------------------------------------------------------
+// Open SDB database file using a given read mode
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+inline void BaseSDBFileIO<MaxDepth>::
+Open(std::string const& a_name, ReadMode a_mode, int a_debug)
+{
+  m_debug     = a_debug;
+  m_read_mode = a_mode;
+  int size    = DoOpen<OpenMode::Read>(a_name.c_str(), 0640);
+
+  //----------------------------------------------------------------------------
+  // Catalog hit: take the cached metadata and skip the in-file parsing
+  //----------------------------------------------------------------------------
+  auto cached = m_catalog ? m_catalog->Find(a_name) : nullptr;
+  if (cached) {
+    m_header       = cached->m_header;
+    m_streams_meta = cached->m_streams_meta;
+    m_candles_meta = cached->m_candles_meta;
+    SetBookDeltasFromMeta();
+
+    if (a_debug) {
+      std::cerr << "File: " << a_name << " (metadata from catalog)" << std::endl;
+      m_header.Print(std::cerr);
+      PrintCandles(std::cerr);
+    }
+
+    m_existing = true;
+    return;
+  }
 
   try   { m_header.Read(m_file, size); }
   catch ( std::exception const& e )  {
@@ -181,17 +249,26 @@ Open(std::string const& a_name, int a_debug)
     m_header.Print(std::cerr);
   }
 
-  if (m_header.Version() != VERSION())
+  if (m_header.Version() < MIN_VERSION() || m_header.Version() > VERSION())
     UTXX_THROW_RUNTIME_ERROR
       ("SDB version ", m_header.Version(), " not supported (expected: ",
-       VERSION(), ')');
+       MIN_VERSION(), "..", VERSION(), ')');
 
+  m_streams_meta.Version(m_header.Version());
+  m_candles_meta.Version(m_header.Version());
   m_streams_meta.Read(m_file);
   m_candles_meta.Read(m_file);
+  SetBookDeltasFromMeta();
+
+  if (m_streams_meta.HasSeekTbl())
+    m_streams_meta.ReadSeekTbl(m_file);
 
   if (a_debug)
     PrintCandles(std::cerr);
 
+  if (m_catalog)
+    m_catalog->Update(a_name, m_header, m_streams_meta, m_candles_meta);
+
   m_existing = true;
 }
 
@@ -230,6 +307,16 @@ DoOpen(std::string const& a_name, int a_perm)
 
   se.disable();
 
+  if (Mode == OpenMode::Read && m_read_mode == ReadMode::UseMmap) {
+    auto mem = ::mmap(nullptr, sz, PROT_READ, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED)
+      UTXX_THROW_IO_ERROR(errno, "Cannot mmap file ", name.c_str());
+    // Decoding is a single forward pass - request aggressive readahead
+    ::madvise(mem, sz, MADV_SEQUENTIAL);
+    m_mem      = static_cast<const char*>(mem);
+    m_mem_size = sz;
+  }
+
   m_filename    = name;
   m_mode        = Mode;
   m_file        = fdopen(fd,Mode == OpenMode::Read ? "r" : "w+");
@@ -237,9 +324,25 @@ DoOpen(std::string const& a_name, int a_perm)
   m_last_sec    = 0;
   m_last_usec   = 0;
   m_next_second = 0;
+  m_wr_size     = 0;
+  m_wr_records  = 0;
+  m_flushed_pos = 0;
+  m_state_next_sec = 0;
+
+  if (Mode != OpenMode::Read && !m_wr_lazy && m_wr_buf.size() < m_wr_cap)
+    m_wr_buf.resize(m_wr_cap);
   m_last_ts.clear();
   m_last_quote_px = NaN();
   m_last_trade_px = NaN();
+  m_last_order_px = NaN();
+
+  if (Mode != OpenMode::Read && m_async) {
+    m_ring_head.store(0, std::memory_order_relaxed);
+    m_ring_tail.store(0, std::memory_order_relaxed);
+    m_io_stop   = false;
+    m_io_thread = std::thread([this]() { IoThreadLoop(); });
+  }
+
   return sz;
 }
 
@@ -252,12 +355,37 @@ Close()
 {
   if (!m_file) return;
 
+  FlushWrBuf();
+  StopIoThread();  // Drains the ring and joins the async writer (if any)
+
+  if (m_dio.IsOpen()) {
+    m_dio.Close();  // Drains queued writes and trims the tail padding
+    // Re-sync the stdio stream with the true end of the data section
+    ::fseek(m_file, 0, SEEK_END);
+  }
+
+  // The seek table also covers blocks of uncompressed v2 files, and a v2
+  // append strips the old table at open time, so it is rewritten here
+  if (m_mode != OpenMode::Read && m_streams_meta.HasSeekTbl() &&
+      m_written_state == WriteStateT::WrData)
+    m_streams_meta.WriteSeekTbl(m_file);
+
   if (m_mode == OpenMode::Write)
     m_candles_meta.CommitCandles(m_file);
 
+  // Final state snapshot: a later append-mode reopen resumes in O(1)
+  if (m_mode != OpenMode::Read)
+    WriteStateTrailer();
+
   if (m_debug > 1)
     PrintCandles(std::cerr);
 
+  if (m_mem) {
+    ::munmap((void*)m_mem, m_mem_size);
+    m_mem      = nullptr;
+    m_mem_size = 0;
+  }
+
   ::fclose(m_file);
   m_file = nullptr;
 
@@ -268,398 +396,2142 @@ Close()
   m_last_usec     = 0;
   m_last_quote_px = NaN();
   m_last_trade_px = NaN();
+  m_last_order_px = NaN();
+  m_wr_book_valid = false;
+  m_rd_book_valid = false;
 }
 
+//------------------------------------------------------------------------------
+// Flush the encode buffer: write it out synchronously, or hand it off to the
+// I/O thread in async mode
 //------------------------------------------------------------------------------
 template <uint MaxDepth>
-int BaseSDBFileIO<MaxDepth>::
-ReadHeader()
+void BaseSDBFileIO<MaxDepth>::
+FlushWrBuf()
 {
-  assert(m_file);
-  auto   sz = utxx::path::file_size(fileno(m_file));
-  return m_header(m_file, sz);
+  if (!m_wr_size)
+    return;
+
+  bool written = true;
+
+  if (m_async)
+    written = EnqueueWrBuf();
+  else
+    WriteBlock(&m_wr_buf[0], m_wr_size, m_blk_first_sec, m_wr_records);
+
+  if (utxx::likely(written))
+    // For uncompressed files this is the file offset of the next byte; for
+    // compressed files it tracks the uncompressed stream offset
+    m_flushed_pos += m_wr_size;
+  else
+    // The block was dropped (BackPressureT::Drop) and the stream position
+    // did not advance: candle data offsets recorded while encoding it point
+    // past where the data actually ends, so clear them lest Seek() land in
+    // the middle of whatever block is written at that position next
+    for (auto& ch : m_candles_meta.Headers())
+      for (auto& c : ch.Candles())
+        if (c.DataOffset() > uint64_t(m_flushed_pos))
+          c.DataOffset(0);
+
+  m_wr_size      = 0;
+  m_wr_records   = 0;
+
+  if (m_streams_meta.Compression() != StreamsMeta::CompressT::None ||
+      m_header.Version() >= 2) {
+    // Force the next block to start with an absolute SecondsSample and full
+    // (non-delta) prices, so blocks can be decoded independently
+    m_next_second   = 0;
+    m_last_quote_px = NaN();
+    m_last_trade_px = NaN();
+    m_last_order_px = NaN();
+    m_wr_book_valid = false;
+  }
+
+  if (m_streams_meta.Compression() == StreamsMeta::CompressT::None &&
+      !m_async && m_last_sec >= m_state_next_sec)
+    // Periodically snapshot the write state so that an append-mode reopen
+    // resumes in constant time (in async mode this is done by Flush())
+    WriteStateTrailer();
 }
 
+//------------------------------------------------------------------------------
+// Compress (when enabled) and write one data block to file
 //------------------------------------------------------------------------------
 template <uint MaxDepth>
-int BaseSDBFileIO<MaxDepth>::
-WriteHeader
-(
-  std::string const& a_xchg,
-  std::string const& a_symbol,
-  std::string const& a_instr,
-  long               a_secid,
-  time_val           a_date,
-  std::string const& a_tz_name,
-  int                a_tz_offset,
-  uint8_t            a_depth,
-  double             a_px_step,
-  uuid        const& a_uuid
-)
+void BaseSDBFileIO<MaxDepth>::
+WriteBlock(const char* a_buf, size_t a_sz, uint a_first_sec, uint a_records)
 {
-  if (m_written_state != WriteStateT::Init)
-    UTXX_THROW_RUNTIME_ERROR("Header already written to file ", m_filename);
+  if (m_streams_meta.Compression() != StreamsMeta::CompressT::None) {
+#ifdef SDB_HAVE_ZSTD
+    // Compress the block and write it with a framing header:
+    //   [CompSize:4][RawSize:4][FirstSec:4][compressed payload]
+    auto bound = ZSTD_compressBound(a_sz);
+    if (m_comp_buf.size() < bound + 12)
+      m_comp_buf.resize(bound + 12);
+
+    auto csz = ZSTD_compress(&m_comp_buf[12], bound,
+                             a_buf, a_sz, m_comp_level);
+    if (ZSTD_isError(csz))
+      UTXX_THROW_RUNTIME_ERROR
+        ("Error compressing block of file ", m_filename, ": ",
+         ZSTD_getErrorName(csz));
+
+    char* p = &m_comp_buf[0];
+    utxx::put32le(p, uint32_t(csz));
+    utxx::put32le(p, uint32_t(a_sz));
+    utxx::put32le(p, a_first_sec);
+
+    // m_raw_written is the uncompressed stream offset of this block; it is
+    // maintained here (not from m_flushed_pos) because in async mode this
+    // code runs on the I/O thread after the producer has moved on
+    m_streams_meta.AddBlock(m_dio.IsOpen() ? m_dio.Pos() : ftell(m_file),
+                            m_raw_written,  a_first_sec,  a_records);
+
+    auto sz = csz + 12;
+    if (m_dio.IsOpen())
+      m_dio.Write(&m_comp_buf[0], sz);
+    else if (fwrite(&m_comp_buf[0], 1, sz, m_file) != sz)
+      UTXX_THROW_IO_ERROR
+        (errno, "Error writing stream data to file ", m_filename);
 
-  assert(m_file);
-  auto   sz = utxx::path::file_size(fileno(m_file));
-  if (sz > 0)
+    m_raw_written += a_sz;
+    return;
+#else
     UTXX_THROW_RUNTIME_ERROR
-      ("Cannot write SDB header to non-empty file ", m_filename);
-
-  m_header.Set(VERSION(), a_xchg,    a_symbol,    a_instr,  a_secid,
-               a_date,    a_tz_name, a_tz_offset, a_depth,  a_px_step, a_uuid);
-
-  try { sz = m_header.Write(m_file); }
-  catch (std::exception const& e) {
-    UTXX_THROW_IO_ERROR(errno, "Error writing header to file ", m_filename);
+      ("Cannot write compressed file ", m_filename,
+       ": SDB was compiled without zstd support");
+#endif
   }
 
-  m_written_state = WriteStateT::WrHeader;
+  if (m_header.Version() >= 2) {
+    // Record the block's extent in the seek table so readers can decode
+    // blocks independently (without compression the raw offset of a block
+    // equals its file offset)
+    auto pos = m_dio.IsOpen() ? m_dio.Pos() : ftell(m_file);
+    m_streams_meta.AddBlock(pos, pos, a_first_sec, a_records);
+  }
 
-  return sz;
+  if (m_dio.IsOpen())
+    m_dio.Write(a_buf, a_sz);
+  else if (fwrite(a_buf, 1, a_sz, m_file) != a_sz)
+    UTXX_THROW_IO_ERROR
+      (errno, "Error writing stream data to file ", m_filename);
 }
 
 //------------------------------------------------------------------------------
 template <uint MaxDepth>
-void BaseSDBFileIO<MaxDepth>::
-WriteStreamsMeta(std::vector<StreamType>&& a_types)
+inline void BaseSDBFileIO<MaxDepth>::
+EnsureWrSpace(size_t a_sz)
 {
-  if (m_written_state != WriteStateT::WrHeader)
-    UTXX_THROW_RUNTIME_ERROR
-      ("Streams metadata already written to file ", m_filename);
+  assert(a_sz <= m_wr_cap);
+  if (utxx::unlikely(m_wr_buf.size() < m_wr_cap))
+    m_wr_buf.resize(m_wr_cap);  // Lazily (re)acquired buffer (see WrBufSize())
+  auto cap = m_streams_meta.Compression() == StreamsMeta::CompressT::None
+           ? m_wr_cap : std::min(m_wr_cap, StreamsMeta::COMP_BLOCK_SIZE());
+  if (utxx::unlikely(cap - m_wr_size < a_sz))
+    FlushWrBuf();
+}
 
-  auto v = std::vector<StreamsMeta::StreamMeta>();
+//==============================================================================
+// DirectWriter: O_DIRECT output backend of the stream data section
+//==============================================================================
+template <uint MaxDepth>
+void BaseSDBFileIO<MaxDepth>::DirectWriter::
+Open(std::string const& a_filename, int a_queue_depth, long a_pos)
+{
+  assert(m_fd < 0);
 
-  for (auto st: a_types) v.emplace_back(st);
-  if (m_debug) {
-    auto n = ftell(m_file);
-    std::cerr << "  StreamsMeta position: " << n << " (" << std::hex << n << ")\n";
+  m_fd = ::open(a_filename.c_str(), O_WRONLY | O_DIRECT);
+
+  if (m_fd < 0)
+    UTXX_THROW_IO_ERROR
+      (errno, "Cannot open file ", a_filename, " with O_DIRECT");
+
+  m_filename = a_filename;
+  m_pos      = a_pos;
+  m_tail     = a_pos & (ALIGNMENT()-1);
+
+  if (m_tail) {
+    // The data section doesn't start sector-aligned: read back the partial
+    // sector written through stdio so it can be rewritten with the data
+    int pfd = ::open(a_filename.c_str(), O_RDONLY);
+    if (pfd < 0 ||
+        ::pread(pfd, m_tail_data, m_tail, a_pos - m_tail) != long(m_tail)) {
+      if (pfd >= 0) ::close(pfd);
+      UTXX_THROW_IO_ERROR(errno, "Cannot read back tail of ", a_filename);
+    }
+    ::close(pfd);
   }
 
-  m_streams_meta = StreamsMeta(std::move(v));
+  int qd = std::max(1, a_queue_depth);
 
-  if (m_streams_meta.Write(m_file) < 0)
-    UTXX_THROW_IO_ERROR
-      (errno, "Error writing streams metadata to file ", m_filename);
+#ifdef SDB_HAVE_URING
+  int rc = io_uring_queue_init(qd, &m_ring, 0);
+  if  (rc < 0)
+    UTXX_THROW_IO_ERROR(-rc, "Cannot initialize io_uring for ", a_filename);
+  m_inflight = 0;
+#else
+  qd = 1;  // Writes are synchronous pwrite's without liburing
+#endif
 
-  // At this point m_streams_meta contains the DataOffset() field that needs
-  // to be updated after the candles are written
+  // Each staging buffer must fit a full block (a compressed block may
+  // slightly exceed the raw buffer size), the retained tail and padding
+  size_t buf_sz = WR_BUF_SIZE() + (1 << 16) + 2*ALIGNMENT();
 
-  m_written_state = WriteStateT::WrStreamsMeta;
+  for (int i = 0; i < qd; ++i) {
+    void* p;
+    if (posix_memalign(&p, ALIGNMENT(), buf_sz) != 0)
+      UTXX_THROW_RUNTIME_ERROR
+        ("Cannot allocate aligned I/O buffer for ", a_filename);
+    m_bufs.push_back(static_cast<char*>(p));
+    m_free.push_back(static_cast<char*>(p));
+  }
 }
 
 //------------------------------------------------------------------------------
 template <uint MaxDepth>
-void BaseSDBFileIO<MaxDepth>::
-WriteCandlesMeta(CandlesMeta&& a_meta)
+char* BaseSDBFileIO<MaxDepth>::DirectWriter::
+Acquire()
 {
-  if (m_written_state != WriteStateT::WrStreamsMeta)
-    UTXX_THROW_RUNTIME_ERROR
-      ("Candles metadata already written to file ", m_filename);
-
-  if (m_debug) {
-    auto n = ftell(m_file);
-    std::cerr << "  CandlesMeta position: " << std::dec << n
-              << " (" << std::hex << n      << std::dec << ")\n";
+#ifdef SDB_HAVE_URING
+  while (m_free.empty()) {
+    struct io_uring_cqe* cqe;
+    int rc = io_uring_wait_cqe(&m_ring, &cqe);
+    if (rc < 0)
+      UTXX_THROW_IO_ERROR(-rc, "io_uring_wait_cqe failed on ", m_filename);
+    if (cqe->res < 0)
+      UTXX_THROW_IO_ERROR
+        (-cqe->res, "Error writing stream data to file ", m_filename);
+    m_free.push_back(static_cast<char*>(io_uring_cqe_get_data(cqe)));
+    io_uring_cqe_seen(&m_ring, cqe);
+    m_inflight--;
   }
+#endif
+  auto p = m_free.back();
+  m_free.pop_back();
+  return p;
+}
 
-  if (a_meta.Write(m_file, m_debug) < 0)
-    UTXX_THROW_IO_ERROR(errno, "Error writing candle data to file ", m_filename);
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void BaseSDBFileIO<MaxDepth>::DirectWriter::
+Submit(char* a_buf, size_t a_sz, long a_off)
+{
+#ifdef SDB_HAVE_URING
+  auto sqe = io_uring_get_sqe(&m_ring);  // Never null: a slot was Acquire'd
+  io_uring_prep_write(sqe, m_fd, a_buf, a_sz, a_off);
+  io_uring_sqe_set_data(sqe, a_buf);
+  io_uring_submit(&m_ring);
+  m_inflight++;
+#else
+  if (::pwrite(m_fd, a_buf, a_sz, a_off) != ssize_t(a_sz))
+    UTXX_THROW_IO_ERROR
+      (errno, "Error writing stream data to file ", m_filename);
+  m_free.push_back(a_buf);
+#endif
+}
 
-  m_candles_meta  = std::move(a_meta);
-  m_written_state = WriteStateT::WrCandlesMeta;
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void BaseSDBFileIO<MaxDepth>::DirectWriter::
+Write(const char* a_buf, size_t a_sz)
+{
+  auto lead  = m_tail;
+  auto total = lead + a_sz;
+
+  if (utxx::unlikely(total < ALIGNMENT())) {
+    // Less than one sector in hand: just extend the retained tail
+    memcpy(m_tail_data + lead, a_buf, a_sz);
+    m_tail  = total;
+    m_pos  += a_sz;
+    return;
+  }
 
-  // Now that we know the beginning of data offset, write it to the
-  // StreamsMeta header:
-  if (m_streams_meta.WriteDataOffset(m_file, ftell(m_file)) < 0)
-    UTXX_THROW_IO_ERROR
-      (errno, "Error writing beginning of data offset to file ", m_filename);
+  auto stage = Acquire();
 
-  char  buf[4];
-  char* p = buf;
-  utxx::put32le(p, BEGIN_STREAM_DATA());
+  memcpy(stage,        m_tail_data, lead);
+  memcpy(stage + lead, a_buf,       a_sz);
 
-  if (m_debug)
-    std::cerr << " Begin Stream Marker: "  << std::dec << ftell(m_file) << " ("
-              << std::hex << ftell(m_file) << ')'      << std::dec << std::endl;
+  // Submit only the sector-aligned prefix: in-flight writes then never
+  // overlap, so their completion order cannot matter (plain io_uring SQEs
+  // carry no ordering guarantee between each other).  The partial tail is
+  // retained in memory and either prepended to the next Write() or flushed
+  // by Drain()
+  auto wr = total & ~(ALIGNMENT()-1);
+  m_tail  = total - wr;
+  memcpy(m_tail_data, stage + wr, m_tail);
 
-  if (fwrite(buf, 1, sizeof(buf), m_file) != sizeof(buf))
-    UTXX_THROW_IO_ERROR
-      (errno, "Error writing beginning data marker to file ", m_filename);
+  Submit(stage, wr, m_pos - lead);
+  m_pos += a_sz;
+}
 
-  m_written_state = WriteStateT::WrData;
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void BaseSDBFileIO<MaxDepth>::DirectWriter::
+Drain()
+{
+#ifdef SDB_HAVE_URING
+  while (m_inflight > 0) {
+    struct io_uring_cqe* cqe;
+    int rc = io_uring_wait_cqe(&m_ring, &cqe);
+    if (rc < 0)
+      UTXX_THROW_IO_ERROR(-rc, "io_uring_wait_cqe failed on ", m_filename);
+    if (cqe->res < 0)
+      UTXX_THROW_IO_ERROR
+        (-cqe->res, "Error writing stream data to file ", m_filename);
+    m_free.push_back(static_cast<char*>(io_uring_cqe_get_data(cqe)));
+    io_uring_cqe_seen(&m_ring, cqe);
+    m_inflight--;
+  }
+#endif
+  if (m_tail) {
+    // With all aligned writes complete it is safe to put the zero-padded
+    // partial tail sector on disk: a later Write() rewrites that sector,
+    // but only after this synchronous write has finished, so writes still
+    // never overlap while in flight
+    auto buf = m_free.back();  // Idle now that the queue is drained
+    memcpy(buf, m_tail_data, m_tail);
+    memset(buf + m_tail, 0, ALIGNMENT() - m_tail);
+    if (::pwrite(m_fd, buf, ALIGNMENT(), m_pos - m_tail) !=
+        ssize_t(ALIGNMENT()))
+      UTXX_THROW_IO_ERROR
+        (errno, "Error writing stream data to file ", m_filename);
+  }
 }
 
 //------------------------------------------------------------------------------
 template <uint MaxDepth>
-bool BaseSDBFileIO<MaxDepth>::
-WriteSeconds(time_val a_now)
+void BaseSDBFileIO<MaxDepth>::DirectWriter::
+Close()
 {
-  auto midnight_ns = a_now - Midnight();
-  int  usec        = midnight_ns.usec(); // Microsecs
-  m_last_sec       = midnight_ns.sec();  // Seconds since midnight
-  m_last_ts        = a_now;
-  m_last_usec      = usec;
+  if (m_fd < 0)
+    return;
 
-  // Check if the second changed and we need to write the second stream data
-  if (m_next_second == 0 || m_last_sec >= m_next_second) {
-    // Possibly update candles with current data offset at this second
-    m_candles_meta.UpdateDataOffset(m_last_sec, ftell(m_file));
-    // Write the new SecondsSample to file
-    if (!SecondsSample(m_last_sec).Write(m_file))
-      UTXX_THROW_IO_ERROR(errno, "Error writing seconds to file ",
-                          m_filename, " at ", ftell(m_file));
-    m_next_second = m_last_sec+1;
-    m_last_quote_px = NaN();
-    m_last_trade_px = NaN();
+  Drain();
 
-    return true;
-  }
+  // Trim the zero padding of the last partial sector
+  if (::ftruncate(m_fd, m_pos) < 0)
+    UTXX_THROW_IO_ERROR(errno, "Cannot truncate file ", m_filename);
 
-  return false;
+  ::close(m_fd);
+  m_fd = -1;
+
+#ifdef SDB_HAVE_URING
+  io_uring_queue_exit(&m_ring);
+#endif
+
+  for (auto p : m_bufs)
+    ::free(p);
+  m_bufs.clear();
+  m_free.clear();
+  m_tail = 0;
 }
 
 //------------------------------------------------------------------------------
 template <uint MaxDepth>
-template <PriceUnit PU, typename T>
-int BaseSDBFileIO<MaxDepth>::
-NormalizePx(T a_px)
+void BaseSDBFileIO<MaxDepth>::
+WriteBackend(WriteBackendT a_backend, int a_queue_depth)
 {
-  return PU == PriceUnit::DoubleVal
-      ? (int)(double(a_px) / m_header.PxStep()  + 0.5)
-      : PU == PriceUnit::PrecisionVal
-      ? (int)(int(a_px)    / m_header.PxScale() + 0.5)
-      : PU == PriceUnit::PriceSteps
-      ? a_px
-      : throw std::logic_error
-              ("Undefined price unit " UTXX_FILE_SRC_LOCATION);
+  if (utxx::unlikely(IsOpen()))
+    UTXX_THROW_RUNTIME_ERROR("WriteBackend() must be called before Open()");
+  m_backend = a_backend;
+  m_io_qd   = std::max(1, a_queue_depth);
 }
 
 //------------------------------------------------------------------------------
 template <uint MaxDepth>
-template <PriceUnit PU, typename PxT>
 void BaseSDBFileIO<MaxDepth>::
-WriteQuotes
-(
-  time_val a_ts,
-  PxLevels<MaxDepth, PxT>&& a_bids, size_t a_bid_cnt,
-  PxLevels<MaxDepth, PxT>&& a_asks, size_t a_ask_cnt
-)
+AsyncWrite(bool a_enable, BackPressureT a_bp)
 {
-  if (utxx::unlikely(a_bid_cnt > MaxDepth || a_ask_cnt > MaxDepth))
-    UTXX_THROW_RUNTIME_ERROR("Invalid bid/ask counts: ",a_bid_cnt,' ',a_ask_cnt);
-
-  // Start with the first
-  PxT  first_px;
-  int  qty;
-  PxLevel<PxT>* pb, *pb_end;
-  PxLevel<PxT>* pa, *pa_end;
+  if (utxx::unlikely(m_io_thread.joinable()))
+    UTXX_THROW_RUNTIME_ERROR("AsyncWrite() must be called before Open()");
+  m_async        = a_enable;
+  m_backpressure = a_bp;
+}
 
-  if (utxx::likely(a_bid_cnt > 0)) {
-    auto&  b = a_bids[a_bid_cnt-1];
-    first_px = NormalizePx<PU>(b.m_px);
-    qty      = b.m_qty;
-    pb       = &b;
-    // pb pointer points to the next item after the first bid:
-    pb_end   = pb-- - a_bid_cnt;
-    pa       = &a_asks[0];
-    pa_end   = pa + a_ask_cnt;
-  } else if (utxx::likely(a_ask_cnt > 0)) {
-    auto&  a = a_asks[a_ask_cnt-1];
-    first_px = NormalizePx<PU>(a.m_px);
-    qty      = a.m_qty;
-    // Since there are no bids, set pb to point to the end of the bids range,
-    // and the first price is based on a_asks[0], so pa pointer should be set
-    // to next item after the first ask:
-    pb       = &a_bids[0];
-    pb_end   = --pb;
-    pa       = &a;
-    pa_end   = pa++ + a_ask_cnt;
-  } else
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void BaseSDBFileIO<MaxDepth>::
+Flush()
+{
+  if (!m_file)
     return;
 
-  if (utxx::unlikely(a_ts < m_last_ts))
-    UTXX_THROW_RUNTIME_ERROR
-      ("Attempt to write an out-of-order timestamp=",
-       utxx::timestamp::to_string(a_ts, utxx::DATE_TIME_WITH_USEC),
-       ", last=",
-       utxx::timestamp::to_string(m_last_ts, utxx::DATE_TIME_WITH_USEC),
-       " to file ", m_filename);
+  SDB_STAT_TIMER(m_stats.m_flush);
 
-  // If the seconds advanced, write the new second since midnight (StreamID=0)
-  int  prev_usec  = m_last_usec;
-  bool sec_chng   = WriteSeconds(a_ts);
+  FlushWrBuf();
+  if (m_async)
+    WaitIoDrained();  // Barrier: all queued blocks are on disk past this point
+  if (m_dio.IsOpen())
+    m_dio.Drain();
+  ::fflush(m_file);
 
-  auto ts         = sec_chng ? m_last_usec : (m_last_usec - prev_usec);
+  // Everything encoded so far is on disk - snapshot the append-resume state
+  if (m_mode != OpenMode::Read && m_last_sec >= m_state_next_sec)
+    WriteStateTrailer();
+}
 
-  // StreamBase - when sec_chng is true, this is a Full quote; otherwise: Delta
-  bool delta = m_last_quote_px != NaN();
+//------------------------------------------------------------------------------
+// Append-resume state trailer (sidecar "<filename>.state")
+//
+// A small snapshot of the write state (data length, timestamps, delta-price
+// chains, candle accumulators) rewritten atomically every few seconds of
+// data time.  Open<OpenMode::Append> restores it and replays only the
+// samples written after the last rewrite, instead of decoding the whole day
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void BaseSDBFileIO<MaxDepth>::
+WriteStateTrailer()
+{
+  if (m_streams_meta.Compression() != StreamsMeta::CompressT::None ||
+      m_written_state != WriteStateT::WrData || m_dio.IsOpen())
+    return;
 
-  using QuoteSampleT = QuoteSample<MaxDepth*2, PriceT>;
+  // The trailer vouches for the file content up to m_flushed_pos
+  ::fflush(m_file);
+
+  size_t sz = 54;
+  for (auto& ch : m_candles_meta.Headers())
+    sz += 6 + ch.Candles().size() * 32;
+
+  std::vector<char> buf(sz);
+  char* p = &buf[0];
+  utxx::put32le(p, STATE_MAGIC());
+  utxx::put32le(p, uint32_t(STATE_VERSION()));
+  utxx::put64le(p, uint64_t(m_flushed_pos));
+  utxx::put64le(p, uint64_t(m_last_ts.sec()));
+  utxx::put32le(p, uint32_t(m_last_ts.usec()));
+  utxx::put32le(p, uint32_t(m_last_sec));
+  utxx::put32le(p, uint32_t(m_last_usec));
+  utxx::put32le(p, uint32_t(m_next_second));
+  utxx::put32le(p, uint32_t(m_last_quote_px));
+  utxx::put32le(p, uint32_t(m_last_trade_px));
+  utxx::put32le(p, uint32_t(m_last_order_px));
+  utxx::put16le(p, uint16_t(m_candles_meta.Headers().size()));
 
-  auto  book = typename QuoteSampleT::PxLevelsT();
+  for (auto& ch : m_candles_meta.Headers()) {
+    utxx::put16le(p, ch.Resolution());
+    utxx::put32le(p, uint32_t(ch.Candles().size()));
+    for (auto& c : ch.Candles()) {
+      utxx::put32le(p, uint32_t(c.Open()));
+      utxx::put32le(p, uint32_t(c.High()));
+      utxx::put32le(p, uint32_t(c.Low()));
+      utxx::put32le(p, uint32_t(c.Close()));
+      utxx::put32le(p, c.BVolume());
+      utxx::put32le(p, c.SVolume());
+      utxx::put64le(p, c.DataOffset());
+    }
+  }
+  assert(p == &buf[0] + sz);
+
+  // Best effort: failing to write the trailer must not fail the data path
+  auto  name = StateFilename();
+  auto  tmp  = name + ".tmp";
+  FILE* f    = fopen(tmp.c_str(), "w");
+  if (!f)
+    return;
+
+  bool ok = fwrite(&buf[0], 1, sz, f) == sz;
+  ok      = (fclose(f) == 0) && ok;
+  if (ok)
+    ok    = ::rename(tmp.c_str(), name.c_str()) == 0;
+  if (!ok)
+    ::unlink(tmp.c_str());
+
+  m_state_next_sec = m_last_sec + STATE_UPDATE_SECS();
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+bool BaseSDBFileIO<MaxDepth>::
+TryResumeFromTrailer(size_t a_file_size)
+{
+  // Book deltas need a base snapshot that the trailer doesn't carry, and a
+  // tail replay could then hit a delta without its preceding full quote
+  if (m_book_deltas)
+    return false;
+
+  auto  name = StateFilename();
+  FILE* f    = fopen(name.c_str(), "r");
+  if (!f)
+    return false;
+
+  fseek(f, 0, SEEK_END);
+  long fsz = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  if (fsz < 54) {
+    fclose(f);
+    return false;
+  }
+
+  std::vector<char> buf(fsz);
+  bool ok = fread(&buf[0], 1, fsz, f) == size_t(fsz);
+  fclose(f);
+  if (!ok)
+    return false;
+
+  const char* p   = &buf[0];
+  const char* end = p + fsz;
+
+  if (uint32_t(utxx::get32le(p)) != STATE_MAGIC() ||
+      int     (utxx::get32le(p)) != STATE_VERSION())
+    return false;
+
+  auto data_len = long(utxx::get64le(p));
+
+  // Stale if the file lost data written after the trailer (e.g. unflushed
+  // stdio buffers in a crash): fall back to the full replay
+  if (data_len > long(a_file_size) ||
+      data_len < long(m_streams_meta.DataOffset()) + 4)
+    return false;
+
+  auto ts_sec   = long(utxx::get64le(p));
+  auto ts_usec  = int (utxx::get32le(p));
+  auto last_sec = int (utxx::get32le(p));
+  auto last_usec= int (utxx::get32le(p));
+  auto next_sec = int (utxx::get32le(p));
+  auto quote_px = int (utxx::get32le(p));
+  auto trade_px = int (utxx::get32le(p));
+  auto order_px = int (utxx::get32le(p));
+  auto nhdrs    = int (utxx::get16le(p));
+
+  if (size_t(nhdrs) != m_candles_meta.Headers().size())
+    return false;
+
+  // Fill a copy of the candle accumulators; applied only when fully valid
+  auto cm = m_candles_meta;
+  for (auto& ch : cm.Headers()) {
+    if (end - p < 6                                               ||
+        uint16_t(utxx::get16le(p)) != ch.Resolution()             ||
+        size_t(uint32_t(utxx::get32le(p))) != ch.Candles().size() ||
+        end - p < long(ch.Candles().size()) * 32)
+      return false;
+
+    for (auto& c : ch.Candles()) {
+      auto o  = int(utxx::get32le(p));
+      auto h  = int(utxx::get32le(p));
+      auto l  = int(utxx::get32le(p));
+      auto cl = int(utxx::get32le(p));
+      auto bv = uint32_t(utxx::get32le(p));
+      auto sv = uint32_t(utxx::get32le(p));
+      auto off= uint64_t(utxx::get64le(p));
+      c = Candle(o, h, l, cl, bv, sv, off);
+    }
+    ch.LastUpdated(nullptr);
+  }
+
+  // The trailer is valid: restore the write state
+  m_last_ts = utxx::time_val(utxx::secs(ts_sec));
+  m_last_ts.usec(ts_usec);
+  m_last_sec       = last_sec;
+  m_last_usec      = last_usec;
+  m_next_second    = next_sec;
+  m_last_quote_px  = quote_px;
+  m_last_trade_px  = trade_px;
+  m_last_order_px  = order_px;
+  m_candles_meta   = std::move(cm);
+  m_state_next_sec = m_last_sec + STATE_UPDATE_SECS();
+
+  if (m_debug)
+    std::cerr << "Resuming append of " << m_filename << " at " << data_len
+              << " (of " << a_file_size << ") from the state trailer"
+              << std::endl;
+
+  // Replay the (normally tiny) tail written after the last trailer rewrite
+  ReplayTail(data_len);
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void BaseSDBFileIO<MaxDepth>::
+ReplayTail(long a_from)
+{
+  if (fseek(m_file, a_from, SEEK_SET) < 0)
+    UTXX_THROW_IO_ERROR
+      (errno, "Can't seek to offset ", a_from, ": ", m_filename);
+
+  auto dummy = [](auto& sample) {};
+
+  utxx::dynamic_io_buffer buf(4096);
+  long pos = a_from;
+
+  while (true) {
+    long n = fread(buf.wr_ptr(), 1, buf.capacity(), m_file);
+    if  (n == 0)
+      break;
+
+    buf.commit(n);
+
+    while (n > 0) {
+      n = ReadSample(buf.rd_ptr(), buf.size(), dummy);
+
+      if (n == 0) break;
+      if (n <  0)
+        UTXX_THROW_IO_ERROR(errno, "Error reading from file ", m_filename);
+
+      buf.read(n);
+      pos += n;
+    }
+
+    buf.crunch();
+  }
+
+  // Appended samples overwrite whatever partial tail sample may follow
+  m_flushed_pos = pos;
+  if (fseek(m_file, pos, SEEK_SET) < 0)
+    UTXX_THROW_IO_ERROR
+      (errno, "Can't seek to offset ", pos, ": ", m_filename);
+}
+
+//------------------------------------------------------------------------------
+// Hand the filled encode buffer to the I/O thread (producer side of the ring)
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+bool BaseSDBFileIO<MaxDepth>::
+EnqueueWrBuf()
+{
+  auto head = m_ring_head.load(std::memory_order_relaxed);
+
+  if (head - m_ring_tail.load(std::memory_order_acquire) == WR_RING_SIZE()) {
+    if (m_backpressure == BackPressureT::Drop) {
+      // Lossy mode: discard this block rather than stall the encoding thread
+      m_dropped_blks.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    // Block until the I/O thread frees a slot
+    std::unique_lock<std::mutex> lock(m_io_mutex);
+    m_io_cv.wait(lock, [&]() {
+      return head - m_ring_tail.load(std::memory_order_acquire)
+           < WR_RING_SIZE();
+    });
+  }
+
+  auto& slot = m_wr_ring[head & (WR_RING_SIZE()-1)];
+
+  // Swap buffers with the slot so the encode arena stays allocated
+  slot.buf.swap(m_wr_buf);
+  slot.size      = m_wr_size;
+  slot.first_sec = m_blk_first_sec;
+  slot.records   = m_wr_records;
+
+  if (m_wr_buf.size() < m_wr_cap)
+    m_wr_buf.resize(m_wr_cap);
+
+  // Publish under the mutex to avoid a lost wakeup of the sleeping I/O
+  // thread.  This costs one uncontended lock per block, not per sample
+  {
+    std::unique_lock<std::mutex> lock(m_io_mutex);
+    m_ring_head.store(head + 1, std::memory_order_release);
+  }
+  m_io_cv.notify_all();
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Consumer side of the ring: drain blocks to file on the dedicated I/O thread
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void BaseSDBFileIO<MaxDepth>::
+IoThreadLoop()
+{
+  auto tail = m_ring_tail.load(std::memory_order_relaxed);
+
+  while (true) {
+    if (tail == m_ring_head.load(std::memory_order_acquire)) {
+      std::unique_lock<std::mutex> lock(m_io_mutex);
+      m_io_cv.wait(lock, [&]() {
+        return m_io_stop
+            || tail != m_ring_head.load(std::memory_order_acquire);
+      });
+      if (tail == m_ring_head.load(std::memory_order_acquire))
+        break;  // Stopped and the ring is drained
+    }
+
+    auto& slot = m_wr_ring[tail & (WR_RING_SIZE()-1)];
+
+    try {
+      if (!m_io_error)  // Don't write past the first failure
+        WriteBlock(&slot.buf[0], slot.size, slot.first_sec, slot.records);
+    } catch (...) {
+      // Surfaced to the caller by Flush()/Close()
+      m_io_error = std::current_exception();
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(m_io_mutex);
+      m_ring_tail.store(++tail, std::memory_order_release);
+    }
+    m_io_cv.notify_all();
+  }
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void BaseSDBFileIO<MaxDepth>::
+WaitIoDrained()
+{
+  std::unique_lock<std::mutex> lock(m_io_mutex);
+  m_io_cv.wait(lock, [&]() {
+    return m_ring_tail.load(std::memory_order_acquire)
+        == m_ring_head.load(std::memory_order_relaxed);
+  });
+
+  if (utxx::unlikely(m_io_error != nullptr)) {
+    auto err   = m_io_error;
+    m_io_error = nullptr;
+    std::rethrow_exception(err);
+  }
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void BaseSDBFileIO<MaxDepth>::
+StopIoThread()
+{
+  if (!m_io_thread.joinable())
+    return;
+
+  {
+    std::unique_lock<std::mutex> lock(m_io_mutex);
+    m_io_stop = true;
+  }
+  m_io_cv.notify_all();
+  m_io_thread.join();
+  m_io_stop = false;
+
+  if (utxx::unlikely(m_io_error != nullptr)) {
+    auto err   = m_io_error;
+    m_io_error = nullptr;
+    std::rethrow_exception(err);
+  }
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+int BaseSDBFileIO<MaxDepth>::
+ReadHeader()
+{
+  assert(m_file);
+  auto   sz = utxx::path::file_size(fileno(m_file));
+  return m_header(m_file, sz);
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+int BaseSDBFileIO<MaxDepth>::
+WriteHeader
+(
+  std::string const& a_xchg,
+  std::string const& a_symbol,
+  std::string const& a_instr,
+  long               a_secid,
+  time_val           a_date,
+  std::string const& a_tz_name,
+  int                a_tz_offset,
+  uint8_t            a_depth,
+  double             a_px_step,
+  uuid        const& a_uuid
+)
+{
+  if (m_written_state != WriteStateT::Init)
+    UTXX_THROW_RUNTIME_ERROR("Header already written to file ", m_filename);
+
+  assert(m_file);
+  auto   sz = utxx::path::file_size(fileno(m_file));
+  if (sz > 0)
+    UTXX_THROW_RUNTIME_ERROR
+      ("Cannot write SDB header to non-empty file ", m_filename);
+
+  m_header.Set(VERSION(), a_xchg,    a_symbol,    a_instr,  a_secid,
+               a_date,    a_tz_name, a_tz_offset, a_depth,  a_px_step, a_uuid);
+
+  try { sz = m_header.Write(m_file); }
+  catch (std::exception const& e) {
+    UTXX_THROW_IO_ERROR(errno, "Error writing header to file ", m_filename);
+  }
+
+  m_written_state = WriteStateT::WrHeader;
+
+  return sz;
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void BaseSDBFileIO<MaxDepth>::
+WriteStreamsMeta(std::vector<StreamType>&& a_types, StreamsMeta::CompressT a_cmp)
+{
+  if (m_written_state != WriteStateT::WrHeader)
+    UTXX_THROW_RUNTIME_ERROR
+      ("Streams metadata already written to file ", m_filename);
+
+#ifndef SDB_HAVE_ZSTD
+  if (a_cmp == StreamsMeta::CompressT::Zstd)
+    UTXX_THROW_RUNTIME_ERROR
+      ("Cannot write compressed file ", m_filename,
+       ": SDB was compiled without zstd support");
+#endif
+
+  auto v = std::vector<StreamsMeta::StreamMeta>();
+
+  for (auto st: a_types) v.emplace_back(st);
+  if (m_debug) {
+    auto n = ftell(m_file);
+    std::cerr << "  StreamsMeta position: " << n << " (" << std::hex << n << ")\n";
+  }
+
+  m_streams_meta = StreamsMeta(std::move(v), 0, a_cmp);
+  m_streams_meta.Version(m_header.Version());
+  SetBookDeltasFromMeta();
+
+  if (m_streams_meta.Write(m_file) < 0)
+    UTXX_THROW_IO_ERROR
+      (errno, "Error writing streams metadata to file ", m_filename);
+
+  // At this point m_streams_meta contains the DataOffset() field that needs
+  // to be updated after the candles are written
+
+  m_written_state = WriteStateT::WrStreamsMeta;
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void BaseSDBFileIO<MaxDepth>::
+WriteCandlesMeta(CandlesMeta&& a_meta)
+{
+  if (m_written_state != WriteStateT::WrStreamsMeta)
+    UTXX_THROW_RUNTIME_ERROR
+      ("Candles metadata already written to file ", m_filename);
+
+  if (m_debug) {
+    auto n = ftell(m_file);
+    std::cerr << "  CandlesMeta position: " << std::dec << n
+              << " (" << std::hex << n      << std::dec << ")\n";
+  }
+
+  a_meta.Version(m_header.Version());
+
+  if (a_meta.Write(m_file, m_debug) < 0)
+    UTXX_THROW_IO_ERROR(errno, "Error writing candle data to file ", m_filename);
+
+  m_candles_meta  = std::move(a_meta);
+  m_written_state = WriteStateT::WrCandlesMeta;
+
+  // Now that we know the beginning of data offset, write it to the
+  // StreamsMeta header:
+  if (m_streams_meta.WriteDataOffset(m_file, ftell(m_file)) < 0)
+    UTXX_THROW_IO_ERROR
+      (errno, "Error writing beginning of data offset to file ", m_filename);
+
+  char  buf[4];
+  char* p = buf;
+  utxx::put32le(p, BEGIN_STREAM_DATA());
+
+  if (m_debug)
+    std::cerr << " Begin Stream Marker: "  << std::dec << ftell(m_file) << " ("
+              << std::hex << ftell(m_file) << ')'      << std::dec << std::endl;
+
+  if (fwrite(buf, 1, sizeof(buf), m_file) != sizeof(buf))
+    UTXX_THROW_IO_ERROR
+      (errno, "Error writing beginning data marker to file ", m_filename);
+
+  // Stream data starts here - track the logical offset internally so that
+  // the write hot path doesn't need ftell().  For compressed files the
+  // logical offset is the uncompressed stream offset starting at 0.
+  m_flushed_pos   = m_streams_meta.Compression() == StreamsMeta::CompressT::None
+                  ? ftell(m_file) : 0;
+  m_raw_written   = 0;
+  m_wr_size       = 0;
+  m_wr_records    = 0;
+
+  if (m_backend == WriteBackendT::Direct && m_mode == OpenMode::Write) {
+    // Metadata above is on disk via stdio; data blocks written from here on
+    // bypass the page cache
+    ::fflush(m_file);
+    m_dio.Open(m_filename, m_io_qd, ftell(m_file));
+  }
+
+  m_written_state = WriteStateT::WrData;
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+bool BaseSDBFileIO<MaxDepth>::
+WriteSeconds(time_val a_now)
+{
+  auto midnight_ns = a_now - Midnight();
+  int  usec        = midnight_ns.usec(); // Microsecs
+  m_last_sec       = midnight_ns.sec();  // Seconds since midnight
+  m_last_ts        = a_now;
+  m_last_usec      = usec;
+
+  // Check if the second changed and we need to write the second stream data
+  if (m_next_second == 0 || m_last_sec >= m_next_second) {
+    // Possibly update candles with current data offset at this second
+    m_candles_meta.UpdateDataOffset(m_last_sec, LogicalPos());
+    // Encode the new SecondsSample into the write buffer
+    EnsureWrSpace(16);
+    if (!m_wr_size)
+      m_blk_first_sec = m_last_sec;  // First sample of a new data block
+    auto p = WrPtr();
+    SecondsSample(m_last_sec).Encode(p);
+    WrCommit(p);
+    m_next_second = m_last_sec+1;
+    m_last_quote_px = NaN();
+    m_last_trade_px = NaN();
+    m_last_order_px = NaN();
+
+    return true;
+  }
+
+  return false;
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+template <PriceUnit PU, typename T>
+int BaseSDBFileIO<MaxDepth>::
+NormalizePx(T a_px)
+{
+  return PU == PriceUnit::DoubleVal
+      ? (int)(double(a_px) / m_header.PxStep()  + 0.5)
+      : PU == PriceUnit::PrecisionVal
+      ? (int)(int(a_px)    / m_header.PxScale() + 0.5)
+      : PU == PriceUnit::PriceSteps
+      ? a_px
+      : throw std::logic_error
+              ("Undefined price unit " UTXX_FILE_SRC_LOCATION);
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+template <PriceUnit PU, typename PxT>
+void BaseSDBFileIO<MaxDepth>::
+WriteQuotes
+(
+  time_val a_ts,
+  PxLevels<MaxDepth, PxT>&& a_bids, size_t a_bid_cnt,
+  PxLevels<MaxDepth, PxT>&& a_asks, size_t a_ask_cnt
+)
+{
+  if (utxx::unlikely(a_bid_cnt > MaxDepth || a_ask_cnt > MaxDepth))
+    UTXX_THROW_RUNTIME_ERROR("Invalid bid/ask counts: ",a_bid_cnt,' ',a_ask_cnt);
+
+  SDB_STAT_TIMER(m_stats.m_wr_quote);
+
+  // Incremental encoding: write only the changed levels when a base snapshot
+  // exists within the current second
+  if (m_book_deltas &&
+      TryWriteBookDelta<PU>(a_ts, a_bids, a_bid_cnt, a_asks, a_ask_cnt))
+    return;
+
+  // Start with the first
+  PxT  first_px;
+  int  qty;
+  PxLevel<PxT>* pb, *pb_end;
+  PxLevel<PxT>* pa, *pa_end;
+
+  if (utxx::likely(a_bid_cnt > 0)) {
+    auto&  b = a_bids[a_bid_cnt-1];
+    first_px = NormalizePx<PU>(b.m_px);
+    qty      = b.m_qty;
+    pb       = &b;
+    // pb pointer points to the next item after the first bid:
+    pb_end   = pb-- - a_bid_cnt;
+    pa       = &a_asks[0];
+    pa_end   = pa + a_ask_cnt;
+  } else if (utxx::likely(a_ask_cnt > 0)) {
+    auto&  a = a_asks[a_ask_cnt-1];
+    first_px = NormalizePx<PU>(a.m_px);
+    qty      = a.m_qty;
+    // Since there are no bids, set pb to point to the end of the bids range,
+    // and the first price is based on a_asks[0], so pa pointer should be set
+    // to next item after the first ask:
+    pb       = &a_bids[0];
+    pb_end   = --pb;
+    pa       = &a;
+    pa_end   = pa++ + a_ask_cnt;
+  } else
+    return;
+
+  if (utxx::unlikely(a_ts < m_last_ts))
+    UTXX_THROW_RUNTIME_ERROR
+      ("Attempt to write an out-of-order timestamp=",
+       utxx::timestamp::to_string(a_ts, utxx::DATE_TIME_WITH_USEC),
+       ", last=",
+       utxx::timestamp::to_string(m_last_ts, utxx::DATE_TIME_WITH_USEC),
+       " to file ", m_filename);
+
+  using QuoteSampleT = QuoteSample<MaxDepth*2, PriceT>;
+
+  // Reserve space for this sample plus a possible SecondsSample before any
+  // encoding state is read: a flush here may start a new data block, which
+  // resets the time/price chains so that blocks decode independently
+  EnsureWrSpace(16 + QuoteSampleT::MAX_SIZE());
+
+  // If the seconds advanced, write the new second since midnight (StreamID=0)
+  int  prev_usec  = m_last_usec;
+  bool sec_chng   = WriteSeconds(a_ts);
+
+  auto ts         = sec_chng ? m_last_usec : (m_last_usec - prev_usec);
+
+  // StreamBase - when sec_chng is true, this is a Full quote; otherwise: Delta
+  bool delta = m_last_quote_px != NaN();
+
+  auto  book = typename QuoteSampleT::PxLevelsT();
   auto  q    = &book[0];
   q->m_px    = delta ? first_px - m_last_quote_px : first_px;
   q->m_qty   = qty;
 
-  m_last_quote_px = first_px;
-  auto    prev_px = first_px;
+  m_last_quote_px = first_px;
+  auto    prev_px = first_px;
+
+  // Remaining Bids (a_bids are in descending order, so we go in reverse dir)
+  for (++q; pb != pb_end; --pb, ++q) {
+    // Calculate differential price, and update it in the PxLevels container
+    auto px  = NormalizePx<PU>(pb->m_px);
+    q->m_px  = px - prev_px;
+    q->m_qty = pb->m_qty;
+    prev_px  = px;
+  }
+
+  // Asks (a_asks are sorted in ascending order, so we go in forward direction)
+  for (; pa != pa_end; ++pa, ++q) {
+    // Calculate differential price, and update it in the PxLevels container
+    auto px  = NormalizePx<PU>(pa->m_px);
+    q->m_px  = px - prev_px;
+    q->m_qty = pa->m_qty; // Asks are negative
+    prev_px  = px;
+  }
+
+  QuoteSampleT qt(delta, ts, std::move(book), a_bid_cnt, a_ask_cnt);
+
+  auto ptr = WrPtr();
+  qt.Encode(ptr);
+  SDB_STAT({ auto& c = m_stats.m_wr[int(StreamType::Quotes)];
+             c.m_samples++; c.m_bytes += ptr - WrPtr(); c.m_deltas += delta; });
+  WrCommit(ptr);
+
+  // This full snapshot becomes the base for subsequent book deltas
+  if (m_book_deltas)
+    CaptureWrBook<PU>(a_bids, a_bid_cnt, a_asks, a_ask_cnt);
+}
+
+//------------------------------------------------------------------------------
+// Save the current book as the base snapshot for subsequent book deltas
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+template <PriceUnit PU, typename PxT>
+void BaseSDBFileIO<MaxDepth>::
+CaptureWrBook
+(
+  PxLevels<MaxDepth, PxT> const& a_bids, size_t a_bid_cnt,
+  PxLevels<MaxDepth, PxT> const& a_asks, size_t a_ask_cnt
+)
+{
+  auto& lv = m_wr_book.Levels();
+
+  // Stored level order: bids ascending by price, then asks ascending
+  // (a_bids come sorted in descending order, a_asks - in ascending)
+  for (size_t i = 0; i < a_bid_cnt; ++i) {
+    auto& b = a_bids[a_bid_cnt - 1 - i];
+    lv[i].Set(NormalizePx<PU>(b.m_px), b.m_qty);
+  }
+  for (size_t i = 0; i < a_ask_cnt; ++i) {
+    auto& a = a_asks[i];
+    lv[a_bid_cnt + i].Set(NormalizePx<PU>(a.m_px), a.m_qty);
+  }
+
+  m_wr_book.Set(0, a_bid_cnt, a_ask_cnt);
+  m_wr_book_valid = true;
+}
+
+//------------------------------------------------------------------------------
+// Write an incremental book update (see BookDeltaSample)
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+template <PriceUnit PU, typename PxT>
+bool BaseSDBFileIO<MaxDepth>::
+TryWriteBookDelta
+(
+  time_val a_ts,
+  PxLevels<MaxDepth, PxT> const& a_bids, size_t a_bid_cnt,
+  PxLevels<MaxDepth, PxT> const& a_asks, size_t a_ask_cnt
+)
+{
+  using BookDeltaSampleT = BookDeltaSample<MaxDepth, PriceT>;
+
+  if (!m_wr_book_valid)
+    return false;
+
+  // A new second gets a full snapshot so readers can resync at SecondsSamples
+  int sec = a_ts.sec() - m_header.Date();
+  if (sec >= m_next_second || utxx::unlikely(a_ts < m_last_ts))
+    return false;
+
+  EnsureWrSpace(BookDeltaSampleT::MAX_SIZE());
+
+  // A compressed block boundary flush invalidates the base snapshot
+  if (!m_wr_book_valid)
+    return false;
+
+  // Normalize the new book into stored level order
+  typename BookDeltaSampleT::QuoteSampleT curr;
+  auto& lv = curr.Levels();
+  for (size_t i = 0; i < a_bid_cnt; ++i) {
+    auto& b = a_bids[a_bid_cnt - 1 - i];
+    lv[i].Set(NormalizePx<PU>(b.m_px), b.m_qty);
+  }
+  for (size_t i = 0; i < a_ask_cnt; ++i) {
+    auto& a = a_asks[i];
+    lv[a_bid_cnt + i].Set(NormalizePx<PU>(a.m_px), a.m_qty);
+  }
+  curr.Set(0, a_bid_cnt, a_ask_cnt);
+
+  auto ts = (a_ts - Midnight()).usec() - m_last_usec;
+
+  BookDeltaSampleT bd;
+  if (!bd.Diff(m_wr_book, curr, ts))
+    // Unchanged book: write nothing.  The time state is left untouched so
+    // the next sample's time delta stays relative to the last written one
+    return true;
+
+  bool sec_chng = WriteSeconds(a_ts);   // Updates the time state; no-op
+  assert(!sec_chng); (void)sec_chng;    // sample-wise given the checks above
+
+  auto ptr = WrPtr();
+  bd.Encode(ptr);
+  SDB_STAT({ auto& c = m_stats.m_wr[int(StreamType::BookDelta)];
+             c.m_samples++; c.m_bytes += ptr - WrPtr(); c.m_deltas++; });
+  WrCommit(ptr);
+
+  m_wr_book = curr;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+template <PriceUnit PU, typename PxT>
+void BaseSDBFileIO<MaxDepth>::
+WriteTrade
+(
+  time_val  a_ts,
+  SideT     a_side,
+  PxT       a_px,
+  uint      a_qty,
+  AggrT     a_aggr,
+  size_t    a_ord_id,
+  size_t    a_trade_id
+)
+{
+  if (utxx::unlikely(a_ts < m_last_ts))
+    UTXX_THROW_RUNTIME_ERROR
+      ("Attempt to write an out-of-order timestamp ",
+       utxx::timestamp::to_string(a_ts, utxx::TIME_WITH_USEC),
+       "to file ", m_filename);
+
+  SDB_STAT_TIMER(m_stats.m_wr_trade);
+
+  // Reserved before the price/time chains are read (see WriteQuotes())
+  EnsureWrSpace(16 + TradeSample::MAX_SIZE());
+
+  // If the seconds advanced, write the new second since midnight (StreamID=0)
+  int  prev_usec  = m_last_usec;
+  bool sec_chng   = WriteSeconds(a_ts);
+  auto ts         = sec_chng ? m_last_usec : (m_last_usec - prev_usec);
+
+  // When seconds changed, this is a Full quote; otherwise: Delta
+  bool delta      = m_last_trade_px != NaN();
+  auto px         = NormalizePx<PU>(a_px);
+  auto px_inc     = delta ? (px - m_last_trade_px) : px;
 
-  // Remaining Bids (a_bids are in descending order, so we go in reverse dir)
-  for (++q; pb != pb_end; --pb, ++q) {
-    // Calculate differential price, and update it in the PxLevels container
-    auto px  = NormalizePx<PU>(pb->m_px);
-    q->m_px  = px - prev_px;
-    q->m_qty = pb->m_qty;
-    prev_px  = px;
+  m_last_trade_px = px;
+
+  TradeSample tr(delta, ts, a_side, px_inc, a_qty, a_aggr, a_ord_id, a_trade_id);
+
+  auto ptr = WrPtr();
+  tr.Encode(ptr);
+  SDB_STAT({ auto& c = m_stats.m_wr[int(StreamType::Trade)];
+             c.m_samples++; c.m_bytes += ptr - WrPtr(); c.m_deltas += delta; });
+  WrCommit(ptr);
+
+  // Update candles using this trade
+  int qty = a_side == SideT::Buy ? int(a_qty) : -int(a_qty);
+  m_candles_meta.UpdateCandles(m_last_sec, px, qty);
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+template <PriceUnit PU, typename PxT>
+void BaseSDBFileIO<MaxDepth>::
+WriteOrder
+(
+  time_val             a_ts,
+  OrderSample::ActionT a_action,
+  SideT                a_side,
+  size_t               a_order_id,
+  PxT                  a_px,
+  int                  a_qty
+)
+{
+  if (utxx::unlikely(a_ts < m_last_ts))
+    UTXX_THROW_RUNTIME_ERROR
+      ("Attempt to write an out-of-order timestamp ",
+       utxx::timestamp::to_string(a_ts, utxx::TIME_WITH_USEC),
+       "to file ", m_filename);
+
+  // Reserved before the price/time chains are read (see WriteQuotes())
+  EnsureWrSpace(16 + OrderSample::MAX_SIZE());
+
+  // If the seconds advanced, write the new second since midnight (StreamID=0)
+  int  prev_usec  = m_last_usec;
+  bool sec_chng   = WriteSeconds(a_ts);
+  auto ts         = sec_chng ? m_last_usec : (m_last_usec - prev_usec);
+
+  // Delete orders carry no price; encode it only for Add/Modify
+  bool has_px     = a_action != OrderSample::ActionT::Delete;
+
+  // When seconds changed, this is a Full sample; otherwise: Delta
+  bool delta      = m_last_order_px != NaN();
+  auto px         = has_px ? NormalizePx<PU>(a_px) : 0;
+  auto px_inc     = (has_px && delta) ? (px - m_last_order_px) : px;
+
+  if (has_px)
+    m_last_order_px = px;
+
+  OrderSample::FieldMask mask(a_action, a_side, has_px, a_qty != 0);
+  OrderSample os(delta, mask, ts, a_order_id, px_inc, a_qty);
+
+  auto ptr = WrPtr();
+  os.Encode(ptr);
+  WrCommit(ptr);
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+int BaseSDBFileIO<MaxDepth>::
+WriteMsg(time_val a_ts, const char* a_msg, size_t a_sz)
+{
+  if (utxx::unlikely(a_ts < m_last_ts))
+    UTXX_THROW_RUNTIME_ERROR
+      ("Attempt to write an out-of-order timestamp ",
+       utxx::timestamp::to_string(a_ts, utxx::TIME_WITH_USEC),
+       "to file ", m_filename);
+
+  // Reserved before the time chain is read (see WriteQuotes())
+  EnsureWrSpace(32 + a_sz);
+
+  // If the seconds advanced, write the new second since midnight (StreamID=0)
+  int  prev_usec  = m_last_usec;
+  bool sec_chng   = WriteSeconds(a_ts);
+  auto ts         = sec_chng ? m_last_usec : (m_last_usec - prev_usec);
+
+  MessageSample ms(ts, a_msg, a_sz);
+
+  auto ptr = WrPtr();
+  int  n   = ms.Encode(ptr);
+  WrCommit(ptr);
+  return n;
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+int BaseSDBFileIO<MaxDepth>::
+WriteSummary
+(
+  time_val  a_ts,
+  int       a_bid_qty,
+  int       a_ask_qty,
+  bool      a_has_open_pos,
+  int       a_open_pos,
+  bool      a_has_risk,
+  double    a_risk
+)
+{
+  if (utxx::unlikely(a_ts < m_last_ts))
+    UTXX_THROW_RUNTIME_ERROR
+      ("Attempt to write an out-of-order timestamp ",
+       utxx::timestamp::to_string(a_ts, utxx::TIME_WITH_USEC),
+       "to file ", m_filename);
+
+  // Reserved before the time chain is read (see WriteQuotes())
+  EnsureWrSpace(16 + SummarySample::MAX_SIZE());
+
+  // If the seconds advanced, write the new second since midnight (StreamID=0)
+  int  prev_usec  = m_last_usec;
+  bool sec_chng   = WriteSeconds(a_ts);
+  auto ts         = sec_chng ? m_last_usec : (m_last_usec - prev_usec);
+
+  SummarySample ss(ts, a_bid_qty, a_ask_qty,
+                   a_has_open_pos, a_open_pos, a_has_risk, a_risk);
+
+  auto ptr = WrPtr();
+  int  n   = ss.Encode(ptr);
+  WrCommit(ptr);
+  return n;
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void BaseSDBFileIO<MaxDepth>::
+UpdateCandles(int a_ts, PriceT a_px, int a_qty)
+{
+  m_candles_meta.UpdateCandles(a_ts, a_px, a_qty);
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void BaseSDBFileIO<MaxDepth>::
+AddCandleVolumes(int a_ts, int a_buy_qty, int a_sell_qty)
+{
+  m_candles_meta.AddCandleVolumes(a_ts, a_buy_qty, a_sell_qty);
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void BaseSDBFileIO<MaxDepth>::
+PrintCandles(std::ostream& out, int a_resolution) const
+{
+  if (m_debug)
+    out << "  Candle Resolutions: " << m_candles_meta.Headers().size()
+        << std::endl;
+
+  bool found = a_resolution == -1;
+  uint idx   = 0;
+  for (auto& ch : m_candles_meta.Headers()) {
+    // If requested specific candle resolution - skip the rest
+    if (a_resolution != -1 && a_resolution != ch.Resolution())
+      continue;
+
+    auto n = ch.Candles().size();
+    int  s = ch.StartTime() + TZOffset();
+    int  e = s + ch.Resolution()*n;
+    char buf[128];
+    sprintf(buf, "# Resolution: %ds %02d:%02d - %02d:%02d %s (UTC: %ld)\n",
+            ch.Resolution(),
+            s / 3600, s % 3600 / 60,
+            e / 3600, e % 3600 / 60,
+            TZ().c_str(), Date() + ch.StartTime());
+    out << buf <<
+      "#Time    Open   High   Low    Close     BuyVol   SellVol DataOffset\n";
+
+    for (auto& c : ch.Candles()) {
+      int  ts = ch.CandleToTime(idx++) + TZOffset();
+      uint h  = ts / 3600, m = ts % 3600 / 60, s = ts % 60;
+      //if (c.DataOffset() == 0)
+      //  continue;
+      int  n  = sprintf(buf, "%02d:%02d:%02d ", h,m,s);
+      auto px = [&, this](int a_px) {
+        n += FormatPx(buf+n, a_px, PxScale(), PxPrecision());
+        buf[n++] = ' ';
+      };
+      px(c.Open()); px(c.High()); px(c.Low()); px(c.Close());
+      out.write(buf, n)
+          << std::setw(9)   << c.BVolume() << ' '
+          << std::setw(9)   << c.SVolume();
+      if (m_debug)
+        out << " [" << c.DataOffset() << "]\n";
+      else
+        out << '\n';
+    }
+
+    found = true;
   }
 
-  // Asks (a_asks are sorted in ascending order, so we go in forward direction)
-  for (; pa != pa_end; ++pa, ++q) {
-    // Calculate differential price, and update it in the PxLevels container
-    auto px  = NormalizePx<PU>(pa->m_px);
-    q->m_px  = px - prev_px;
-    q->m_qty = pa->m_qty; // Asks are negative
-    prev_px  = px;
+  if (!found)
+    UTXX_THROW_RUNTIME_ERROR
+      ("Requested candle resolution ", a_resolution, "not found in ", m_filename);
+}
+
+//------------------------------------------------------------------------------
+// Rebuild candles of an arbitrary resolution from the trade stream
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+CandleHeader& BaseSDBFileIO<MaxDepth>::
+RecomputeCandles(int a_resolution)
+{
+  assert(m_mode == OpenMode::Read);
+
+  struct Rebuilder {
+    BaseSDBFileIO& io;
+    CandlesMeta&   meta;
+
+    bool operator()(TradeSample const& a) {
+      int qty = a.Side() == SideT::Buy ? int(a.Qty()) : -int(a.Qty());
+      meta.UpdateCandles(io.m_last_sec, a.Price(), qty);
+      return true;
+    }
+    template <typename T>
+    bool operator()(T const&) { return true; }
+  };
+
+  // Cover the whole day; candles outside the traded range stay empty
+  CandlesMeta meta({CandleHeader(a_resolution, 0, 86400)});
+
+  Rebuilder rb{*this, meta};
+  Read(rb);
+
+  m_candles_meta.Headers().emplace_back(std::move(meta.Headers()[0]));
+  return m_candles_meta.Headers().back();
+}
+
+//------------------------------------------------------------------------------
+// Decode a single sample pointed to by a_buf
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+template <typename OnSample>
+long BaseSDBFileIO<MaxDepth>::
+ReadSample(const char* a_buf, size_t a_sz, OnSample& a_fun)
+{
+  if (a_sz < 2)
+    return 0;
+
+  auto x         = *(uint8_t*)a_buf;
+  auto base      = (StreamBase*)&x;
+  bool is_delta  = base->Delta();
+  auto stream_tp = base->Type();
+  long n         = 0;
+
+  switch (stream_tp) {
+    case StreamType::Seconds: {
+      SecondsSample ss;
+      n = ss.Read(a_buf, a_sz);
+      if (n > 0) {
+        time_t secs     = m_header.Midnight().sec() + ss.Time();
+        m_last_ts.set(secs);
+        m_last_sec      = ss.Time(); //secs;
+        m_last_usec     = 0;
+        m_next_second   = m_last_sec + 1;
+        m_last_quote_px = NaN();
+        m_last_trade_px = NaN();
+        m_last_order_px = NaN();
+        a_fun(ss);
+      }
+      break;
+    }
+    case StreamType::Quotes: {
+      QuoteSample<MaxDepth, PriceT> qs;
+      n = qs.Read(a_buf, a_sz, is_delta, m_last_quote_px);
+      if (n <= 0)
+        break;
+      m_last_usec += qs.Time();
+      m_last_ts.usec(m_last_usec);
+      a_fun(qs);
+      if (m_book_deltas) {
+        // This full snapshot is the base of the following book deltas
+        m_rd_book       = qs;
+        m_rd_book_valid = true;
+      }
+      break;
+    }
+    case StreamType::BookDelta: {
+      BookDeltaSample<MaxDepth, PriceT> bd;
+      n = bd.Read(a_buf, a_sz);
+      if (n <= 0)
+        break;
+      if (utxx::unlikely(!m_rd_book_valid))
+        UTXX_THROW_RUNTIME_ERROR
+          ("Book delta without a preceding full quote: ", m_filename);
+      m_last_usec += bd.Time();
+      m_last_ts.usec(m_last_usec);
+      // Reconstruct the full book and hand it to the visitor as a quote
+      bd.Apply(m_rd_book);
+      a_fun(m_rd_book);
+      break;
+    }
+    case StreamType::Trade: {
+      TradeSample ts;
+      n = ts.Read(a_buf, a_sz, is_delta, m_last_trade_px);
+      if (n <= 0)
+        break;
+      m_last_usec += ts.Time();
+      m_last_ts.usec(m_last_usec);
+      a_fun(ts);
+      break;
+    }
+    case StreamType::Order: {
+      OrderSample os;
+      n = os.Read(a_buf, a_sz, is_delta, m_last_order_px);
+      if (n <= 0)
+        break;
+      m_last_usec += os.Time();
+      m_last_ts.usec(m_last_usec);
+      a_fun(os);
+      break;
+    }
+    case StreamType::Summary: {
+      SummarySample ss;
+      n = ss.Read(a_buf, a_sz);
+      if (n <= 0)
+        break;
+      m_last_usec += ss.Time();
+      m_last_ts.usec(m_last_usec);
+      a_fun(ss);
+      break;
+    }
+    case StreamType::Message: {
+      MessageSample ms;
+      n = ms.Read(a_buf, a_sz);
+      if (n <= 0)
+        break;
+      m_last_usec += ms.Time();
+      m_last_ts.usec(m_last_usec);
+      a_fun(ms);
+      break;
+    }
+    default:
+      UTXX_THROW_RUNTIME_ERROR("Invalid stream type: ", int(stream_tp));
+  }
+
+  if (n > 0)
+    SDB_STAT({ auto& c = m_stats.m_rd[int(stream_tp)];
+               c.m_samples++; c.m_bytes += n; c.m_deltas += is_delta; });
+
+  return n;
+}
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+template <typename OnSample>
+void BaseSDBFileIO<MaxDepth>::
+Read(OnSample a_fun)
+{
+  SDB_STAT_TIMER(m_stats.m_rd_decode);
+
+  m_last_quote_px = NaN();
+  m_last_trade_px = NaN();
+  m_last_order_px = NaN();
+  m_rd_book_valid = false;
+
+  //----------------------------------------------------------------------------
+  // Compressed path: decompress and decode the data section block by block
+  //----------------------------------------------------------------------------
+  if (m_streams_meta.Compression() != StreamsMeta::CompressT::None) {
+    ReadCompressed(a_fun);
+    return;
+  }
+
+  //----------------------------------------------------------------------------
+  // Zero-copy path: decode directly out of the memory-mapped region
+  //----------------------------------------------------------------------------
+  if (m_mem) {
+    auto p   = m_mem + m_streams_meta.DataOffset();
+    // In v2 files the seek table follows the data section - don't decode it
+    auto end = m_mem + (DataEnd() ? size_t(DataEnd()) : m_mem_size);
+
+    if (p + 4 > end)
+      UTXX_THROW_RUNTIME_ERROR
+        ("Can't read beginning of data marker ", m_filename);
+
+    auto q = p;
+    if (uint(utxx::get32le(q)) != BEGIN_STREAM_DATA())
+      UTXX_THROW_RUNTIME_ERROR
+        ("Invalid beginning of data marker: ", m_filename);
+    p = q;
+
+    while (p < end) {
+      long n = ReadSample(p, end - p, a_fun);
+      if  (n <= 0)      // Truncated tail sample
+        break;
+      p += n;
+    }
+    return;
+  }
+
+  //----------------------------------------------------------------------------
+  // Buffered stdio path
+  //----------------------------------------------------------------------------
+  if (fseek(m_file, m_streams_meta.DataOffset(), SEEK_SET) < 0)
+    UTXX_THROW_IO_ERROR
+      (errno, "Can't find file data offset ", m_streams_meta.DataOffset(), ": ",
+       m_filename);
+
+  // Read the beginning of data marker
+  {
+    char buf[4];
+    if (fread(buf, 1, sizeof(buf), m_file) != sizeof(buf))
+      UTXX_THROW_IO_ERROR
+        (errno, "Can't read beginning of data marker ", m_filename);
+
+    if (uint(utxx::cast32le(buf)) != BEGIN_STREAM_DATA())
+      UTXX_THROW_RUNTIME_ERROR
+        ("Invalid beginning of data marker: ", m_filename);
+  }
+
+  //----------------------------------------------------------------------------
+  // Pipelined path: a prefetch thread reads ahead of the decoder
+  //----------------------------------------------------------------------------
+  if (m_read_mode == ReadMode::Prefetch) {
+    ReadPrefetch(a_fun);
+    return;
   }
 
-  QuoteSampleT qt(delta, ts, std::move(book), a_bid_cnt, a_ask_cnt);
+  // In v2 files the seek table follows the data section - don't decode it
+  long left = DataEnd() ? DataEnd() - ftell(m_file)
+                        : std::numeric_limits<long>::max();
+
+  utxx::dynamic_io_buffer buf(4096);
+
+  while (left > 0) {
+    long n = fread(buf.wr_ptr(), 1,
+                   std::min(long(buf.capacity()), left), m_file);
+
+    if  (n == 0)
+      break;
+
+    left -= n;
+    buf.commit(n);
+
+    while (n > 0) {
+      n = ReadSample(buf.rd_ptr(), buf.size(), a_fun);
+
+      if (n == 0) break;
+      if (n <  0)
+        UTXX_THROW_IO_ERROR(errno, "Error reading from file ", m_filename);
 
-  if (qt.Write(m_file) < 0)
-    UTXX_THROW_IO_ERROR
-      (errno, "Error writing a quote to file ", m_filename);
+      buf.read(n);
+    }
+
+    buf.crunch();
+  }
 }
 
+//------------------------------------------------------------------------------
+// Pipelined read: a prefetch thread fills large buffers ahead of the decoder
+// through a SPSC ring (the async writer's pattern, in the opposite
+// direction), so blocking file reads overlap with decode work
 //------------------------------------------------------------------------------
 template <uint MaxDepth>
-template <PriceUnit PU, typename PxT>
+template <typename OnSample>
 void BaseSDBFileIO<MaxDepth>::
-WriteTrade
-(
-  time_val  a_ts,
-  SideT     a_side,
-  PxT       a_px,
-  uint      a_qty,
-  AggrT     a_aggr,
-  size_t    a_ord_id,
-  size_t    a_trade_id
-)
+ReadPrefetch(OnSample& a_fun)
 {
-  if (utxx::unlikely(a_ts < m_last_ts))
-    UTXX_THROW_RUNTIME_ERROR
-      ("Attempt to write an out-of-order timestamp ",
-       utxx::timestamp::to_string(a_ts, utxx::TIME_WITH_USEC),
-       "to file ", m_filename);
+  struct PrefetchBuf {
+    std::vector<char> data;
+    size_t            size = 0;
+  };
+
+  std::array<PrefetchBuf, PREFETCH_NBUFS()> bufs;
+  for (auto& b : bufs)
+    b.data.resize(PREFETCH_BUF_SIZE());
+
+  // In v2 files the seek table follows the data section - don't read it
+  long left = DataEnd() ? DataEnd() - ftell(m_file)
+                        : std::numeric_limits<long>::max();
+
+  std::atomic<size_t> head{0};        ///< Next slot filled  by the prefetcher
+  std::atomic<size_t> tail{0};        ///< Next slot decoded by this thread
+  std::atomic<bool>   done{false};    ///< Prefetcher hit EOF or an error
+  std::atomic<bool>   stop{false};    ///< Decoder terminated early
+  std::exception_ptr  err;
+  std::mutex              mtx;        // Used only to sleep/wake the threads
+  std::condition_variable cv;
+
+  std::thread prefetcher([&]() {
+    try {
+      while (!stop.load(std::memory_order_relaxed)) {
+        auto h = head.load(std::memory_order_relaxed);
+
+        if (h - tail.load(std::memory_order_acquire) == PREFETCH_NBUFS()) {
+          // All buffers are owned by the decoder - wait for a free one
+          std::unique_lock<std::mutex> lock(mtx);
+          cv.wait(lock, [&]() {
+            return stop.load(std::memory_order_relaxed)
+                || h - tail.load(std::memory_order_acquire)
+                 < PREFETCH_NBUFS();
+          });
+          continue;
+        }
 
-  // If the seconds advanced, write the new second since midnight (StreamID=0)
-  int  prev_usec  = m_last_usec;
-  bool sec_chng   = WriteSeconds(a_ts);
-  auto ts         = sec_chng ? m_last_usec : (m_last_usec - prev_usec);
+        auto& b    = bufs[h & (PREFETCH_NBUFS()-1)];
+        auto  want = std::min(long(b.data.size()), left);
+        auto  n    = want > 0 ? fread(&b.data[0], 1, want, m_file) : size_t(0);
+        if  (n == 0)
+          break;
 
-  // When seconds changed, this is a Full quote; otherwise: Delta
-  bool delta      = m_last_trade_px != NaN();
-  auto px         = NormalizePx<PU>(a_px);
-  auto px_inc     = delta ? (px - m_last_trade_px) : px;
+        left  -= n;
+        b.size = n;
 
-  m_last_trade_px = px;
+        {
+          std::unique_lock<std::mutex> lock(mtx);
+          head.store(h + 1, std::memory_order_release);
+        }
+        cv.notify_all();
+      }
+    }
+    catch (...) { err = std::current_exception(); }
 
-  TradeSample tr(delta, ts, a_side, px_inc, a_qty, a_aggr, a_ord_id, a_trade_id);
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      done.store(true, std::memory_order_release);
+    }
+    cv.notify_all();
+  });
+
+  // Make sure the prefetcher is stopped and joined even when the visitor
+  // or the decoder throws
+  auto on_exit = [&]() {
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      stop.store(true, std::memory_order_relaxed);
+    }
+    cv.notify_all();
+    prefetcher.join();
+  };
+  utxx::scope_exit se(on_exit);
 
-  int sz = tr.Write(m_file);
+  std::vector<char> carry;            // Sample straddling a buffer boundary
+  size_t t = 0;
 
-  // Update candles using this trade
-  int qty = a_side == SideT::Buy ? int(a_qty) : -int(a_qty);
-  m_candles_meta.UpdateCandles(m_last_sec, px, qty);
+  while (true) {
+    if (head.load(std::memory_order_acquire) == t) {
+      // Wait for the next filled buffer (or EOF)
+      std::unique_lock<std::mutex> lock(mtx);
+      cv.wait(lock, [&]() {
+        return head.load(std::memory_order_acquire) != t
+            || done.load(std::memory_order_acquire);
+      });
+      if (head.load(std::memory_order_acquire) == t)
+        break;
+    }
 
-  if (sz < 0)
-    UTXX_THROW_IO_ERROR
-      (errno, "Error writing a trade ", tr.ToString(), " to file ", m_filename);
+    auto& b   = bufs[t & (PREFETCH_NBUFS()-1)];
+    auto  p   = (const char*)&b.data[0];
+    auto  end = p + b.size;
+
+    // Finish the sample left truncated at the previous buffer boundary by
+    // stitching it with the head of this buffer in a small side buffer
+    while (!carry.empty() && p < end) {
+      auto base = carry.size();
+      auto add  = std::min(PREFETCH_STITCH(), size_t(end - p));
+      carry.insert(carry.end(), p, p + add);
+
+      size_t consumed = 0;
+      while (consumed < base) {
+        long n = ReadSample(&carry[consumed], carry.size() - consumed, a_fun);
+        if  (n <= 0)
+          break;
+        consumed += n;
+      }
+
+      if (consumed >= base) {
+        // The straddling sample(s) are done - the rest of the stitched
+        // bytes are decoded in place inside the current buffer
+        p += consumed - base;
+        carry.clear();
+      } else {
+        // Still truncated: keep the undecoded part and stitch more
+        carry.erase(carry.begin(), carry.begin() + consumed);
+        p += add;
+      }
+    }
+
+    while (p < end) {
+      long n = ReadSample(p, end - p, a_fun);
+      if  (n <= 0)
+        break;
+      p += n;
+    }
+
+    if (p < end)
+      carry.assign(p, end);           // Truncated tail sample
+
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      tail.store(++t, std::memory_order_release);
+    }
+    cv.notify_all();
+  }
+
+  if (err)
+    std::rethrow_exception(err);
 }
 
+//------------------------------------------------------------------------------
+// Read a compressed stream data section block by block
 //------------------------------------------------------------------------------
 template <uint MaxDepth>
+template <typename OnSample>
 void BaseSDBFileIO<MaxDepth>::
-UpdateCandles(int a_ts, PriceT a_px, int a_qty)
+ReadCompressed(OnSample& a_fun, size_t a_first_blk, const bool* a_stop)
 {
-  m_candles_meta.UpdateCandles(a_ts, a_px, a_qty);
+  std::vector<char> raw(StreamsMeta::COMP_BLOCK_SIZE());
+
+  auto& blocks = m_streams_meta.Blocks();
+
+  for (auto i = a_first_blk; i < blocks.size(); ++i) {
+    if (a_stop && *a_stop)
+      break;
+
+    auto rsz = DecompressBlock(i, raw);
+
+    auto p   = (const char*)&raw[0];
+    auto end = p + rsz;
+
+    while (p < end && !(a_stop && *a_stop)) {
+      long k = ReadSample(p, end - p, a_fun);
+      if  (k <= 0)
+        break;
+      p += k;
+    }
+  }
 }
 
+//------------------------------------------------------------------------------
+// Decode the samples of a single data block (see the seek table)
 //------------------------------------------------------------------------------
 template <uint MaxDepth>
+template <typename OnSample>
 void BaseSDBFileIO<MaxDepth>::
-AddCandleVolumes(int a_ts, int a_buy_qty, int a_sell_qty)
+ReadBlock(size_t a_blk, OnSample a_fun)
 {
-  m_candles_meta.AddCandleVolumes(a_ts, a_buy_qty, a_sell_qty);
+  auto& blocks = m_streams_meta.Blocks();
+
+  if (a_blk >= blocks.size())
+    UTXX_THROW_RUNTIME_ERROR
+      ("Invalid block index ", a_blk, " (have ", blocks.size(),
+       " blocks) in file ", m_filename);
+
+  // Every block starts with an absolute SecondsSample and full prices, so
+  // no decoder state from the preceding blocks is needed
+  m_last_quote_px = NaN();
+  m_last_trade_px = NaN();
+  m_last_order_px = NaN();
+  m_rd_book_valid = false;
+
+  //----------------------------------------------------------------------------
+  // Compressed block: decode out of the decompression buffer
+  //----------------------------------------------------------------------------
+  if (m_streams_meta.Compression() != StreamsMeta::CompressT::None) {
+    std::vector<char> raw(StreamsMeta::COMP_BLOCK_SIZE());
+    auto rsz = DecompressBlock(a_blk, raw);
+
+    auto p   = (const char*)&raw[0];
+    auto end = p + rsz;
+
+    while (p < end) {
+      long k = ReadSample(p, end - p, a_fun);
+      if  (k <= 0)
+        break;
+      p += k;
+    }
+    return;
+  }
+
+  //----------------------------------------------------------------------------
+  // Uncompressed v2 block: the extent runs up to the next block (the last
+  // one ends where the seek table begins)
+  //----------------------------------------------------------------------------
+  auto& blk = blocks[a_blk];
+  long  off = long(blk.m_file_offset);
+  long  end = a_blk+1 < blocks.size() ? long(blocks[a_blk+1].m_file_offset)
+                                      : DataEnd();
+  if (end <= off)
+    UTXX_THROW_RUNTIME_ERROR
+      ("Invalid block extent [", off, ", ", end, ") in file ", m_filename);
+
+  if (m_mem) {
+    auto p = m_mem + off, e = m_mem + end;
+    while (p < e) {
+      long k = ReadSample(p, e - p, a_fun);
+      if  (k <= 0)
+        break;
+      p += k;
+    }
+    return;
+  }
+
+  if (fseek(m_file, off, SEEK_SET) < 0)
+    UTXX_THROW_IO_ERROR
+      (errno, "Can't seek to data block at ", off, ": ", m_filename);
+
+  std::vector<char> buf(end - off);
+  if (fread(&buf[0], 1, buf.size(), m_file) != buf.size())
+    UTXX_THROW_IO_ERROR(errno, "Can't read block data: ", m_filename);
+
+  auto p = (const char*)&buf[0];
+  auto e = p + buf.size();
+  while (p < e) {
+    long k = ReadSample(p, e - p, a_fun);
+    if  (k <= 0)
+      break;
+    p += k;
+  }
 }
 
+//------------------------------------------------------------------------------
+// Decompress one data block of a compressed file
 //------------------------------------------------------------------------------
 template <uint MaxDepth>
-void BaseSDBFileIO<MaxDepth>::
-PrintCandles(std::ostream& out, int a_resolution) const
+size_t BaseSDBFileIO<MaxDepth>::
+DecompressBlock(size_t a_blk, std::vector<char>& a_raw)
 {
-  if (m_debug)
-    out << "  Candle Resolutions: " << m_candles_meta.Headers().size()
-        << std::endl;
+#ifdef SDB_HAVE_ZSTD
+  if (m_streams_meta.Compression() != StreamsMeta::CompressT::Zstd)
+    UTXX_THROW_RUNTIME_ERROR
+      ("Unsupported compression type ", int(m_streams_meta.Compression()),
+       " in file ", m_filename);
+
+  auto&       blk = m_streams_meta.Blocks()[a_blk];
+  uint32_t    csz, rsz;
+  const char* src;
+
+  if (m_mem) {
+    auto p = m_mem + blk.m_file_offset;
+    csz    = utxx::get32le(p);
+    rsz    = utxx::get32le(p);
+    utxx::get32le(p);              // FirstSec (used for seeking only)
+    src    = p;
+  } else {
+    if (fseek(m_file, blk.m_file_offset, SEEK_SET) < 0)
+      UTXX_THROW_IO_ERROR
+        (errno, "Can't seek to data block at ", blk.m_file_offset, ": ",
+         m_filename);
+    char hdr[12];
+    if (fread(hdr, 1, sizeof(hdr), m_file) != sizeof(hdr))
+      UTXX_THROW_IO_ERROR(errno, "Can't read block header: ", m_filename);
+    auto p = (const char*)hdr;
+    csz    = utxx::get32le(p);
+    rsz    = utxx::get32le(p);
+    if (m_comp_buf.size() < csz)
+      m_comp_buf.resize(csz);
+    if (fread(&m_comp_buf[0], 1, csz, m_file) != csz)
+      UTXX_THROW_IO_ERROR(errno, "Can't read block data: ", m_filename);
+    src    = &m_comp_buf[0];
+  }
 
-  bool found = a_resolution == -1;
-  uint idx   = 0;
-  for (auto& ch : m_candles_meta.Headers()) {
-    // If requested specific candle resolution - skip the rest
-    if (a_resolution != -1 && a_resolution != ch.Resolution())
-      continue;
+  if (a_raw.size() < rsz)
+    a_raw.resize(rsz);
 
-    auto n = ch.Candles().size();
-    int  s = ch.StartTime() + TZOffset();
-    int  e = s + ch.Resolution()*n;
-    char buf[80];
-    sprintf(buf, "# Resolution: %ds %02d:%02d - %02d:%02d %s (UTC: %ld)\n",
-            ch.Resolution(),
-            s / 3600, s % 3600 / 60,
-            e / 3600, e % 3600 / 60,
-            TZ().c_str(), Date() + ch.StartTime());
-    out << buf <<
-      "#Time    Open   High   Low    Close     BuyVol   SellVol DataOffset\n";
+  auto n = ZSTD_decompress(&a_raw[0], a_raw.size(), src, csz);
+  if (ZSTD_isError(n) || n != rsz)
+    UTXX_THROW_RUNTIME_ERROR
+      ("Error decompressing block of file ", m_filename, ": ",
+       ZSTD_isError(n) ? ZSTD_getErrorName(n) : "short block");
+
+  return rsz;
+#else
+  UTXX_THROW_RUNTIME_ERROR
+    ("Cannot read compressed file ", m_filename,
+     ": SDB was compiled without zstd support");
+#endif
+}
 
-    for (auto& c : ch.Candles()) {
-      int  ts = ch.CandleToTime(idx++) + TZOffset();
-      uint h  = ts / 3600, m = ts % 3600 / 60, s = ts % 60;
-      //if (c.DataOffset() == 0)
-      //  continue;
-      sprintf(buf, "%02d:%02d:%02d ", h,m,s);
-      out << buf
-          << std::setprecision(Header().PxPrecision())     << std::fixed
-          << NormalPxToDouble(c.Open())    << ' '
-          << NormalPxToDouble(c.High())    << ' '
-          << NormalPxToDouble(c.Low())     << ' '
-          << NormalPxToDouble(c.Close())   << ' '
-          << std::setw(9)   << c.BVolume() << ' '
-          << std::setw(9)   << c.SVolume();
-      if (m_debug)
-        out << " [" << c.DataOffset() << "]\n";
-      else
-        out << std::endl;
+//------------------------------------------------------------------------------
+// Decode one sample for Query(), extracting only the fields the kernel needs
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+template <typename Kernel>
+long BaseSDBFileIO<MaxDepth>::
+QuerySample(const char* a_buf, size_t a_sz, Kernel& a_kernel,
+            QueryBook<MaxDepth>& a_bk)
+{
+  if (a_sz < 2)
+    return 0;
+
+  auto x        = *(uint8_t*)a_buf;
+  auto base     = (StreamBase*)&x;
+  bool is_delta = base->Delta();
+
+  switch (base->Type()) {
+    case StreamType::Seconds: {
+      SecondsSample ss;
+      long n = ss.Read(a_buf, a_sz);
+      if (n > 0) {
+        a_bk.m_sec           = ss.Time();
+        a_bk.m_last_quote_px = NaN();
+        a_bk.m_last_trade_px = NaN();
+        a_bk.m_last_order_px = NaN();
+      }
+      return n;
     }
+    case StreamType::Quotes: {
+      // Decode the levels straight into the kernel's flat book - no
+      // QuoteSample is constructed
+      auto begin = a_buf;
+      auto end   = a_buf + a_sz;
+
+      a_buf++;
+      uleb128_decode(a_buf);            // Time within second (sub-bucket)
+
+      if (a_buf >= end)
+        return 0;                       // Not enough data
+
+      int bc = *a_buf & 0x0F;
+      int ac = (*a_buf++ >> 4) & 0x0F;
+      int n  = bc + ac;
+
+      if (bc > int(MaxDepth) || ac > int(MaxDepth))
+        UTXX_THROW_RUNTIME_ERROR("Too many price levels: ", bc, ' ', ac);
+
+      if (utxx::unlikely(n == 0))
+        return a_buf - begin;
+
+      int64_t vals[MaxDepth*4];
+      a_buf = decode_sleb128_batch(a_buf, end, vals, 2*n);
+      if (!a_buf)
+        return 0;                       // Need more data
+
+      auto v    = vals;
+      auto last = PriceT(*v++);
+      if (is_delta)
+        last += a_bk.m_last_quote_px;
+      a_bk.m_px [0]        = last;
+      a_bk.m_qty[0]        = int(*v++);
+      a_bk.m_last_quote_px = last;      // First px anchors the delta chain
+
+      for (int i = 1; i < n; ++i) {
+        last         += PriceT(*v++);
+        a_bk.m_px [i] = last;
+        a_bk.m_qty[i] = int(*v++);
+      }
 
-    found = true;
-  }
+      a_bk.m_bid_cnt = bc;
+      a_bk.m_ask_cnt = ac;
+      a_bk.m_valid   = true;
+      a_kernel.OnQuote(a_bk);
+      return a_buf - begin;
+    }
+    case StreamType::BookDelta: {
+      BookDeltaSample<MaxDepth, PriceT> bd;
+      long n = bd.Read(a_buf, a_sz);
+      if (n <= 0)
+        return n;
+      if (utxx::unlikely(!a_bk.m_valid))
+        UTXX_THROW_RUNTIME_ERROR
+          ("Book delta without a preceding full quote: ", m_filename);
 
-  if (!found)
-    UTXX_THROW_RUNTIME_ERROR
-      ("Requested candle resolution ", a_resolution, "not found in ", m_filename);
+      // Apply the ops in place on the flat book (see BookDeltaSample::Apply)
+      int    obc = a_bk.m_bid_cnt, oac = a_bk.m_ask_cnt;
+      int    nbc = bd.BidCount(),  nac = bd.AskCount();
+      PriceT npx [MaxDepth*2] = {};
+      int    nqty[MaxDepth*2] = {};
+
+      for (int i = 0, e = std::min(nbc, obc); i < e; ++i) {
+        npx [i] = a_bk.m_px [i];
+        nqty[i] = a_bk.m_qty[i];
+      }
+      for (int i = 0, e = std::min(nac, oac); i < e; ++i) {
+        npx [nbc + i] = a_bk.m_px [obc + i];
+        nqty[nbc + i] = a_bk.m_qty[obc + i];
+      }
+      auto ops = bd.Ops();
+      for (int i = 0; i < bd.BidOps(); ++i) {
+        auto& op = ops[i];
+        npx [op.m_idx] = op.m_px + (op.m_idx < obc ? a_bk.m_px[op.m_idx]
+                                                   : PriceT());
+        nqty[op.m_idx] = op.m_qty;
+      }
+      for (int i = bd.BidOps(), e = bd.BidOps() + bd.AskOps(); i < e; ++i) {
+        auto& op = ops[i];
+        npx [nbc + op.m_idx] = op.m_px + (op.m_idx < oac
+                                          ? a_bk.m_px[obc + op.m_idx]
+                                          : PriceT());
+        nqty[nbc + op.m_idx] = op.m_qty;
+      }
+
+      std::copy(npx,  npx  + nbc + nac, a_bk.m_px);
+      std::copy(nqty, nqty + nbc + nac, a_bk.m_qty);
+      a_bk.m_bid_cnt = nbc;
+      a_bk.m_ask_cnt = nac;
+      a_kernel.OnQuote(a_bk);
+      return n;
+    }
+    case StreamType::Trade: {
+      TradeSample ts;
+      long n = ts.Read(a_buf, a_sz, is_delta, a_bk.m_last_trade_px);
+      if (n > 0)
+        a_kernel.OnTrade(a_bk.m_sec, ts.Price(), ts.Qty(), ts.Side());
+      return n;
+    }
+    // Streams no kernel consumes are decoded only to find their length
+    case StreamType::Order: {
+      OrderSample os;
+      return os.Read(a_buf, a_sz, is_delta, a_bk.m_last_order_px);
+    }
+    case StreamType::Summary: {
+      SummarySample ss;
+      return ss.Read(a_buf, a_sz);
+    }
+    case StreamType::Message: {
+      MessageSample ms;
+      return ms.Read(a_buf, a_sz);
+    }
+    default:
+      UTXX_THROW_RUNTIME_ERROR("Invalid stream type: ", int(base->Type()));
+  }
 }
 
+//------------------------------------------------------------------------------
+// Run an aggregate query kernel over all samples of the file
 //------------------------------------------------------------------------------
 template <uint MaxDepth>
-template <typename OnSample>
+template <typename Kernel>
 void BaseSDBFileIO<MaxDepth>::
-Read(OnSample a_fun)
+Query(Kernel& a_kernel)
 {
+  QueryBook<MaxDepth> bk;
+  bk.m_last_quote_px = NaN();
+  bk.m_last_trade_px = NaN();
+  bk.m_last_order_px = NaN();
+
+  //----------------------------------------------------------------------------
+  // Compressed path: decompress and reduce the data section block by block
+  //----------------------------------------------------------------------------
+  if (m_streams_meta.Compression() != StreamsMeta::CompressT::None) {
+    std::vector<char> raw(StreamsMeta::COMP_BLOCK_SIZE());
+
+    for (size_t i = 0, e = BlockCount(); i != e; ++i) {
+      auto rsz = DecompressBlock(i, raw);
+      auto p   = (const char*)&raw[0];
+      auto end = p + rsz;
+
+      while (p < end) {
+        long n = QuerySample(p, end - p, a_kernel, bk);
+        if  (n <= 0)
+          break;
+        p += n;
+      }
+    }
+    return;
+  }
+
+  //----------------------------------------------------------------------------
+  // Zero-copy path: reduce directly out of the memory-mapped region
+  //----------------------------------------------------------------------------
+  if (m_mem) {
+    auto p   = m_mem + m_streams_meta.DataOffset();
+    auto end = m_mem + (DataEnd() ? size_t(DataEnd()) : m_mem_size);
+
+    if (p + 4 > end)
+      UTXX_THROW_RUNTIME_ERROR
+        ("Can't read beginning of data marker ", m_filename);
+
+    auto q = p;
+    if (uint(utxx::get32le(q)) != BEGIN_STREAM_DATA())
+      UTXX_THROW_RUNTIME_ERROR
+        ("Invalid beginning of data marker: ", m_filename);
+    p = q;
+
+    while (p < end) {
+      long n = QuerySample(p, end - p, a_kernel, bk);
+      if  (n <= 0)
+        break;
+      p += n;
+    }
+    return;
+  }
+
+  //----------------------------------------------------------------------------
+  // Buffered stdio path
+  //----------------------------------------------------------------------------
   if (fseek(m_file, m_streams_meta.DataOffset(), SEEK_SET) < 0)
     UTXX_THROW_IO_ERROR
       (errno, "Can't find file data offset ", m_streams_meta.DataOffset(), ": ",
        m_filename);
 
-  // Read the beginning of data marker
   {
     char buf[4];
     if (fread(buf, 1, sizeof(buf), m_file) != sizeof(buf))
@@ -671,70 +2543,164 @@ Read(OnSample a_fun)
         ("Invalid beginning of data marker: ", m_filename);
   }
 
+  long left = DataEnd() ? DataEnd() - ftell(m_file)
+                        : std::numeric_limits<long>::max();
+
   utxx::dynamic_io_buffer buf(4096);
 
+  while (left > 0) {
+    long n = fread(buf.wr_ptr(), 1,
+                   std::min(long(buf.capacity()), left), m_file);
+
+    if  (n == 0)
+      break;
+
+    left -= n;
+    buf.commit(n);
+
+    while (n > 0) {
+      n = QuerySample(buf.rd_ptr(), buf.size(), a_kernel, bk);
+
+      if (n == 0) break;
+      if (n <  0)
+        UTXX_THROW_IO_ERROR(errno, "Error reading from file ", m_filename);
+
+      buf.read(n);
+    }
+
+    buf.crunch();
+  }
+}
+
+//------------------------------------------------------------------------------
+// Find the nearest indexed position preceding a_from
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+long BaseSDBFileIO<MaxDepth>::
+Seek(time_val a_from)
+{
+  // First sample is right past the beginning-of-data marker
+  long pos = long(m_streams_meta.DataOffset()) + 4;
+  int  sec = (a_from - Midnight()).sec();
+
+  // The candle array is directly indexed by time, so the lookup is a
+  // simple index computation in the finest-resolution header
+  CandleHeader const* best = nullptr;
+  for (auto& ch : m_candles_meta.Headers())
+    if (!best || ch.Resolution() < best->Resolution())
+      best = &ch;
+
+  if (!best || best->Candles().empty())
+    return pos;
+
+  int idx = (sec - int(best->StartTime())) / best->Resolution();
+  if (idx >= int(best->Candles().size()))
+    idx = int(best->Candles().size()) - 1;
+
+  // Walk back to the nearest candle that recorded a data offset.  The
+  // offset was taken just before a SecondsSample was written, so decoding
+  // can resynchronize there with no prior state.
+  for (; idx >= 0; --idx) {
+    auto off = best->Candles()[idx].DataOffset();
+    if (off && best->CandleToTime(idx) <= sec) {
+      pos = long(off);
+      break;
+    }
+  }
+
+  return pos;
+}
+
+//------------------------------------------------------------------------------
+// Read samples within the [a_from, a_to] time window
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+template <typename OnSample>
+void BaseSDBFileIO<MaxDepth>::
+Read(time_val a_from, time_val a_to, OnSample a_fun)
+{
   m_last_quote_px = NaN();
   m_last_trade_px = NaN();
+  m_last_order_px = NaN();
+  m_rd_book_valid = false;
+
+  bool synced = false;
+  bool done   = false;
+
+  // Resynchronize at the first SecondsSample, then filter by timestamp
+  auto filter = [&,this](auto& sample) {
+    using T = typename std::decay<decltype(sample)>::type;
+    if (std::is_same<T, SecondsSample>::value)
+      synced = true;
+    if (!synced)
+      return;
+    if (utxx::unlikely(m_last_ts > a_to)) {
+      done = true;
+      return;
+    }
+    if (m_last_ts >= a_from)
+      a_fun(sample);
+  };
+
+  //----------------------------------------------------------------------------
+  // Compressed: the seek table holds each block's first timestamp
+  //----------------------------------------------------------------------------
+  if (m_streams_meta.Compression() != StreamsMeta::CompressT::None) {
+    int    from_sec  = (a_from - Midnight()).sec();
+    size_t first_blk = 0;
+    auto&  blocks    = m_streams_meta.Blocks();
+
+    for (size_t i = 0; i < blocks.size(); ++i)
+      if (int(blocks[i].m_first_sec) <= from_sec)
+        first_blk = i;
+      else
+        break;
 
-  while (true) {
-    long n = fread(buf.wr_ptr(), 1, buf.capacity(), m_file);
+    ReadCompressed(filter, first_blk, &done);
+    return;
+  }
+
+  long pos = Seek(a_from);
+
+  //----------------------------------------------------------------------------
+  // Mmap'ed file
+  //----------------------------------------------------------------------------
+  if (m_mem) {
+    auto p   = m_mem + pos;
+    auto end = m_mem + (DataEnd() ? size_t(DataEnd()) : m_mem_size);
+
+    while (p < end && !done) {
+      long n = ReadSample(p, end - p, filter);
+      if  (n <= 0)
+        break;
+      p += n;
+    }
+    return;
+  }
+
+  //----------------------------------------------------------------------------
+  // Buffered stdio
+  //----------------------------------------------------------------------------
+  if (fseek(m_file, pos, SEEK_SET) < 0)
+    UTXX_THROW_IO_ERROR
+      (errno, "Can't seek to data offset ", pos, ": ", m_filename);
+
+  long left = DataEnd() ? DataEnd() - pos : std::numeric_limits<long>::max();
+
+  utxx::dynamic_io_buffer buf(4096);
+
+  while (!done && left > 0) {
+    long n = fread(buf.wr_ptr(), 1,
+                   std::min(long(buf.capacity()), left), m_file);
 
     if  (n == 0)
       break;
 
+    left -= n;
     buf.commit(n);
 
-    while (n > 0) {
-      if (buf.size() < 2)
-        break;
-      auto x         = *(uint8_t*)buf.rd_ptr();
-      auto base      = (StreamBase*)&x;
-      bool is_delta  = base->Delta();
-      auto stream_tp = base->Type();
-
-      switch (stream_tp) {
-        case StreamType::Seconds: {
-          SecondsSample ss;
-          n = ss.Read(buf.rd_ptr(), buf.size());
-          if (n > 0) {
-            time_t secs     = m_header.Midnight().sec() + ss.Time();
-            m_last_ts.set(secs);
-            m_last_sec      = ss.Time(); //secs;
-            m_last_usec     = 0;
-            m_next_second   = m_last_sec + 1;
-            m_last_quote_px = NaN();
-            m_last_trade_px = NaN();
-            a_fun(ss);
-          }
-          break;
-        }
-        case StreamType::Quotes: {
-          QuoteSample<MaxDepth, PriceT> qs;
-          n = qs.Read(buf.rd_ptr(), buf.size(), is_delta, m_last_quote_px);
-          if (n <= 0)
-            break;
-          m_last_usec += qs.Time();
-          m_last_ts.usec(m_last_usec);
-          a_fun(qs);
-          break;
-        }
-        case StreamType::Trade: {
-          TradeSample ts;
-          n = ts.Read(buf.rd_ptr(), buf.size(), is_delta, m_last_trade_px);
-          if (n <= 0)
-            break;
-          m_last_usec += ts.Time();
-          m_last_ts.usec(m_last_usec);
-          a_fun(ts);
-          break;
-        }
-        case StreamType::Order:
-        case StreamType::Summary:
-        case StreamType::Message:
-          UTXX_THROW_RUNTIME_ERROR("Not supported: ", int(stream_tp), " stream");
-        default:
-          UTXX_THROW_RUNTIME_ERROR("Invalid stream type: ", int(stream_tp));
-      }
+    while (n > 0 && !done) {
+      n = ReadSample(buf.rd_ptr(), buf.size(), filter);
 
       if (n == 0) break;
       if (n <  0)
@@ -0,0 +1,105 @@
+// vim:ts=2:sw=2:et
+//-----------------------------------------------------------------------------
+/// \file  sdb_leb128.hpp
+//------------------------------------------------------------------------------
+/// \brief Batch LEB128 codec for hot encode/decode paths
+///
+/// Price levels are stored as runs of signed LEB128 values.  On liquid
+/// instruments nearly all of them (price deltas of one step, small sizes)
+/// fit a single byte, so the batch decoder tests 16 continuation bits at a
+/// time with one SSE2 movemask and decodes 16 single-byte values per
+/// iteration, falling back to the scalar codec for longer values.
+///
+/// \see https://github.com/saleyn/sdb/wiki/Data-Format
+//------------------------------------------------------------------------------
+// Copyright (c) 2015 Omnibius, LLC
+// Author:  Serge Aleynikov <saleyn@gmail.com>
+// Created: 2015-10-15
+//------------------------------------------------------------------------------
+#pragma once
+
+#include <cstdint>
+#include <utxx/leb128.hpp>
+#include <utxx/compiler_hints.hpp>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace sdb {
+
+//------------------------------------------------------------------------------
+/// Decode \a a_n signed LEB128 values from \a a_buf into \a a_out.
+/// @return pointer past the last consumed byte, or NULL if the input would
+///         run past \a a_end (caller needs more data)
+//------------------------------------------------------------------------------
+inline const char* decode_sleb128_batch
+(
+  const char* a_buf,
+  const char* a_end,
+  int64_t*    a_out,
+  uint        a_n
+)
+{
+  uint i = 0;
+
+#if defined(__SSE2__)
+  // Fast path: 16 values at a time when none of the next 16 bytes has its
+  // continuation bit set (i.e. all are single-byte values)
+  while (a_n - i >= 16 && a_end - a_buf >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)a_buf);
+    if (_mm_movemask_epi8(v) != 0)
+      break;                            // Some value spans multiple bytes
+
+    // Sign-extend the 7-bit payload of each byte: (b ^ 0x40) - 0x40
+    __m128i k40 = _mm_set1_epi8(0x40);
+    __m128i r   = _mm_sub_epi8(_mm_xor_si128(v, k40), k40);
+
+    char tmp[16];
+    _mm_storeu_si128((__m128i*)tmp, r);
+    for (int j = 0; j < 16; ++j)
+      a_out[i+j] = (int8_t)tmp[j];
+
+    a_buf += 16;
+    i     += 16;
+  }
+#endif
+
+  for (; i < a_n; ++i) {
+    if (utxx::unlikely(a_buf >= a_end))
+      return nullptr;
+
+    uint8_t b = uint8_t(*a_buf);
+
+    if (utxx::likely(!(b & 0x80))) {    // Single-byte value
+      a_out[i] = int64_t((int8_t((b ^ 0x40)) - 0x40));
+      a_buf++;
+      continue;
+    }
+
+    a_out[i] = utxx::decode_sleb128(a_buf);
+
+    if (utxx::unlikely(a_buf > a_end))
+      return nullptr;
+  }
+
+  return a_buf;
+}
+
+//------------------------------------------------------------------------------
+/// Encode \a a_n signed LEB128 values from \a a_vals into \a a_buf.
+/// The caller must guarantee 10 bytes of output space per value.
+/// @return pointer past the last written byte
+//------------------------------------------------------------------------------
+inline char* encode_sleb128_batch(const int64_t* a_vals, uint a_n, char* a_buf)
+{
+  for (uint i = 0; i < a_n; ++i) {
+    auto v = a_vals[i];
+    if (utxx::likely(v >= -64 && v < 64))   // Single-byte fast path
+      *a_buf++ = char(v & 0x7F);
+    else
+      a_buf += utxx::encode_sleb128(v, a_buf);
+  }
+  return a_buf;
+}
+
+} // namespace sdb
@@ -0,0 +1,260 @@
+// vim:ts=2:sw=2:et
+//-----------------------------------------------------------------------------
+/// \file  sdb_query.hpp
+//------------------------------------------------------------------------------
+/// \brief Aggregate query kernels over SDB files
+///
+/// Computing an aggregate (VWAP, OHLC, book imbalance) through Read() pays
+/// for fully materialized samples - a QuoteSample is a 250+ byte struct at
+/// depth 10 - even though the aggregate reduces each record to a couple of
+/// numbers.  BaseSDBFileIO::Query() instead decodes only the fields a kernel
+/// needs straight out of the byte stream (see QuerySample()) and hands them
+/// to one of the kernels below, which accumulate into flat per-bucket arrays
+/// laid out one aggregate per vector (SIMD-friendly for the reduction that
+/// typically follows).
+///
+/// A kernel is any type with
+///   void OnQuote(QueryBook<MaxDepth> const& a_book);
+///   void OnTrade(int a_sec, PriceT a_px, int a_qty, SideT a_side);
+/// (either may be a no-op).  Prices are in integer price steps; multiply by
+/// Header::PxStep() to convert.
+//------------------------------------------------------------------------------
+// Copyright (c) 2015 Omnibius, LLC
+// Author:  Serge Aleynikov <saleyn@gmail.com>
+// Created: 2015-10-15
+//------------------------------------------------------------------------------
+#pragma once
+
+#include <sdb/sdb_fmt.hpp>
+#include <utxx/compiler_hints.hpp>
+#include <vector>
+#include <limits>
+#include <cassert>
+
+namespace sdb {
+
+//------------------------------------------------------------------------------
+/// Flat order book scratch state maintained by BaseSDBFileIO::Query().
+/// Levels are stored like in QuoteSample: bids ascending by price, then asks
+/// ascending, so the best bid is level BidCount()-1 and the best ask is
+/// level BidCount()
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+struct QueryBook {
+  int    m_sec     = 0;       ///< Seconds since midnight of the current second
+  int    m_bid_cnt = 0;
+  int    m_ask_cnt = 0;
+  PriceT m_px [MaxDepth*2];
+  int    m_qty[MaxDepth*2];
+  bool   m_valid   = false;   ///< A full quote has been decoded
+
+  PriceT BestBidPx () const { return m_px [m_bid_cnt-1]; }
+  int    BestBidQty() const { return m_qty[m_bid_cnt-1]; }
+  PriceT BestAskPx () const { return m_px [m_bid_cnt];   }
+  int    BestAskQty() const { return m_qty[m_bid_cnt];   }
+
+  /// Decoder price chains (internal to Query())
+  PriceT m_last_quote_px = 0;
+  PriceT m_last_trade_px = 0;
+  PriceT m_last_order_px = 0;
+};
+
+//------------------------------------------------------------------------------
+/// Uniform time bucketing of seconds-since-midnight used by all kernels
+//------------------------------------------------------------------------------
+struct TimeGrid {
+  /// Buckets of \a a_resolution seconds covering [a_start, a_end)
+  TimeGrid(int a_start, int a_end, int a_resolution)
+    : m_start     (a_start)
+    , m_resolution(a_resolution)
+    , m_count     ((a_end - a_start + a_resolution - 1) / a_resolution)
+  {
+    assert(a_resolution > 0 && a_end > a_start);
+  }
+
+  /// @return bucket index of \a a_sec or -1 when outside the grid
+  int Bucket(int a_sec) const {
+    int n = (a_sec - m_start) / m_resolution;
+    return (a_sec >= m_start && n < m_count) ? n : -1;
+  }
+
+  int    Start     ()         const { return m_start;      }
+  int    Resolution()         const { return m_resolution; }
+  size_t Count     ()         const { return m_count;      }
+  /// Start time (seconds since midnight) of bucket \a a_idx
+  int    BucketTime(size_t a_idx) const
+    { return m_start + m_resolution * int(a_idx); }
+
+private:
+  int m_start;
+  int m_resolution;
+  int m_count;
+};
+
+//------------------------------------------------------------------------------
+/// Volume-weighted average trade price per bucket
+//------------------------------------------------------------------------------
+struct VWAPKernel {
+  explicit VWAPKernel(TimeGrid a_grid)
+    : m_grid (a_grid)
+    , m_pxqty(a_grid.Count(), 0.0)
+    , m_qty  (a_grid.Count(), 0)
+  {}
+
+  template <typename BookT>
+  void OnQuote(BookT const&) {}
+
+  void OnTrade(int a_sec, PriceT a_px, int a_qty, SideT) {
+    int b = m_grid.Bucket(a_sec);
+    if (utxx::unlikely(b < 0))
+      return;
+    m_pxqty[b] += double(a_px) * a_qty;
+    m_qty  [b] += a_qty;
+  }
+
+  TimeGrid const& Grid()         const { return m_grid;   }
+  long            Volume(size_t i) const { return m_qty[i]; }
+  /// VWAP of bucket \a i in price steps (0 when the bucket saw no trades)
+  double          VWAP  (size_t i) const
+    { return m_qty[i] ? m_pxqty[i] / double(m_qty[i]) : 0.0; }
+
+private:
+  TimeGrid            m_grid;
+  std::vector<double> m_pxqty;
+  std::vector<long>   m_qty;
+};
+
+//------------------------------------------------------------------------------
+/// Open/High/Low/Close trade prices per bucket
+//------------------------------------------------------------------------------
+struct OHLCKernel {
+  explicit OHLCKernel(TimeGrid a_grid)
+    : m_grid (a_grid)
+    , m_open (a_grid.Count(), 0)
+    , m_high (a_grid.Count(), std::numeric_limits<PriceT>::lowest())
+    , m_low  (a_grid.Count(), std::numeric_limits<PriceT>::max())
+    , m_close(a_grid.Count(), 0)
+    , m_count(a_grid.Count(), 0)
+  {}
+
+  template <typename BookT>
+  void OnQuote(BookT const&) {}
+
+  void OnTrade(int a_sec, PriceT a_px, int, SideT) {
+    int b = m_grid.Bucket(a_sec);
+    if (utxx::unlikely(b < 0))
+      return;
+    if (!m_count[b])        m_open[b] = a_px;
+    if (a_px > m_high[b])   m_high[b] = a_px;
+    if (a_px < m_low [b])   m_low [b] = a_px;
+    m_close[b] = a_px;
+    m_count[b]++;
+  }
+
+  TimeGrid const& Grid()          const { return m_grid;     }
+  int             Count(size_t i) const { return m_count[i]; }
+  PriceT          Open (size_t i) const { return m_open [i]; }
+  PriceT          High (size_t i) const { return m_high [i]; }
+  PriceT          Low  (size_t i) const { return m_low  [i]; }
+  PriceT          Close(size_t i) const { return m_close[i]; }
+
+private:
+  TimeGrid            m_grid;
+  std::vector<PriceT> m_open;
+  std::vector<PriceT> m_high;
+  std::vector<PriceT> m_low;
+  std::vector<PriceT> m_close;
+  std::vector<int>    m_count;
+};
+
+//------------------------------------------------------------------------------
+/// Last observed top-of-book per bucket (price/size of best bid and ask)
+//------------------------------------------------------------------------------
+struct TopBookKernel {
+  explicit TopBookKernel(TimeGrid a_grid)
+    : m_grid   (a_grid)
+    , m_bid_px (a_grid.Count(), 0)
+    , m_bid_qty(a_grid.Count(), 0)
+    , m_ask_px (a_grid.Count(), 0)
+    , m_ask_qty(a_grid.Count(), 0)
+    , m_count  (a_grid.Count(), 0)
+  {}
+
+  template <typename BookT>
+  void OnQuote(BookT const& a_bk) {
+    int b = m_grid.Bucket(a_bk.m_sec);
+    if (utxx::unlikely(b < 0))
+      return;
+    if (a_bk.m_bid_cnt) {
+      m_bid_px [b] = a_bk.BestBidPx();
+      m_bid_qty[b] = a_bk.BestBidQty();
+    }
+    if (a_bk.m_ask_cnt) {
+      m_ask_px [b] = a_bk.BestAskPx();
+      m_ask_qty[b] = a_bk.BestAskQty();
+    }
+    m_count[b]++;
+  }
+
+  void OnTrade(int, PriceT, int, SideT) {}
+
+  TimeGrid const& Grid()           const { return m_grid;      }
+  int             Count (size_t i) const { return m_count [i]; }
+  PriceT          BidPx (size_t i) const { return m_bid_px[i]; }
+  int             BidQty(size_t i) const { return m_bid_qty[i];}
+  PriceT          AskPx (size_t i) const { return m_ask_px[i]; }
+  int             AskQty(size_t i) const { return m_ask_qty[i];}
+
+private:
+  TimeGrid            m_grid;
+  std::vector<PriceT> m_bid_px;
+  std::vector<int>    m_bid_qty;
+  std::vector<PriceT> m_ask_px;
+  std::vector<int>    m_ask_qty;
+  std::vector<int>    m_count;
+};
+
+//------------------------------------------------------------------------------
+/// Depth-weighted book imbalance per bucket, averaged over the updates in
+/// the bucket.  Each update contributes (B - A) / (B + A), where B and A
+/// are the bid/ask sizes weighted 1/(k+1) by distance k from the top
+//------------------------------------------------------------------------------
+struct ImbalanceKernel {
+  explicit ImbalanceKernel(TimeGrid a_grid)
+    : m_grid (a_grid)
+    , m_sum  (a_grid.Count(), 0.0)
+    , m_count(a_grid.Count(), 0)
+  {}
+
+  template <typename BookT>
+  void OnQuote(BookT const& a_bk) {
+    int b = m_grid.Bucket(a_bk.m_sec);
+    if (utxx::unlikely(b < 0))
+      return;
+    double bid = 0, ask = 0;
+    for (int k = 0; k < a_bk.m_bid_cnt; ++k)   // Best bid first
+      bid += double(a_bk.m_qty[a_bk.m_bid_cnt-1 - k]) / (k + 1);
+    for (int k = 0; k < a_bk.m_ask_cnt; ++k)   // Best ask first
+      ask += double(a_bk.m_qty[a_bk.m_bid_cnt   + k]) / (k + 1);
+    auto tot = bid + ask;
+    if (tot > 0) {
+      m_sum[b] += (bid - ask) / tot;
+      m_count[b]++;
+    }
+  }
+
+  void OnTrade(int, PriceT, int, SideT) {}
+
+  TimeGrid const& Grid()          const { return m_grid;     }
+  int             Count(size_t i) const { return m_count[i]; }
+  /// Mean imbalance of bucket \a i in [-1, 1] (0 when no updates)
+  double          Imbalance(size_t i) const
+    { return m_count[i] ? m_sum[i] / m_count[i] : 0.0; }
+
+private:
+  TimeGrid            m_grid;
+  std::vector<double> m_sum;
+  std::vector<int>    m_count;
+};
+
+} // namespace sdb
@@ -0,0 +1,282 @@
+// vim:ts=2:sw=2:et
+//-----------------------------------------------------------------------------
+/// \file  sdb_shmem_ring.hpp
+//------------------------------------------------------------------------------
+/// \brief Shared-memory ring buffer teeing encoded samples to live consumers
+///
+/// A capture process writing an SDB file can attach a ShmemRing to the file
+/// (BaseSDBFileIO::Publish()), after which every encoded sample committed to
+/// the write buffer is also published into a named POSIX shared-memory ring.
+/// Same-host consumers attach to the ring and decode records with the
+/// existing QuoteSample::Read() / TradeSample::Read() routines, giving them
+/// microsecond-latency access to the live stream without tailing the file.
+///
+/// The ring is single-writer / multi-reader.  The writer never blocks and
+/// never waits for readers: a reader that falls more than one ring size
+/// behind loses data and is resynchronized to the current head (reported
+/// by a negative return of Reader::Next()).  Readers are lock-free - they
+/// only load the atomic head and copy record bytes out.
+//------------------------------------------------------------------------------
+// Copyright (c) 2015 Omnibius, LLC
+// Author:  Serge Aleynikov <saleyn@gmail.com>
+// Created: 2015-10-15
+//------------------------------------------------------------------------------
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <utxx/error.hpp>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sdb {
+
+//------------------------------------------------------------------------------
+/// Named shared-memory ring of encoded SDB samples
+//------------------------------------------------------------------------------
+struct ShmemRing {
+  static constexpr uint32_t MAGIC()    { return 0x52424453;   } // "SDBR"
+  static constexpr int      VERSION()  { return 1;            }
+  static constexpr size_t   DEF_SIZE() { return 8*1024*1024;  }
+  /// Marker record: skip to the beginning of the ring
+  static constexpr uint32_t SKIP()     { return 0xFFFFFFFF;   }
+
+  /// Create a ring (writer side).  An existing ring of the same name is
+  /// replaced.  \a a_size is rounded up to a power of two
+  ShmemRing(std::string const& a_name, size_t a_size);
+
+  /// Attach to an existing ring (reader side)
+  explicit ShmemRing(std::string const& a_name);
+
+  ShmemRing(ShmemRing&& a_rhs);
+  ~ShmemRing();
+
+  ShmemRing(ShmemRing const&)            = delete;
+  ShmemRing& operator=(ShmemRing const&) = delete;
+
+  /// Remove a ring's name from the system (attached processes keep it alive)
+  static void Unlink(std::string const& a_name) { shm_unlink(a_name.c_str()); }
+
+  std::string const& Name() const { return m_name;        }
+  size_t             Size() const { return m_hdr->m_size; }
+  /// Monotonically increasing byte sequence of the next record to be written
+  uint64_t           Head() const
+    { return m_hdr->m_head.load(std::memory_order_acquire); }
+
+  /// Publish one encoded sample (single writer only, never blocks)
+  void Publish(const char* a_data, size_t a_sz);
+
+  //----------------------------------------------------------------------------
+  /// Lock-free reading cursor over a ring.  Each reader progresses
+  /// independently; a slow reader is overrun rather than slowing the writer
+  //----------------------------------------------------------------------------
+  struct Reader {
+    explicit Reader(ShmemRing const& a_ring)
+      : m_ring(&a_ring)
+      , m_seq (a_ring.Head())       // Start at the live edge
+    {}
+
+    /// Copy the next record's payload into \a a_buf.
+    /// @return payload size; 0 when no new data; -1 when this reader was
+    ///         overrun by the writer (the cursor is resynchronized to the
+    ///         head - samples in between are lost, and the next record
+    ///         should be treated as the start of a fresh stream)
+    long Next(char* a_buf, size_t a_max);
+
+    /// Byte sequence of the next record to be read
+    uint64_t Seq() const { return m_seq; }
+
+  private:
+    ShmemRing const* m_ring;
+    uint64_t         m_seq;
+  };
+
+private:
+  struct Hdr {
+    uint32_t              m_magic;
+    uint32_t              m_version;
+    uint64_t              m_size;     ///< Data capacity (power of two)
+    std::atomic<uint64_t> m_head;     ///< Monotonic published byte count
+    char                  m_pad[64 - sizeof(std::atomic<uint64_t>)];
+  };
+
+  static size_t Align8 (size_t a_sz) { return (a_sz + 7) & ~size_t(7); }
+  static size_t RoundUpPow2(size_t a_sz) {
+    size_t n = 64*1024;
+    while (n < a_sz) n <<= 1;
+    return n;
+  }
+
+  void Map(std::string const& a_name, size_t a_size, bool a_create);
+
+  std::string m_name;
+  Hdr*        m_hdr  = nullptr;
+  char*       m_data = nullptr;
+  size_t      m_size = 0;             ///< Cached m_hdr->m_size
+};
+
+//------------------------------------------------------------------------------
+// Implementation
+//------------------------------------------------------------------------------
+inline void ShmemRing::
+Map(std::string const& a_name, size_t a_size, bool a_create)
+{
+  int flags = a_create ? O_CREAT | O_RDWR : O_RDWR;
+  int fd    = shm_open(a_name.c_str(), flags, 0660);
+  if (fd < 0)
+    UTXX_THROW_IO_ERROR(errno, "Can't open shared memory ring ", a_name);
+
+  size_t total = sizeof(Hdr) + a_size;
+
+  if (a_create && ftruncate(fd, total) < 0) {
+    auto err = errno;
+    ::close(fd);
+    UTXX_THROW_IO_ERROR(err, "Can't size shared memory ring ", a_name);
+  }
+
+  if (!a_create) {
+    struct stat st;
+    if (fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(Hdr)) {
+      ::close(fd);
+      UTXX_THROW_RUNTIME_ERROR("Invalid shared memory ring ", a_name);
+    }
+    total = st.st_size;
+  }
+
+  auto p = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED)
+    UTXX_THROW_IO_ERROR(errno, "Can't map shared memory ring ", a_name);
+
+  m_hdr  = static_cast<Hdr*>(p);
+  m_data = reinterpret_cast<char*>(m_hdr + 1);
+
+  if (a_create) {
+    m_hdr->m_magic   = MAGIC();
+    m_hdr->m_version = VERSION();
+    m_hdr->m_size    = a_size;
+    m_hdr->m_head.store(0, std::memory_order_release);
+  } else if (m_hdr->m_magic != MAGIC() || m_hdr->m_version != VERSION()) {
+    munmap(m_hdr, total);
+    m_hdr = nullptr;
+    UTXX_THROW_RUNTIME_ERROR
+      ("Shared memory ring version mismatch: ", a_name);
+  }
+
+  m_size = m_hdr->m_size;
+}
+
+//------------------------------------------------------------------------------
+inline ShmemRing::
+ShmemRing(std::string const& a_name, size_t a_size)
+  : m_name(a_name)
+{
+  shm_unlink(a_name.c_str());         // Replace a stale ring of the same name
+  Map(a_name, RoundUpPow2(a_size), true);
+}
+
+//------------------------------------------------------------------------------
+inline ShmemRing::
+ShmemRing(std::string const& a_name)
+  : m_name(a_name)
+{
+  Map(a_name, 0, false);
+}
+
+//------------------------------------------------------------------------------
+inline ShmemRing::
+ShmemRing(ShmemRing&& a_rhs)
+  : m_name(std::move(a_rhs.m_name))
+  , m_hdr (a_rhs.m_hdr)
+  , m_data(a_rhs.m_data)
+  , m_size(a_rhs.m_size)
+{
+  a_rhs.m_hdr  = nullptr;
+  a_rhs.m_data = nullptr;
+}
+
+//------------------------------------------------------------------------------
+inline ShmemRing::
+~ShmemRing()
+{
+  if (m_hdr)
+    munmap(m_hdr, sizeof(Hdr) + m_size);
+}
+
+//------------------------------------------------------------------------------
+inline void ShmemRing::
+Publish(const char* a_data, size_t a_sz)
+{
+  assert(m_hdr);
+  assert(Align8(4 + a_sz) < m_size);
+
+  auto need = Align8(4 + a_sz);
+  auto head = m_hdr->m_head.load(std::memory_order_relaxed);
+  auto off  = head & (m_size - 1);
+
+  if (off + need > m_size) {
+    // Not enough room before the edge: pad to it (records never wrap)
+    *reinterpret_cast<uint32_t*>(m_data + off) = SKIP();
+    head += m_size - off;
+    off   = 0;
+  }
+
+  *reinterpret_cast<uint32_t*>(m_data + off) = uint32_t(a_sz);
+  memcpy(m_data + off + 4, a_data, a_sz);
+
+  // The release store makes the record visible to readers only when complete
+  m_hdr->m_head.store(head + need, std::memory_order_release);
+}
+
+//------------------------------------------------------------------------------
+inline long ShmemRing::Reader::
+Next(char* a_buf, size_t a_max)
+{
+  auto& hdr  = *m_ring->m_hdr;
+  auto  size = m_ring->m_size;
+  auto  data = m_ring->m_data;
+
+  while (true) {
+    auto head = hdr.m_head.load(std::memory_order_acquire);
+    if (m_seq == head)
+      return 0;                                 // Caught up - no new data
+
+    if (head - m_seq > size) {
+      m_seq = head;                             // Overrun: jump to the edge
+      return -1;
+    }
+
+    auto off = m_seq & (size - 1);
+    auto len = *reinterpret_cast<uint32_t const*>(data + off);
+
+    if (len == SKIP()) {
+      m_seq += size - off;                      // Padding up to the edge
+      continue;
+    }
+
+    // A torn length (record overwritten mid-read) is caught by the
+    // validation below; clamp the copy so it can't run past the mapping
+    auto n = size_t(len);
+    bool ok = off + 4 + n <= size && n <= a_max;
+    if (ok)
+      memcpy(a_buf, data + off + 4, n);
+
+    if (hdr.m_head.load(std::memory_order_acquire) - m_seq > size) {
+      m_seq = hdr.m_head.load(std::memory_order_acquire);
+      return -1;                                // Overrun during the copy
+    }
+
+    if (!ok)
+      UTXX_THROW_RUNTIME_ERROR
+        ("Shared memory ring record too large: ", n, " (max ", a_max, ')');
+
+    m_seq += Align8(4 + n);
+    return long(n);
+  }
+}
+
+} // namespace sdb
@@ -0,0 +1,174 @@
+// vim:ts=2:sw=2:et
+//-----------------------------------------------------------------------------
+/// \file  sdb_stats.hpp
+//------------------------------------------------------------------------------
+/// \brief Optional I/O instrumentation: counters and latency histograms
+///
+/// When capture falls behind it matters whether the time goes into LEB128
+/// encoding, candle updates or the file write itself.  IOStats collects
+/// per-stream throughput counters and log2-bucketed latency histograms
+/// around the hot write/read entry points of BaseSDBFileIO, exposed via its
+/// Stats() accessor and the `sdbdump --stats` report.
+///
+/// Collection is compiled in only under SDB_HAVE_STATS (cmake -DWITH_STATS);
+/// without it the SDB_STAT*() hooks expand to nothing and the facility has
+/// zero runtime overhead.
+//------------------------------------------------------------------------------
+// Copyright (c) 2015 Omnibius, LLC
+// Author:  Serge Aleynikov <saleyn@gmail.com>
+// Created: 2015-10-15
+//------------------------------------------------------------------------------
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <ostream>
+#include <iomanip>
+
+namespace sdb {
+
+//------------------------------------------------------------------------------
+/// Latency histogram with one bucket per power of two nanoseconds.
+/// Recording is one clz + two increments; percentiles are approximated by
+/// the geometric midpoint of the matching bucket
+//------------------------------------------------------------------------------
+struct LatencyHistogram {
+  static constexpr int BUCKETS() { return 48; }
+
+  void Add(uint64_t a_ns) {
+    int b = a_ns ? 63 - __builtin_clzll(a_ns) + 1 : 0;
+    if (b >= BUCKETS()) b = BUCKETS() - 1;
+    m_buckets[b]++;
+    m_count++;
+    m_sum += a_ns;
+    if (a_ns < m_min) m_min = a_ns;
+    if (a_ns > m_max) m_max = a_ns;
+  }
+
+  uint64_t Count() const { return m_count;                   }
+  uint64_t Min()   const { return m_count ? m_min : 0;       }
+  uint64_t Max()   const { return m_max;                     }
+  double   Mean()  const { return m_count ? double(m_sum)/m_count : 0.0; }
+
+  /// Approximate \a a_pct percentile (0 < a_pct < 100) in nanoseconds
+  uint64_t Percentile(double a_pct) const {
+    if (!m_count)
+      return 0;
+    auto     rank = uint64_t(double(m_count) * a_pct / 100.0);
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS(); ++i) {
+      seen += m_buckets[i];
+      if (seen > rank)
+        // Geometric midpoint of bucket i: [2^(i-1), 2^i)
+        return i ? ((uint64_t(1) << (i-1)) + (uint64_t(1) << i)) >> 1
+                 : 0;
+    }
+    return m_max;
+  }
+
+  void Clear() { *this = LatencyHistogram(); }
+
+  void Print(std::ostream& a_out, const char* a_name) const {
+    a_out << "  " << std::left << std::setw(12) << a_name << std::right
+          << " count="  << std::setw(10) << Count()
+          << " min="    << std::setw(8)  << Min()   << "ns"
+          << " mean="   << std::setw(10) << uint64_t(Mean()) << "ns"
+          << " p50="    << std::setw(8)  << Percentile(50.0) << "ns"
+          << " p99="    << std::setw(8)  << Percentile(99.0) << "ns"
+          << " max="    << std::setw(10) << Max()   << "ns\n";
+  }
+
+private:
+  uint64_t m_buckets[BUCKETS()] = {};
+  uint64_t m_count = 0;
+  uint64_t m_sum   = 0;
+  uint64_t m_min   = uint64_t(-1);
+  uint64_t m_max   = 0;
+};
+
+//------------------------------------------------------------------------------
+/// Per-stream throughput counters
+//------------------------------------------------------------------------------
+struct StreamCounters {
+  uint64_t m_samples = 0;   ///< Samples encoded or decoded
+  uint64_t m_bytes   = 0;   ///< Encoded bytes
+  uint64_t m_deltas  = 0;   ///< Delta-encoded samples (vs full)
+};
+
+//------------------------------------------------------------------------------
+/// Instrumentation state of one BaseSDBFileIO instance (see Stats())
+//------------------------------------------------------------------------------
+struct IOStats {
+  /// Indexed by int(StreamType)
+  static constexpr int NSTREAMS() { return 8; }
+
+  StreamCounters   m_wr[NSTREAMS()];  ///< Write-path per-stream counters
+  StreamCounters   m_rd[NSTREAMS()];  ///< Read-path  per-stream counters
+
+  LatencyHistogram m_wr_quote;        ///< WriteQuotes() call latency
+  LatencyHistogram m_wr_trade;        ///< WriteTrade()  call latency
+  LatencyHistogram m_flush;           ///< Flush()       call latency
+  LatencyHistogram m_rd_decode;       ///< Read() call latency (decode + I/O)
+
+  void Clear() { *this = IOStats(); }
+
+  void Print(std::ostream& a_out) const {
+    static const char* s_names[NSTREAMS()] =
+      {"Seconds", "Quotes", "Trade", "Order", "Summary", "Message",
+       "BookDelta", "?"};
+    auto side = [&](const char* a_nm, StreamCounters const (&a_c)[NSTREAMS()]) {
+      for (int i = 0; i < NSTREAMS(); ++i) {
+        auto& c = a_c[i];
+        if (!c.m_samples)
+          continue;
+        a_out << "  " << std::left  << std::setw(4) << a_nm
+              << std::setw(10) << s_names[i] << std::right
+              << " samples=" << std::setw(12) << c.m_samples
+              << " bytes="   << std::setw(14) << c.m_bytes
+              << " deltas="  << std::setw(12) << c.m_deltas << '\n';
+      }
+    };
+    a_out << "Stream counters:\n";
+    side("wr", m_wr);
+    side("rd", m_rd);
+    a_out << "Latency histograms:\n";
+    m_wr_quote .Print(a_out, "WriteQuotes");
+    m_wr_trade .Print(a_out, "WriteTrade");
+    m_flush    .Print(a_out, "Flush");
+    m_rd_decode.Print(a_out, "Decode");
+  }
+};
+
+//------------------------------------------------------------------------------
+/// Scoped timer recording its lifetime into a LatencyHistogram
+//------------------------------------------------------------------------------
+struct StatTimer {
+  explicit StatTimer(LatencyHistogram& a_hist)
+    : m_hist(a_hist)
+    , m_start(std::chrono::steady_clock::now())
+  {}
+
+  ~StatTimer() {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>
+              (std::chrono::steady_clock::now() - m_start).count();
+    m_hist.Add(uint64_t(ns));
+  }
+
+private:
+  LatencyHistogram&                              m_hist;
+  std::chrono::steady_clock::time_point          m_start;
+};
+
+//------------------------------------------------------------------------------
+// Collection hooks: no-ops unless compiled with SDB_HAVE_STATS
+//------------------------------------------------------------------------------
+#ifdef SDB_HAVE_STATS
+#define SDB_STAT(Expr)         do { Expr; } while (0)
+#define SDB_STAT_TIMER(Hist)   sdb::StatTimer _sdb_stat_timer_(Hist)
+#else
+#define SDB_STAT(Expr)         ((void)0)
+#define SDB_STAT_TIMER(Hist)   ((void)0)
+#endif
+
+} // namespace sdb
@@ -0,0 +1,186 @@
+// vim:ts=2:sw=2:et
+//-----------------------------------------------------------------------------
+/// \file  sdb_writer_pool.hpp
+//------------------------------------------------------------------------------
+/// \brief Pool of SDB writers for capturing many instruments at once
+///
+/// Capturing a whole exchange keeps thousands of BaseSDBFileIO writers alive
+/// simultaneously.  A WriterPool owns the writers, routes samples to them by
+/// security id, and recycles encode buffers through a shared arena: a writer
+/// only holds a buffer between its first write and the next pool-wide
+/// Flush(), so the arena is bounded by the number of instruments active in a
+/// flush interval rather than by the total number of open files.  Flushing
+/// all dirty writers in one pass also replaces thousands of independent
+/// per-file flushes with a single sweep.
+//------------------------------------------------------------------------------
+// Copyright (c) 2015 Omnibius, LLC
+// Author:  Serge Aleynikov <saleyn@gmail.com>
+// Created: 2015-10-15
+//------------------------------------------------------------------------------
+#pragma once
+
+#include <sdb/sdb_fmt_io.hxx>
+#include <memory>
+#include <unordered_map>
+
+namespace sdb {
+
+//------------------------------------------------------------------------------
+/// Pool of per-instrument SDB writers sharing an encode-buffer arena
+//------------------------------------------------------------------------------
+template <uint MaxDepth = 10>
+struct WriterPool {
+  using FileIO = BaseSDBFileIO<MaxDepth>;
+
+  /// Default per-writer encode buffer size.  Smaller than the standalone
+  /// WR_BUF_SIZE() since pooled buffers are recycled across instruments
+  static constexpr size_t DEF_WR_BUF_SIZE() { return 128*1024; }
+
+  /// @param a_wr_buf_size encode buffer size handed to pooled writers
+  /// @param a_max_dirty   automatically Flush() once this many writers have
+  ///                      unflushed data (0 = flush manually)
+  explicit WriterPool(size_t a_wr_buf_size = DEF_WR_BUF_SIZE(),
+                      size_t a_max_dirty   = 0)
+    : m_wr_buf_size(std::min(std::max(a_wr_buf_size, size_t(64*1024)),
+                             FileIO::WR_BUF_SIZE()))
+    , m_max_dirty  (a_max_dirty)
+  {}
+
+  ~WriterPool() { Close(); }
+
+  WriterPool(WriterPool const&)            = delete;
+  WriterPool& operator=(WriterPool const&) = delete;
+
+  /// Create a writer for instrument \a a_secid and open its file.
+  /// Arguments are forwarded to FileIO::Open<Mode>() (the security id is
+  /// passed there explicitly as one of the arguments as usual).
+  /// @return reference to the new writer
+  template <OpenMode Mode = OpenMode::Write, typename... Args>
+  FileIO& Add(long a_secid, Args&&... args) {
+    if (utxx::unlikely(m_writers.count(a_secid)))
+      UTXX_THROW_RUNTIME_ERROR("Duplicate writer for secid ", a_secid);
+    auto  w = std::unique_ptr<FileIO>(new FileIO());
+    // Buffers come from the shared arena on the first write after a flush
+    w->WrBufSize(m_wr_buf_size, true);
+    w->template Open<Mode>(std::forward<Args>(args)...);
+    auto& res = *w;
+    m_writers.emplace(a_secid, std::move(w));
+    return res;
+  }
+
+  /// @return writer of instrument \a a_secid or nullptr if there is none
+  FileIO* Find(long a_secid) {
+    auto it = m_writers.find(a_secid);
+    return it == m_writers.end() ? nullptr : it->second.get();
+  }
+
+  /// Write a book snapshot to the file of instrument \a a_secid
+  template <PriceUnit PU, typename PxT>
+  void WriteQuotes
+  (
+    long a_secid, time_val a_ts,
+    PxLevels<MaxDepth, PxT>&& a_bids, size_t a_bid_cnt,
+    PxLevels<MaxDepth, PxT>&& a_asks, size_t a_ask_cnt
+  ) {
+    auto& w = Route(a_secid);
+    w.template WriteQuotes<PU>(a_ts, std::move(a_bids), a_bid_cnt,
+                                     std::move(a_asks), a_ask_cnt);
+    MaybeFlush();
+  }
+
+  /// Write a trade to the file of instrument \a a_secid
+  template <PriceUnit PU, typename PxT>
+  void WriteTrade
+  (
+    long      a_secid,
+    time_val  a_ts,
+    SideT     a_side,
+    PxT       a_px,
+    uint      a_qty,
+    AggrT     a_aggr     = AggrT::Undefined,
+    size_t    a_ord_id   = 0,
+    size_t    a_trade_id = 0
+  ) {
+    auto& w = Route(a_secid);
+    w.template WriteTrade<PU>(a_ts, a_side, a_px, a_qty, a_aggr,
+                              a_ord_id, a_trade_id);
+    MaybeFlush();
+  }
+
+  /// Write an order action to the file of instrument \a a_secid
+  template <PriceUnit PU, typename PxT>
+  void WriteOrder
+  (
+    long                 a_secid,
+    time_val             a_ts,
+    OrderSample::ActionT a_action,
+    SideT                a_side,
+    size_t               a_order_id,
+    PxT                  a_px,
+    int                  a_qty
+  ) {
+    auto& w = Route(a_secid);
+    w.template WriteOrder<PU>(a_ts, a_action, a_side, a_order_id, a_px, a_qty);
+    MaybeFlush();
+  }
+
+  /// Flush all writers with pending data in one sweep and return their
+  /// encode buffers to the shared arena
+  void Flush() {
+    for (auto* w : m_dirty) {
+      w->Flush();
+      m_arena.emplace_back(w->DetachWrBuf());
+    }
+    m_dirty.clear();
+  }
+
+  /// Flush and close all writers, releasing the arena
+  void Close() {
+    Flush();
+    for (auto& it : m_writers)
+      it.second->Close();
+    m_writers.clear();
+    m_arena.clear();
+  }
+
+  /// Number of writers in the pool
+  size_t Count()        const { return m_writers.size(); }
+  /// Number of writers with unflushed data
+  size_t DirtyCount()   const { return m_dirty.size();   }
+  /// Number of free encode buffers in the shared arena
+  size_t ArenaBuffers() const { return m_arena.size();   }
+
+private:
+  //----------------------------------------------------------------------------
+  /// Look up the writer of \a a_secid and make sure it owns an encode buffer
+  //----------------------------------------------------------------------------
+  FileIO& Route(long a_secid) {
+    auto it = m_writers.find(a_secid);
+    if (utxx::unlikely(it == m_writers.end()))
+      UTXX_THROW_RUNTIME_ERROR("No writer for secid ", a_secid);
+
+    auto& w = *it->second;
+    if (!w.HasWrBuf()) {
+      if (!m_arena.empty()) {
+        w.AttachWrBuf(std::move(m_arena.back()));
+        m_arena.pop_back();
+      }
+      // Otherwise the writer allocates a buffer of WrBufSize() on demand
+      m_dirty.push_back(&w);
+    }
+    return w;
+  }
+
+  void MaybeFlush() {
+    if (m_max_dirty && m_dirty.size() >= m_max_dirty)
+      Flush();
+  }
+
+  size_t                                           m_wr_buf_size;
+  size_t                                           m_max_dirty;
+  std::unordered_map<long, std::unique_ptr<FileIO>> m_writers;
+  std::vector<std::vector<char>>                   m_arena;
+  std::vector<FileIO*>                             m_dirty;
+};
+
+} // namespace sdb
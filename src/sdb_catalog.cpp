@@ -0,0 +1,322 @@
+// vim:ts=2:sw=2:et
+//-----------------------------------------------------------------------------
+/// \file  sdb_catalog.cpp
+//------------------------------------------------------------------------------
+/// \brief Metadata catalog sidecar of an SDB database root
+//------------------------------------------------------------------------------
+// Copyright (c) 2015 Omnibius, LLC
+// Author:  Serge Aleynikov <saleyn@gmail.com>
+// Created: 2015-10-15
+//------------------------------------------------------------------------------
+#include <sdb/sdb_catalog.hpp>
+#include <utxx/error.hpp>
+#include <utxx/endian.hpp>
+#include <sys/stat.h>
+#include <cassert>
+#include <cstring>
+#include <cstdio>
+
+using namespace std;
+
+namespace sdb {
+
+namespace {
+  //----------------------------------------------------------------------------
+  // Little-endian encoder writing to a growable buffer
+  //----------------------------------------------------------------------------
+  struct Enc {
+    vector<char> buf;
+
+    void U8 (uint8_t  a) { buf.push_back(char(a)); }
+    void U16(uint16_t a) { char t[2]; char* p=t; utxx::put16le(p,a); Add(t,2); }
+    void U32(uint32_t a) { char t[4]; char* p=t; utxx::put32le(p,a); Add(t,4); }
+    void U64(uint64_t a) { char t[8]; char* p=t; utxx::put64le(p,a); Add(t,8); }
+    void I32(int32_t  a) { U32(uint32_t(a)); }
+    void I64(int64_t  a) { U64(uint64_t(a)); }
+    void Dbl(double   a) { uint64_t v; memcpy(&v, &a, 8); U64(v); }
+
+    void Str(string const& a) {
+      U16(uint16_t(a.size()));
+      Add(a.data(), a.size());
+    }
+
+    void Add(const char* a, size_t a_sz) { buf.insert(buf.end(), a, a+a_sz); }
+  };
+
+  //----------------------------------------------------------------------------
+  // Little-endian decoder reading from a memory buffer
+  //----------------------------------------------------------------------------
+  struct Dec {
+    const char* p;
+    const char* end;
+
+    void Need(size_t a_sz) {
+      if (utxx::unlikely(p + a_sz > end))
+        UTXX_THROW_RUNTIME_ERROR("Truncated catalog entry");
+    }
+
+    uint8_t  U8 () { Need(1); return uint8_t(*p++);       }
+    uint16_t U16() { Need(2); return utxx::get16le(p);    }
+    uint32_t U32() { Need(4); return utxx::get32le(p);    }
+    uint64_t U64() { Need(8); return utxx::get64le(p);    }
+    int32_t  I32() { return int32_t(U32());               }
+    int64_t  I64() { return int64_t(U64());               }
+    double   Dbl() { auto v=U64(); double d; memcpy(&d,&v,8); return d; }
+
+    string   Str() {
+      auto n = U16();
+      Need(n);
+      string s(p, n);
+      p += n;
+      return s;
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  bool StatFile(string const& a_path, time_t& a_mtime, int64_t& a_size) {
+    struct stat st;
+    if (::stat(a_path.c_str(), &st) < 0)
+      return false;
+    a_mtime = st.st_mtime;
+    a_size  = st.st_size;
+    return true;
+  }
+}
+
+//------------------------------------------------------------------------------
+MetaCatalog::MetaCatalog(string const& a_root_dir)
+  : m_catalog_file((a_root_dir.empty() ? string(".") : a_root_dir)
+                   + "/" + FILENAME())
+{
+  Load();
+}
+
+//------------------------------------------------------------------------------
+void MetaCatalog::Load()
+{
+  FILE* f = ::fopen(m_catalog_file.c_str(), "r");
+  if (!f)
+    return;                             // No catalog yet - empty cache
+
+  vector<char> buf;
+  try {
+    if (fseek(f, 0, SEEK_END) < 0)
+      UTXX_THROW_IO_ERROR(errno, "Cannot seek catalog ", m_catalog_file);
+    auto sz = ftell(f);
+    ::rewind(f);
+    buf.resize(sz);
+    if (long(fread(&buf[0], 1, sz, f)) != sz)
+      UTXX_THROW_IO_ERROR(errno, "Cannot read catalog ", m_catalog_file);
+    ::fclose(f);
+  }
+  catch (...) { ::fclose(f); throw; }
+
+  try {
+    Dec in{&buf[0], &buf[0] + buf.size()};
+
+    if (in.U32() != MAGIC() || in.U32() != VERSION())
+      UTXX_THROW_RUNTIME_ERROR("Invalid catalog format ", m_catalog_file);
+
+    auto count = in.U32();
+
+    for (uint32_t i = 0; i < count; ++i) {
+      auto  path = in.Str();
+      Entry e;
+      e.m_mtime  = in.I64();
+      e.m_size   = in.I64();
+
+      // Header
+      auto ver   = in.U32();
+      auto xchg  = in.Str();
+      auto sym   = in.Str();
+      auto instr = in.Str();
+      auto secid = in.I64();
+      auto date  = in.I64();
+      auto tznm  = in.Str();
+      auto tzoff = in.I32();
+      auto depth = in.U8 ();
+      auto pxstp = in.Dbl();
+      uuid u;
+      in.Need(sizeof(u.data));
+      memcpy(u.data, in.p, sizeof(u.data));
+      in.p      += sizeof(u.data);
+
+      e.m_header.Set(ver, xchg, sym, instr, secid, utxx::time_val(utxx::secs(date)),
+                     tznm, tzoff, depth, pxstp, u);
+
+      // StreamsMeta
+      auto cmp   = StreamsMeta::CompressT(in.U8());
+      auto doff  = in.U64();
+      auto nstrm = in.U16();
+      StreamsMeta::StreamsVec strms;
+      for (int j = 0; j < nstrm; ++j)
+        strms.emplace_back(StreamType(in.U8()));
+      e.m_streams_meta = StreamsMeta(std::move(strms), doff, cmp);
+      e.m_streams_meta.Version(ver);
+      e.m_candles_meta.Version(ver);
+      e.m_streams_meta.SeekTblOffset(in.U64());
+
+      auto nblks = in.U32();
+      for (uint32_t j = 0; j < nblks; ++j) {
+        auto foff = in.U64();
+        auto roff = in.U64();
+        auto fsec = in.U32();
+        auto nrec = in.U32();
+        e.m_streams_meta.AddBlock(foff, roff, fsec, nrec);
+      }
+
+      // CandlesMeta
+      auto nhdrs = in.U16();
+      for (int j = 0; j < nhdrs; ++j) {
+        auto res   = in.U16();
+        auto start = in.I32();
+        auto coff  = in.U64();
+        auto ncans = in.U32();
+        CandleHeader ch(res, start, start + int(res)*ncans, coff);
+        assert(ch.Candles().size() == ncans);
+        for (uint32_t k = 0; k < ncans; ++k) {
+          auto o  = in.I32(); auto h  = in.I32();
+          auto l  = in.I32(); auto c  = in.I32();
+          auto bv = in.U32(); auto sv = in.U32();
+          auto off= in.U64();
+          ch.Candles()[k] = Candle(o, h, l, c, bv, sv, off);
+        }
+        e.m_candles_meta.Headers().emplace_back(std::move(ch));
+      }
+
+      m_entries.emplace(std::move(path), std::move(e));
+    }
+  }
+  catch (std::exception const&) {
+    // Corrupt/stale catalog: discard it and repopulate from in-file parsing
+    m_entries.clear();
+  }
+}
+
+//------------------------------------------------------------------------------
+MetaCatalog::Entry const* MetaCatalog::Find(string const& a_path) const
+{
+  std::lock_guard<std::mutex> guard(m_mutex);
+
+  auto it = m_entries.find(a_path);
+  if (it == m_entries.end())
+    return nullptr;
+
+  time_t  mtime;
+  int64_t size;
+  if (!StatFile(a_path, mtime, size) ||
+      mtime != it->second.m_mtime    || size != it->second.m_size)
+    return nullptr;                     // Entry is stale
+
+  return &it->second;
+}
+
+//------------------------------------------------------------------------------
+void MetaCatalog::Update
+(
+  string      const& a_path,
+  Header      const& a_header,
+  StreamsMeta const& a_streams_meta,
+  CandlesMeta const& a_candles_meta
+)
+{
+  Entry e;
+  if (!StatFile(a_path, e.m_mtime, e.m_size))
+    return;                             // Can't stamp the key - don't cache
+
+  e.m_header       = a_header;
+  e.m_streams_meta = a_streams_meta;
+  e.m_candles_meta = a_candles_meta;
+
+  std::lock_guard<std::mutex> guard(m_mutex);
+  m_entries[a_path] = std::move(e);
+  m_dirty           = true;
+}
+
+//------------------------------------------------------------------------------
+void MetaCatalog::Save()
+{
+  if (!m_dirty)
+    return;
+
+  Enc out;
+  out.U32(MAGIC());
+  out.U32(VERSION());
+  out.U32(m_entries.size());
+
+  for (auto& pe : m_entries) {
+    auto& e = pe.second;
+    out.Str(pe.first);
+    out.I64(e.m_mtime);
+    out.I64(e.m_size);
+
+    // Header
+    auto& h = e.m_header;
+    out.U32(h.Version());
+    out.Str(h.Exchange());
+    out.Str(h.Symbol());
+    out.Str(h.Instrument());
+    out.I64(h.SecID());
+    out.I64(h.Date());
+    out.Str(h.TZName());
+    out.I32(h.TZOffset());
+    out.U8 (h.Depth());
+    out.Dbl(h.PxStep());
+    auto u = h.UUID();
+    out.Add((const char*)u.data, sizeof(u.data));
+
+    // StreamsMeta
+    auto& sm = e.m_streams_meta;
+    out.U8 (uint8_t(sm.Compression()));
+    out.U64(sm.DataOffset());
+    out.U16(sm.Streams().size());
+    for (auto& s : sm.Streams())
+      out.U8(uint8_t(s.StreamID()));
+    out.U64(sm.SeekTblOffset());
+    out.U32(sm.Blocks().size());
+    for (auto& b : sm.Blocks()) {
+      out.U64(b.m_file_offset);
+      out.U64(b.m_raw_offset);
+      out.U32(b.m_first_sec);
+      out.U32(b.m_records);
+    }
+
+    // CandlesMeta
+    auto& cm = e.m_candles_meta;
+    out.U16(cm.Headers().size());
+    for (auto& ch : cm.Headers()) {
+      out.U16(ch.Resolution());
+      out.I32(ch.StartTime());
+      out.U64(ch.CandleDataOffset());
+      out.U32(ch.Candles().size());
+      for (auto& c : ch.Candles()) {
+        out.I32(c.Open());  out.I32(c.High());
+        out.I32(c.Low());   out.I32(c.Close());
+        out.U32(c.BVolume());
+        out.U32(c.SVolume());
+        out.U64(c.DataOffset());
+      }
+    }
+  }
+
+  // Replace the catalog atomically so that concurrent readers never see a
+  // partially written file
+  auto  tmp = m_catalog_file + ".tmp";
+  FILE* f   = ::fopen(tmp.c_str(), "w");
+  if (!f)
+    UTXX_THROW_IO_ERROR(errno, "Cannot create catalog ", tmp);
+
+  if (fwrite(&out.buf[0], 1, out.buf.size(), f) != out.buf.size() ||
+      ::fclose(f) != 0) {
+    ::remove(tmp.c_str());
+    UTXX_THROW_IO_ERROR(errno, "Cannot write catalog ", tmp);
+  }
+
+  if (::rename(tmp.c_str(), m_catalog_file.c_str()) < 0)
+    UTXX_THROW_IO_ERROR
+      (errno, "Cannot rename catalog ", tmp, " to ", m_catalog_file);
+
+  m_dirty = false;
+}
+
+} // namespace sdb
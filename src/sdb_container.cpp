@@ -0,0 +1,230 @@
+// vim:ts=2:sw=2:et
+//-----------------------------------------------------------------------------
+/// \file  sdb_container.cpp
+//------------------------------------------------------------------------------
+/// \brief Multi-instrument container file: preamble and directory I/O
+//------------------------------------------------------------------------------
+// Copyright (c) 2015 Omnibius, LLC
+// Author:  Serge Aleynikov <saleyn@gmail.com>
+// Created: 2015-10-15
+//------------------------------------------------------------------------------
+#include <sdb/sdb_container.hpp>
+#include <utxx/error.hpp>
+#include <utxx/endian.hpp>
+#include <cstring>
+#include <cstdio>
+
+using namespace std;
+
+namespace sdb {
+
+namespace {
+  //----------------------------------------------------------------------------
+  // Little-endian encoder writing to a growable buffer (see sdb_catalog.cpp)
+  //----------------------------------------------------------------------------
+  struct Enc {
+    vector<char> buf;
+
+    void U8 (uint8_t  a) { buf.push_back(char(a)); }
+    void U16(uint16_t a) { char t[2]; char* p=t; utxx::put16le(p,a); Add(t,2); }
+    void U32(uint32_t a) { char t[4]; char* p=t; utxx::put32le(p,a); Add(t,4); }
+    void U64(uint64_t a) { char t[8]; char* p=t; utxx::put64le(p,a); Add(t,8); }
+    void I32(int32_t  a) { U32(uint32_t(a)); }
+    void I64(int64_t  a) { U64(uint64_t(a)); }
+    void Dbl(double   a) { uint64_t v; memcpy(&v, &a, 8); U64(v); }
+
+    void Str(string const& a) {
+      U16(uint16_t(a.size()));
+      Add(a.data(), a.size());
+    }
+
+    void Add(const char* a, size_t a_sz) { buf.insert(buf.end(), a, a+a_sz); }
+  };
+
+  //----------------------------------------------------------------------------
+  // Little-endian decoder reading from a memory buffer
+  //----------------------------------------------------------------------------
+  struct Dec {
+    const char* p;
+    const char* end;
+
+    void Need(size_t a_sz) {
+      if (utxx::unlikely(p + a_sz > end))
+        UTXX_THROW_RUNTIME_ERROR("Truncated container directory");
+    }
+
+    uint8_t  U8 () { Need(1); return uint8_t(*p++);       }
+    uint16_t U16() { Need(2); return utxx::get16le(p);    }
+    uint32_t U32() { Need(4); return utxx::get32le(p);    }
+    uint64_t U64() { Need(8); return utxx::get64le(p);    }
+    int32_t  I32() { return int32_t(U32());               }
+    int64_t  I64() { return int64_t(U64());               }
+    double   Dbl() { auto v=U64(); double d; memcpy(&d,&v,8); return d; }
+
+    string   Str() {
+      auto n = U16();
+      Need(n);
+      string s(p, n);
+      p += n;
+      return s;
+    }
+  };
+}
+
+//------------------------------------------------------------------------------
+void ContainerDir::
+WritePreamble(FILE* a_file, string const& a_filename)
+{
+  char  buf[PREAMBLE_SIZE()];
+  char* p = buf;
+  utxx::put32le(p, MAGIC());
+  utxx::put32le(p, VERSION());
+  utxx::put64le(p, uint64_t(0));          // Directory offset: linked by Write()
+  utxx::put64le(p, uint64_t(m_date.sec()));
+
+  if (fwrite(buf, 1, sizeof(buf), a_file) != sizeof(buf))
+    UTXX_THROW_IO_ERROR
+      (errno, "Error writing preamble of container ", a_filename);
+}
+
+//------------------------------------------------------------------------------
+uint64_t ContainerDir::
+Write(FILE* a_file, string const& a_filename)
+{
+  if (fseek(a_file, 0, SEEK_END) < 0)
+    UTXX_THROW_IO_ERROR(errno, "Cannot seek to end of container ", a_filename);
+
+  auto off = uint64_t(ftell(a_file));
+
+  Enc out;
+  out.U32(m_instruments.size());
+
+  for (auto& in : m_instruments) {
+    // Header
+    auto& h = in.m_header;
+    out.U32(h.Version());
+    out.Str(h.Exchange());
+    out.Str(h.Symbol());
+    out.Str(h.Instrument());
+    out.I64(h.SecID());
+    out.Str(h.TZName());
+    out.I32(h.TZOffset());
+    out.U8 (h.Depth());
+    out.Dbl(h.PxStep());
+    auto u = h.UUID();
+    out.Add((const char*)u.data, sizeof(u.data));
+
+    // Block extents
+    out.U32(in.m_extents.size());
+    for (auto& e : in.m_extents) {
+      out.U64(e.m_file_offset);
+      out.U32(e.m_size);
+      out.U32(e.m_first_sec);
+      out.U32(e.m_records);
+    }
+  }
+
+  if (fwrite(&out.buf[0], 1, out.buf.size(), a_file) != out.buf.size())
+    UTXX_THROW_IO_ERROR
+      (errno, "Error writing directory of container ", a_filename);
+
+  // Link the directory to the preamble: done last so a crash before this
+  // point leaves the file recognizably incomplete (zero directory offset)
+  char  tmp[8];
+  char* p = tmp;
+  utxx::put64le(p, off);
+  if (fseek(a_file, DIR_OFF_POS(), SEEK_SET) < 0 ||
+      fwrite(tmp, 1, sizeof(tmp), a_file) != sizeof(tmp))
+    UTXX_THROW_IO_ERROR
+      (errno, "Error linking directory of container ", a_filename);
+
+  if (fseek(a_file, 0, SEEK_END) < 0)
+    UTXX_THROW_IO_ERROR(errno, "Cannot seek to end of container ", a_filename);
+
+  return off;
+}
+
+//------------------------------------------------------------------------------
+void ContainerDir::
+Read(FILE* a_file, string const& a_filename)
+{
+  char buf[PREAMBLE_SIZE()];
+  if (fseek(a_file, 0, SEEK_SET) < 0 ||
+      fread(buf, 1, sizeof(buf), a_file) != sizeof(buf))
+    UTXX_THROW_IO_ERROR
+      (errno, "Error reading preamble of container ", a_filename);
+
+  const char* q = buf;
+  auto magic    = utxx::get32le(q);
+  auto version  = utxx::get32le(q);
+  auto dir_off  = utxx::get64le(q);
+  auto date     = utxx::get64le(q);
+
+  if (magic != MAGIC())
+    UTXX_THROW_RUNTIME_ERROR("File ", a_filename, " is not an SDB container");
+  if (version != VERSION())
+    UTXX_THROW_RUNTIME_ERROR
+      ("Container version ", version, " of ", a_filename,
+       " not supported (expected: ", VERSION(), ')');
+  if (!dir_off)
+    UTXX_THROW_RUNTIME_ERROR
+      ("Container ", a_filename, " has no directory (not closed cleanly?)");
+
+  m_date = utxx::time_val(utxx::secs(date));
+
+  if (fseek(a_file, 0, SEEK_END) < 0)
+    UTXX_THROW_IO_ERROR(errno, "Cannot seek to end of container ", a_filename);
+  auto file_size = uint64_t(ftell(a_file));
+  if (dir_off >= file_size)
+    UTXX_THROW_RUNTIME_ERROR
+      ("Invalid directory offset ", dir_off, " of container ", a_filename);
+
+  vector<char> dir(file_size - dir_off);
+  if (fseek(a_file, long(dir_off), SEEK_SET) < 0 ||
+      fread(&dir[0], 1, dir.size(), a_file) != dir.size())
+    UTXX_THROW_IO_ERROR
+      (errno, "Error reading directory of container ", a_filename);
+
+  Dec in{&dir[0], &dir[0] + dir.size()};
+
+  auto count = in.U32();
+  m_instruments.clear();
+  m_instruments.reserve(count);
+
+  for (uint32_t i = 0; i < count; ++i) {
+    Instr instr;
+
+    // Header
+    auto ver   = in.U32();
+    auto xchg  = in.Str();
+    auto sym   = in.Str();
+    auto name  = in.Str();
+    auto secid = in.I64();
+    auto tznm  = in.Str();
+    auto tzoff = in.I32();
+    auto depth = in.U8 ();
+    auto pxstp = in.Dbl();
+    uuid u;
+    in.Need(sizeof(u.data));
+    memcpy(u.data, in.p, sizeof(u.data));
+    in.p      += sizeof(u.data);
+
+    instr.m_header.Set(ver, xchg, sym, name, secid, m_date,
+                       tznm, tzoff, depth, pxstp, u);
+
+    // Block extents
+    auto nexts = in.U32();
+    instr.m_extents.reserve(nexts);
+    for (uint32_t j = 0; j < nexts; ++j) {
+      auto foff = in.U64();
+      auto sz   = in.U32();
+      auto fsec = in.U32();
+      auto nrec = in.U32();
+      instr.m_extents.emplace_back(Extent{foff, sz, fsec, nrec});
+    }
+
+    m_instruments.emplace_back(std::move(instr));
+  }
+}
+
+} // namespace sdb
@@ -218,13 +218,20 @@ void Header::Set
 //==============================================================================
 // SecondsSample
 //==============================================================================
+int SecondsSample::Encode(char*& a_buf)
+{
+  char* begin = a_buf;
+  StreamBase::Write(a_buf);
+  sleb128_encode(m_time, a_buf);
+  return a_buf - begin;
+}
+
+//------------------------------------------------------------------------------
 int SecondsSample::Write(FILE* a_file)
 {
   char  buf[16];
-  char* p = buf;
-  StreamBase::Write(p);
-  sleb128_encode(m_time, p);
-  size_t sz = p - buf;
+  char* p   = buf;
+  size_t sz = Encode(p);
   return fwrite(buf, 1, sz, a_file) == sz ? sz : -1;
 }
 
@@ -267,10 +274,9 @@ int StreamsMeta::Write(FILE* a_file, int a_debug)
   m_data_offset_pos = ftell(a_file);
 
   buf.clear();
-  buf.push_back(0);                         // Reserve 4 bytes for DataOffset
-  buf.push_back(0);
-  buf.push_back(0);
-  buf.push_back(0);
+  // Reserve space for DataOffset (4 bytes in v1, 8 bytes in v2)
+  for (int i=0, e = m_version >= 2 ? 8 : 4; i < e; i++)
+    buf.push_back(0);
   buf.push_back((char)m_streams.size());    // StreamCount
 
   for (auto st : m_streams) {
@@ -278,18 +284,128 @@ int StreamsMeta::Write(FILE* a_file, int a_debug)
     buf.push_back((char)st.StreamID());     // StreamType's
   }
 
+  if (HasSeekTbl())
+    for (int i=0; i < 8; i++)
+      buf.push_back(0);                     // Reserve 8 bytes for SeekTblOffset
+
+  auto sz = buf.size();
+  if ((fwrite(&buf[0], 1, sz, a_file) != sz))
+    return -1;
+
+  if (HasSeekTbl())
+    m_seek_tbl_pos = ftell(a_file) - 8;
+
+  return sz;
+}
+
+//------------------------------------------------------------------------------
+int StreamsMeta::WriteSeekTbl(FILE* a_file)
+{
+  if (fseek(a_file, 0, SEEK_END) < 0)
+    return -1;
+
+  m_seek_tbl_off = ftell(a_file);
+
+  // v2 entries carry a per-block sample count after the first second
+  size_t esz = m_version >= 2 ? 24 : 20;
+
+  std::vector<char> buf(4 + m_blocks.size()*esz);
+  char* p = &buf[0];
+  utxx::put32le(p, uint32_t(m_blocks.size()));
+  for (auto& b : m_blocks) {
+    utxx::put64le(p, b.m_file_offset);
+    utxx::put64le(p, b.m_raw_offset);
+    utxx::put32le(p, b.m_first_sec);
+    if (m_version >= 2)
+      utxx::put32le(p, b.m_records);
+  }
+
   auto sz = buf.size();
-  return (fwrite(&buf[0], 1, sz, a_file) == sz) ? sz : -1;
+  if (fwrite(&buf[0], 1, sz, a_file) != sz)
+    return -1;
+
+  // Link the table to the reserved slot in the StreamsMeta header
+  Bookmark bm(a_file, m_seek_tbl_pos);
+  char slot[8];
+  p = slot;
+  utxx::put64le(p, m_seek_tbl_off);
+  return (fwrite(slot, 1, sizeof(slot), a_file) == sizeof(slot)) ? sz : -1;
 }
 
 //------------------------------------------------------------------------------
-int StreamsMeta::WriteDataOffset(FILE* a_file, uint a_data_offset)
+void StreamsMeta::ReadSeekTbl(FILE* a_file)
+{
+  if (!HasSeekTbl() || !m_seek_tbl_off)
+    return;
+
+  Bookmark bm(a_file, m_seek_tbl_off);
+
+  char hdr[4];
+  if (fread(hdr, 1, sizeof(hdr), a_file) != sizeof(hdr))
+    throw utxx::io_error(errno, "cannot read seek table header");
+
+  const char* p = hdr;
+  uint32_t count = utxx::get32le(p);
+  size_t   esz   = m_version >= 2 ? 24 : 20;
+
+  std::vector<char> buf(count*esz);
+  if (fread(&buf[0], 1, buf.size(), a_file) != buf.size())
+    throw utxx::io_error(errno, "cannot read seek table (count=", count, ')');
+
+  m_blocks.clear();
+  p = &buf[0];
+  for (uint32_t i=0; i < count; ++i) {
+    auto foff = utxx::get64le(p);
+    auto roff = utxx::get64le(p);
+    auto fsec = utxx::get32le(p);
+    auto nrec = m_version >= 2 ? uint32_t(utxx::get32le(p)) : 0;
+    m_blocks.emplace_back(CompBlock{foff, roff, uint32_t(fsec), nrec});
+  }
+}
+
+//------------------------------------------------------------------------------
+bool StreamsMeta::RereadSeekTblOffset(FILE* a_file)
+{
+  if (!HasSeekTbl() || !m_seek_tbl_pos)
+    return false;
+
+  Bookmark bm(a_file, m_seek_tbl_pos);
+  char slot[8];
+  if (fread(slot, 1, sizeof(slot), a_file) != sizeof(slot))
+    throw utxx::io_error(errno, "cannot read StreamsMeta seek table offset");
+  const char* p  = slot;
+  m_seek_tbl_off = utxx::get64le(p);
+  return m_seek_tbl_off != 0;
+}
+
+//------------------------------------------------------------------------------
+int StreamsMeta::ClearSeekTbl(FILE* a_file)
+{
+  if (!m_seek_tbl_off)
+    return 0;
+
+  Bookmark bm(a_file, m_seek_tbl_pos);
+  char slot[8];
+  memset(slot, 0, sizeof(slot));
+  m_seek_tbl_off = 0;
+  return (fwrite(slot, 1, sizeof(slot), a_file) == sizeof(slot)) ? 8 : -1;
+}
+
+//------------------------------------------------------------------------------
+int StreamsMeta::WriteDataOffset(FILE* a_file, uint64_t a_data_offset)
 {
     Bookmark bm(a_file, m_data_offset_pos);
-    constexpr size_t sz = sizeof(uint);
-    char buf[sz];
-    utxx::store_le(buf, a_data_offset);
-    return (fwrite(&buf[0], 1, sz, a_file) == sz) ? sz : -1;
+    char  buf[8];
+    char* p  = buf;
+    size_t sz;
+    if (m_version >= 2) {
+      utxx::put64le(p, a_data_offset);
+      sz = 8;
+    } else {
+      utxx::put32le(p, uint32_t(a_data_offset));
+      sz = 4;
+    }
+    return (fwrite(&buf[0], 1, sz, a_file) == sz) ? int(sz) : -1;
 }
 
 //------------------------------------------------------------------------------
@@ -299,16 +415,20 @@ void StreamsMeta::Read(FILE* a_file)
   if  (pos < 0) throw utxx::io_error(errno, "cannot determine curr file offset");
   m_data_offset_pos = pos + 2;
 
+  // The fixed prefix is code + compression + DataOffset + StreamCount, where
+  // DataOffset is 4 bytes in v1 files and 8 bytes in v2
+  int hsz = m_version >= 2 ? 11 : 7;
+
   std::vector<char> buf(256);
   const char*  p = &buf[0];
-  int n = fread((void*)p, 1, 7, a_file);
-  if (n < 7)
+  int n = fread((void*)p, 1, hsz, a_file);
+  if (n < hsz)
     throw utxx::io_error(errno, "cannot read StreamsMeta");
   if (*p++ != CODE())
     throw utxx::runtime_error("invalid StreamsMeta code (", (uint)buf[0],
                               ", expected: ", (uint)CODE(), ')');
   m_compression = CompressT(*p++);
-  m_data_offset = utxx::get32le(p);
+  m_data_offset = m_version >= 2 ? utxx::get64le(p) : uint64_t(utxx::get32le(p));
   int     count = *(uint8_t*)p++;  // Stream count
 
   p = &buf[0];
@@ -328,6 +448,15 @@ void StreamsMeta::Read(FILE* a_file)
 
     m_streams.emplace_back(StreamType(*p++));
   }
+
+  if (HasSeekTbl()) {
+    m_seek_tbl_pos = ftell(a_file);
+    char slot[8];
+    if (fread(slot, 1, sizeof(slot), a_file) != sizeof(slot))
+      throw utxx::io_error(errno, "cannot read StreamsMeta seek table offset");
+    p = slot;
+    m_seek_tbl_off = utxx::get64le(p);
+  }
 }
 
 //==============================================================================
@@ -345,7 +474,7 @@ int CandleHeader::CalcSize(int a_start_time, int a_end_time, uint16_t a_res)
 //------------------------------------------------------------------------------
 bool CandleHeader::UpdateCandle(int a_ts, PriceT a_px, int a_qty)
 {
-  Candle* c = TimeToCandle(a_ts);
+  Candle* c = CachedCandle(a_ts);
   if (!c)
     return false;
   if (c->Open() ==   0)              c->Open(a_px);
@@ -365,7 +494,7 @@ bool CandleHeader::UpdateCandle(int a_ts, PriceT a_px, int a_qty)
 //------------------------------------------------------------------------------
 bool CandleHeader::AddCandleVolume(int a_ts, int a_buy_qty, int a_sell_qty)
 {
-  Candle* c = TimeToCandle(a_ts);
+  Candle* c = CachedCandle(a_ts);
   if (!c)
     return false;
 
@@ -408,7 +537,7 @@ void CandlesMeta::UpdateDataOffset(int a_ts, uint64_t a_data_offset)
 {
   for (auto& c : m_candle_headers) {
     Candle* last_candle = c.LastUpdated();
-    Candle* this_candle = c.TimeToCandle(a_ts);
+    Candle* this_candle = c.CachedCandle(a_ts);
 
     if (last_candle == this_candle || !this_candle)
       continue;
@@ -460,7 +589,7 @@ int CandlesMeta::Write(FILE* a_file, int a_debug)
   if (fwrite(buf, 1, sz, a_file) != sz)
     return -1;
 
-  std::vector<int> candle_offsets;          // Memorize candle hdr file positions
+  std::vector<long> candle_offsets;         // Memorize candle hdr file positions
 
   for (auto& hdr : Headers()) {
     p    = buf;
@@ -470,7 +599,11 @@ int CandlesMeta::Write(FILE* a_file, int a_debug)
     utxx::put32le(p, hdr.StartTime());      // Start time in secs since midnight
     utxx::put32le(p, hdr.Candles().size()); // Number of candles
     // Reserve space for the offset to be filled later
-    utxx::put32le(p, 0);                    // CandleData file offset
+    // (CandleData file offset: 4 bytes in v1, 8 bytes in v2)
+    if (m_version >= 2)
+      utxx::put64le(p, 0);
+    else
+      utxx::put32le(p, 0);
 
     candle_offsets.push_back(ftell(a_file) + 12);  // Pos of CandleHeader.DataOffset
 
@@ -487,15 +620,21 @@ int CandlesMeta::Write(FILE* a_file, int a_debug)
   for (auto& hdr : Headers()) {
     // Update the proper CandleHeader.CandleData with the corresponding offset
     // to the beginning of this block of Candles.
-    uint pos = (uint)ftell(a_file);
+    long pos = ftell(a_file);
 
     hdr.CandleDataOffset(pos);
 
     if (fseek(a_file, candle_offsets[i++], SEEK_SET) < 0)
       return -1;
 
-    char cpos[4]; utxx::store_le(cpos, pos);
-    if (fwrite(&cpos, 1, sizeof(cpos), a_file) != sizeof(cpos))
+    char cpos[8];
+    p = cpos;
+    size_t psz = m_version >= 2 ? 8 : 4;
+    if (m_version >= 2)
+      utxx::put64le(p, uint64_t(pos));
+    else
+      utxx::put32le(p, uint32_t(pos));
+    if (fwrite(&cpos, 1, psz, a_file) != psz)
       return -1;
 
     if (fseek(a_file, pos, SEEK_SET) < 0)
@@ -526,13 +665,14 @@ void sdb::CandlesMeta::Read(FILE* a_file)
     throw utxx::runtime_error("invalid StreamsMeta filler (", (uint)*(p-1), ')');
 
   size_t count = utxx::get16le(p);
+  size_t esz   = m_version >= 2 ? 20 : 16;  // Entry size (v2: 64-bit offset)
 
-  if (buf.size() < 16*count)
-    buf.resize(16*count);
+  if (buf.size() < esz*count)
+    buf.resize(esz*count);
 
   p = &buf[0];
 
-  if (fread((void*)p, 1, count*16, a_file) != count*16)
+  if (fread((void*)p, 1, count*esz, a_file) != count*esz)
     throw utxx::io_error(errno, "invalid file format (missing CandleHeaders)");
 
   m_candle_headers.clear();
@@ -549,7 +689,8 @@ void sdb::CandlesMeta::Read(FILE* a_file)
     uint16_t resolution  =      utxx::get16le(p);
     int      start_time  = (int)utxx::get32le(p);
     uint32_t candle_cnt  =      utxx::get32le(p);
-    uint32_t data_offset =      utxx::get32le(p);
+    uint64_t data_offset = m_version >= 2 ? utxx::get64le(p)
+                                          : uint64_t(utxx::get32le(p));
 
     m_candle_headers.emplace_back
       (resolution, start_time, start_time + candle_cnt*resolution, data_offset);
@@ -605,23 +746,31 @@ Set(FieldMask a_mask, PriceT a_px, int a_qty, size_t a_tid, size_t a_oid)
 }
 
 //------------------------------------------------------------------------------
-int TradeSample::Write(FILE* a_file)
+int TradeSample::Encode(char*& a_buf)
 {
-  char  buf[128];
-  char* p = buf;
+  char* begin = a_buf;
   // Encode stream header and time
-  StreamBase::Write(p);
-  uleb128_encode(m_time, p);          // Encode time since last second
-  *p++ = *(uint8_t*)&m_mask;          // Encode FieldMask
-  sleb128_encode(m_px, p);            // Encode Price - it's always present
+  StreamBase::Write(a_buf);
+  uleb128_encode(m_time, a_buf);      // Encode time since last second
+  *a_buf++ = *(uint8_t*)&m_mask;      // Encode FieldMask
+  sleb128_encode(m_px, a_buf);        // Encode Price - it's always present
   if (HasQty())
-    sleb128_encode(m_qty, p);
+    sleb128_encode(m_qty, a_buf);
   if (HasTradeID())
-    uleb128_encode(m_trade_id, p);
+    uleb128_encode(m_trade_id, a_buf);
   if (HasOrderID())
-    uleb128_encode(m_order_id, p);
+    uleb128_encode(m_order_id, a_buf);
+
+  assert(size_t(a_buf - begin) <= MAX_SIZE());
+  return a_buf - begin;
+}
 
-  size_t sz  = p - buf;
+//------------------------------------------------------------------------------
+int TradeSample::Write(FILE* a_file)
+{
+  char  buf[128];
+  char* p   = buf;
+  size_t sz = Encode(p);
   assert(sz <= sizeof(buf));
   return fwrite(buf, 1, sz, a_file) == sz ? sz : -1;
 }
@@ -687,6 +836,239 @@ int TradeSample::Read(const char* a_buf, size_t a_sz,
   return a_buf - begin;
 }
 
+//==============================================================================
+// OrderSample
+//==============================================================================
+int OrderSample::Encode(char*& a_buf)
+{
+  char* begin = a_buf;
+  // Encode stream header and time
+  StreamBase::Write(a_buf);
+  uleb128_encode(m_time, a_buf);      // Encode time since last second
+  *a_buf++ = *(uint8_t*)&m_mask;      // Encode FieldMask
+  uleb128_encode(m_order_id, a_buf);  // OrderID is always present
+  if (HasPx())
+    sleb128_encode(m_px, a_buf);
+  if (HasQty())
+    sleb128_encode(m_qty, a_buf);
+
+  assert(size_t(a_buf - begin) <= MAX_SIZE());
+  return a_buf - begin;
+}
+
+//------------------------------------------------------------------------------
+int OrderSample::Write(FILE* a_file)
+{
+  char  buf[MAX_SIZE()];
+  char* p   = buf;
+  size_t sz = Encode(p);
+  return fwrite(buf, 1, sz, a_file) == sz ? sz : -1;
+}
+
+//------------------------------------------------------------------------------
+int OrderSample::Read(const char* a_buf, size_t a_sz,
+                      bool a_is_delta, PriceT& a_last_px)
+{
+#ifndef NDEBUG
+  static constexpr uint8_t s_stream_id = uint8_t(StreamType::Order);
+#endif
+
+  auto begin = a_buf;
+  auto end   = a_buf + a_sz;
+
+  // Must be this stream
+  assert((*a_buf & 0x7F) == s_stream_id);
+
+  a_buf++;
+  auto ts = uleb128_decode(a_buf);
+
+  if (a_buf > end)
+    return 0;     // Not enough data
+
+  FieldMask mask(*a_buf++);
+
+  ulong oid = uleb128_decode(a_buf);
+
+  if (utxx::unlikely(a_buf >= end))
+    return 0;
+
+  PriceT px = 0;
+
+  if (mask.has_px) {
+    px = sleb128_decode(a_buf);
+
+    // If this is a delta order, the price value is the diff between last
+    // known price and current price, so:
+    if (a_is_delta)
+      px += a_last_px;
+
+    if (utxx::unlikely(a_buf >= end))
+      return 0;
+  }
+
+  int qty = 0;
+
+  if (mask.has_qty)
+    qty = sleb128_decode(a_buf);
+
+  if (utxx::unlikely(a_buf >= end))
+    return 0;
+
+  new (this) OrderSample(true, mask, ts, oid, px, qty);
+
+  if (mask.has_px)
+    a_last_px = px;
+
+  return a_buf - begin;
+}
+
+//==============================================================================
+// SummarySample
+//==============================================================================
+int SummarySample::Encode(char*& a_buf)
+{
+  char* begin = a_buf;
+  // Encode stream header and time
+  StreamBase::Write(a_buf);
+  uleb128_encode(m_time, a_buf);      // Encode time since last second
+  *a_buf++ = *(uint8_t*)&m_mask;      // Encode FieldMask
+  if (HasBidQty())
+    sleb128_encode(m_bid_qty, a_buf);
+  if (HasAskQty())
+    sleb128_encode(m_ask_qty, a_buf);
+  if (HasOpenPos())
+    sleb128_encode(m_open_pos, a_buf);
+  if (HasRisk()) {
+    // Risk is stored as a little-endian IEEE 64-bit double
+    uint64_t bits;
+    memcpy(&bits, &m_risk, sizeof(bits));
+    utxx::put64le(a_buf, bits);
+  }
+
+  assert(size_t(a_buf - begin) <= MAX_SIZE());
+  return a_buf - begin;
+}
+
+//------------------------------------------------------------------------------
+int SummarySample::Write(FILE* a_file)
+{
+  char  buf[MAX_SIZE()];
+  char* p   = buf;
+  size_t sz = Encode(p);
+  return fwrite(buf, 1, sz, a_file) == sz ? sz : -1;
+}
+
+//------------------------------------------------------------------------------
+int SummarySample::Read(const char* a_buf, size_t a_sz)
+{
+#ifndef NDEBUG
+  static constexpr uint8_t s_stream_id = uint8_t(StreamType::Summary);
+#endif
+
+  auto begin = a_buf;
+  auto end   = a_buf + a_sz;
+
+  // Must be this stream
+  assert((*a_buf & 0x7F) == s_stream_id);
+
+  a_buf++;
+  auto ts = uleb128_decode(a_buf);
+
+  if (a_buf > end)
+    return 0;     // Not enough data
+
+  FieldMask mask(*a_buf++);
+
+  int    bid_qty  = -1, ask_qty = -1, open_pos = 0;
+  double risk     = 0.0;
+
+  if (mask.has_bid_qty)
+    bid_qty = sleb128_decode(a_buf);
+
+  if (utxx::unlikely(a_buf > end))
+    return 0;
+
+  if (mask.has_ask_qty)
+    ask_qty = sleb128_decode(a_buf);
+
+  if (utxx::unlikely(a_buf > end))
+    return 0;
+
+  if (mask.has_open_pos)
+    open_pos = sleb128_decode(a_buf);
+
+  if (mask.has_risk) {
+    if (utxx::unlikely(a_buf + sizeof(uint64_t) > end))
+      return 0;
+    uint64_t bits = utxx::get64le(a_buf);
+    memcpy(&risk, &bits, sizeof(risk));
+  }
+
+  if (utxx::unlikely(a_buf > end))
+    return 0;
+
+  new (this) SummarySample(ts, bid_qty, ask_qty,
+                           mask.has_open_pos, open_pos,
+                           mask.has_risk,     risk);
+
+  return a_buf - begin;
+}
+
+//==============================================================================
+// MessageSample
+//==============================================================================
+int MessageSample::Encode(char*& a_buf)
+{
+  char* begin = a_buf;
+  // Encode stream header and time
+  StreamBase::Write(a_buf);
+  uleb128_encode(m_time, a_buf);        // Encode time since last second
+  uleb128_encode(m_msg.size(), a_buf);  // Message length
+  memcpy(a_buf, m_msg.data(), m_msg.size());
+  a_buf += m_msg.size();
+  return a_buf - begin;
+}
+
+//------------------------------------------------------------------------------
+int MessageSample::Write(FILE* a_file)
+{
+  std::vector<char> buf(Size());
+  char* p   = &buf[0];
+  size_t sz = Encode(p);
+  return fwrite(&buf[0], 1, sz, a_file) == sz ? sz : -1;
+}
+
+//------------------------------------------------------------------------------
+int MessageSample::Read(const char* a_buf, size_t a_sz)
+{
+#ifndef NDEBUG
+  static constexpr uint8_t s_stream_id = uint8_t(StreamType::Message);
+#endif
+
+  auto begin = a_buf;
+  auto end   = a_buf + a_sz;
+
+  // Must be this stream
+  assert((*a_buf & 0x7F) == s_stream_id);
+
+  a_buf++;
+  auto ts  = uleb128_decode(a_buf);
+
+  if (a_buf > end)
+    return 0;     // Not enough data
+
+  auto len = uleb128_decode(a_buf);
+
+  if (utxx::unlikely(a_buf + len > end))
+    return 0;
+
+  new (this) MessageSample(ts, a_buf, len);
+
+  a_buf += len;
+
+  return a_buf - begin;
+}
+
 //------------------------------------------------------------------------------
 std::string TradeSample::ToString(double a_px_step) const
 {
@@ -13,9 +13,17 @@
 #include <sdb/sdb.hpp>
 #include <utxx/get_option.hpp>
 #include <utxx/error.hpp>
-#include <boost/algorithm/string/classification.hpp>
-#include <boost/algorithm/string/split.hpp>
 #include <boost/progress.hpp>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
 
 using namespace std;
 using namespace sdb;
@@ -31,8 +39,19 @@ void Usage(std::string const& a_text = "")
        << "Usage: " << utxx::path::program::name()
        << " -f MDFilename -x Exchange -s Symbol -i Instr -n SecID -y Date\n"
        << "       [-o|-O OutputDir] [-d] [-q]\n"
+       << "       " << utxx::path::program::name()
+       << " -M Manifest -x Exchange [-o|-O OutputDir] [-j N] [-q]\n"
        << "\nOptions:\n"
        << "  -f MDFilename        - filename with KRX market data\n"
+       << "  -M|--manifest File   - bulk mode: convert every entry of the\n"
+       << "                         manifest on a worker pool within this\n"
+       << "                         process.  Each line holds\n"
+       << "                         'InputFile Symbol Instr SecID YYYYMMDD'\n"
+       << "                         ('#' starts a comment); -x, -o|-O, -t\n"
+       << "                         and -q apply to every entry, while -s,\n"
+       << "                         -i, -n and -y are per-entry and ignored\n"
+       << "  -j|--threads N       - number of worker threads in bulk mode\n"
+       << "                         (def: hardware threads)\n"
        << "  -o|--dir OutDir      - output directory (def: MDFilename's dir)\n"
        << "  -O|--full-dir OutDir - deep output directory (same as -o option,\n"
        << "                         except the subdirectory structure is\n"
@@ -91,6 +110,260 @@ enum class MD {
   , SIZE
 };
 
+//------------------------------------------------------------------------------
+// In-place field scanner.  The input is memory-mapped and fields are parsed
+// straight out of the mapped region - no per-line/per-field strings are
+// materialized on the heap.
+//------------------------------------------------------------------------------
+struct Field {
+  const char* beg;
+  const char* end;
+};
+
+/// Split the [\a a_p, \a a_end) line on ' ' and '|' delimiters
+/// @return number of fields found (at most \a a_max)
+static int SplitFields(const char* a_p, const char* a_end,
+                       Field* a_flds, int a_max)
+{
+  int n = 0;
+  while (a_p != a_end && n < a_max) {
+    while (a_p != a_end && (*a_p == ' ' || *a_p == '|' || *a_p == '\r')) ++a_p;
+    if    (a_p == a_end) break;
+    auto b = a_p;
+    while (a_p != a_end && *a_p != ' ' && *a_p != '|' && *a_p != '\r') ++a_p;
+    a_flds[n].beg = b;
+    a_flds[n].end = a_p;
+    n++;
+  }
+  return n;
+}
+
+//------------------------------------------------------------------------------
+static long ToLong(Field const& a_fld)
+{
+  long v = 0;
+  utxx::fast_atoi<long, false>(a_fld.beg, a_fld.end, v);
+  return v;
+}
+
+//------------------------------------------------------------------------------
+static int ToInt(Field const& a_fld)
+{
+  int v = 0;
+  utxx::fast_atoi<int, false>(a_fld.beg, a_fld.end, v);
+  return v;
+}
+
+//------------------------------------------------------------------------------
+static float ToFloat(Field const& a_fld)
+{
+  auto p   = a_fld.beg;
+  bool neg = p != a_fld.end && *p == '-';
+  if  (neg) ++p;
+
+  long whole = 0;
+  for (; p != a_fld.end && *p != '.'; ++p)
+    whole = whole*10 + (*p - '0');
+
+  double v = whole;
+
+  if (p != a_fld.end && *p == '.') {
+    long   frac  = 0;
+    double scale = 1.0;
+    for (++p; p != a_fld.end; ++p) {
+      frac   = frac*10 + (*p - '0');
+      scale *= 10.0;
+    }
+    v += frac / scale;
+  }
+
+  return float(neg ? -v : v);
+}
+
+//------------------------------------------------------------------------------
+/// Conversion parameters of one input file (one manifest entry, or the
+/// single file given with -f).  The time zone fields are resolved up front
+/// on the main thread - localtime_r with a TZ override is not something to
+/// do concurrently on a worker pool
+//------------------------------------------------------------------------------
+struct ConvertJob {
+  std::string filename;
+  std::string symbol;
+  std::string instr;
+  long        secid = 0;
+  time_val    date;
+  std::string tz_name;
+  long        tz_offset = 0;
+};
+
+//------------------------------------------------------------------------------
+// Convert one KRX text file into an SDB file.
+// The \a a_output writer is reused across calls: Close() resets its state
+// while the encode buffer allocation survives, so a worker converting
+// thousands of files allocates it once
+//------------------------------------------------------------------------------
+static void Convert
+(
+  BaseSDBFileIO<3>&  a_output,
+  ConvertJob const&  a_job,
+  std::string const& a_xchg,
+  std::string const& a_outdir,
+  bool               a_subdirs,
+  bool               a_quiet,
+  int                a_debug
+)
+{
+  int fd = ::open(a_job.filename.c_str(), O_RDONLY);
+
+  if (fd < 0)
+    UTXX_THROW_IO_ERROR(errno, "Cannot open file ", a_job.filename);
+
+  std::shared_ptr<boost::progress_display> show_progress;
+
+  long file_size = utxx::path::file_size(a_job.filename);
+  long file_pos  = 0;
+
+  // Map the entire input and parse it in place
+  const char* base = nullptr;
+
+  if (file_size > 0) {
+    base = static_cast<const char*>
+      (::mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0));
+    if (base == MAP_FAILED) {
+      ::close(fd);
+      UTXX_THROW_IO_ERROR(errno, "Unable to mmap file ", a_job.filename);
+    }
+    ::madvise(const_cast<char*>(base), file_size, MADV_SEQUENTIAL);
+  }
+
+  utxx::scope_exit cleanup([&]() {
+    if (base)
+      ::munmap(const_cast<char*>(base), file_size);
+    ::close(fd);
+  });
+
+  a_output.Debug(a_debug);
+
+  auto out_name = a_output.Filename(a_outdir, a_subdirs, a_xchg, a_job.symbol,
+                                    a_job.instr, a_job.secid, a_job.date);
+  utxx::path::file_unlink(out_name);
+
+  if (!a_quiet) {
+    cerr << a_job.filename << " -> " << out_name << endl;
+    if (file_size > 0)
+      show_progress.reset(new boost::progress_display(file_size, cerr));
+  }
+
+  static const int MAX_FIELDS = 19;
+
+  bool        valid = false;
+  const char* p     = base;
+  const char* end   = base + file_size;
+
+  while (p < end) {
+    auto eol = static_cast<const char*>(memchr(p, '\n', end - p));
+    if (!eol) eol = end;
+
+    utxx::scope_exit advance([&]() {
+      p = eol + 1;
+      if (show_progress) {
+        auto pos = std::min<long>(p - base, file_size);
+        *show_progress += pos - file_pos;
+        file_pos = pos;
+      }
+    });
+
+    if (p == eol || *p == '#') continue;  // Empty line or a comment
+
+    Field fields[MAX_FIELDS];
+    int   nflds = SplitFields(p, eol, fields, MAX_FIELDS);
+
+    // The 19-field format contains 5 price levels rather than 3; skip the
+    // extra two levels (L4BVo,L5BVo and L4AVo,L5AVo) on lookup
+    bool  five_lvls = nflds == 19;
+
+    auto value = [&](MD a_fld) -> Field const& {
+      int i = int(a_fld);
+      if (five_lvls && i >= int(MD::Ask))
+        i += i >= int(MD::LstPx) ? 4 : 2;
+      return fields[i];
+    };
+
+    if (nflds != int(MD::SIZE) && !five_lvls) {
+      cerr << "Invalid record format (expected " << int(MD::SIZE)
+           << " fields, got " << nflds << "):\n  ";
+      cerr.write(p, eol - p);
+      cerr << endl;
+      continue;
+    }
+
+    auto msec = ToLong(value(MD::UTCTime));
+    time_val now(msec / 1000, (msec % 1000) * 1000);
+
+    if (!valid) {
+      time_val d = now - utxx::secs(now.sec() % 86400);
+
+      if (d.sec() != a_job.date.sec())
+        UTXX_THROW_RUNTIME_ERROR
+          ("Invalid date in file ", a_job.filename, " (expected: ",
+           utxx::timestamp::to_string(a_job.date, utxx::DATE_TIME),
+           ", got: ",
+           utxx::timestamp::to_string(now,        utxx::DATE_TIME), ')');
+
+      valid = true;
+
+      a_output.Open<OpenMode::Write>
+        (a_outdir, a_subdirs, a_xchg, a_job.symbol, a_job.instr, a_job.secid,
+         a_job.date, a_job.tz_name, a_job.tz_offset, 3, 0.05, 0664);
+
+      a_output.WriteStreamsMeta({StreamType::Quotes, StreamType::Trade});
+      // 1min candles from 9:00am to 15:00pm KST time
+      auto start_tm  =  9*3600 - a_output.TZOffset();
+      auto end_tm    = 15*3600 + 60 - a_output.TZOffset();
+      a_output.WriteCandlesMeta
+        ({CandleHeader(60, start_tm, end_tm)});
+
+      a_output.Flush();
+    }
+
+    float bid =       ToFloat(value(MD::Bid));
+    float ask =       ToFloat(value(MD::Ask));
+
+    auto bids = PxLevels<3, float>
+    {{
+        {bid        , ToInt(value(MD::L1BVo))}
+      , {bid - 0.05f, ToInt(value(MD::L2BVo))}
+      , {bid - 0.10f, ToInt(value(MD::L3BVo))}
+    }};
+    auto asks = PxLevels<3, float>
+    {{
+        {ask        , ToInt(value(MD::L1AVo))}
+      , {ask + 0.05f, ToInt(value(MD::L2AVo))}
+      , {ask + 0.10f, ToInt(value(MD::L3AVo))}
+    }};
+
+    float last_px  = ToFloat(value(MD::LstPx));
+    int   last_qty = ToInt  (value(MD::LstQty));
+
+    // Write the quote info
+    a_output.WriteQuotes<PriceUnit::DoubleVal>
+      (now, std::move(bids), 3, std::move(asks), 3);
+
+    if (last_qty != 0) {
+      // Write trade details
+      SideT side = last_qty < 0 ? SideT::Sell : SideT::Buy;
+      AggrT aggr = ((side == SideT::Buy  && abs(last_px - ask) < 0.001) ||
+                    (side == SideT::Sell && abs(last_px - bid) < 0.001))
+                 ? AggrT::Aggressor : AggrT::Passive;
+
+      a_output.WriteTrade<PriceUnit::DoubleVal>
+        (now, side, last_px, abs(last_qty), aggr, 0, 0);
+    }
+  }
+
+  a_output.Close();
+}
+
 //------------------------------------------------------------------------------
 int main(int argc, char* argv[])
 //------------------------------------------------------------------------------
@@ -101,9 +374,11 @@ int main(int argc, char* argv[])
   set_terminate(&UnhandledException);
 
   std::string filename;
+  std::string manifest;
   bool        quiet     = false;
   int         debug     = 0;
   bool        subdirs   = false;
+  int         threads   = std::thread::hardware_concurrency();
   std::string outdir;
   std::string xchg;
   std::string symbol;
@@ -113,11 +388,11 @@ int main(int argc, char* argv[])
   time_val    date;
   long        secid   = 0;
 
-  bool        valid   = false;
-
   utxx::opts_parser opts(argc, argv);
   while  (opts.next()) {
       if (opts.match("-f", "",           &filename)) continue;
+      if (opts.match("-M", "--manifest", &manifest)) continue;
+      if (opts.match("-j", "--threads",  &threads))  continue;
       if (opts.match("-d", "--debug"))             { debug++; continue; }
       if (opts.match("-q", "--quiet",    &quiet))    continue;
       if (opts.match("-o", "--dir",      &outdir))   continue;
@@ -142,159 +417,163 @@ int main(int argc, char* argv[])
       Usage(string("Invalid option: ") + opts());
   }
 
-  if (filename.empty()) Usage("Missing required option -f");
   if (xchg.empty())     Usage("Missing required option -x");
-  if (symbol.empty())   Usage("Missing required option -s");
-  if (instr.empty())    Usage("Missing required option -i");
-  if (!date)            Usage("Missing required option -y");
-  if (secid == 0)       Usage("Missing required option -n");
 
-  if (outdir.empty())   outdir = utxx::path::dirname(filename);
-
-  struct tm lt = {0};
-  time_t     t = date.sec();
+  if (manifest.empty()) {
+    if (filename.empty()) Usage("Missing required option -f");
+    if (symbol.empty())   Usage("Missing required option -s");
+    if (instr.empty())    Usage("Missing required option -i");
+    if (!date)            Usage("Missing required option -y");
+    if (secid == 0)       Usage("Missing required option -n");
+  } else {
+    if (!filename.empty())Usage("Options -f and -M are mutually exclusive");
+    if (outdir.empty())   Usage("Bulk mode requires -o|-O OutputDir");
+    if (threads < 1)      Usage("Invalid number of threads");
+  }
 
+  //----------------------------------------------------------------------------
+  // Shared time zone setup: resolve the zone's name and per-date UTC offset
+  // once on the main thread (localtime_r with a TZ override is not safe to
+  // run concurrently, and in bulk mode every worker needs the result)
+  //----------------------------------------------------------------------------
   bool have_tz = !tz.empty();
 
   if (have_tz)
     setenv("TZ", tz.c_str(), 1);
 
-  localtime_r(&t, &lt);
+  std::map<time_t, std::pair<std::string, long>> tz_cache;
 
-  if (have_tz && lt.tm_zone[0] == '\0')
-    UTXX_THROW_RUNTIME_ERROR("Invalid time zone ", tz);
-  else
-    tz = lt.tm_zone;
+  auto resolve_tz = [&](time_val a_date) {
+    auto it = tz_cache.find(a_date.sec());
+    if (it != tz_cache.end())
+      return it->second;
 
-  auto tz_offset = lt.tm_gmtoff;
+    struct tm lt = {0};
+    time_t     t = a_date.sec();
+    localtime_r(&t, &lt);
 
-  if (debug)
-    cerr << "UTC offset: " << tz_offset << "s (" << (tz_offset/3600) << "h) "
-         << tz << endl;
+    if (have_tz && lt.tm_zone[0] == '\0')
+      UTXX_THROW_RUNTIME_ERROR("Invalid time zone ", tz);
 
-  auto file = fopen(filename.c_str(), "r");
+    auto res = std::make_pair(std::string(lt.tm_zone), long(lt.tm_gmtoff));
 
-  if (!file) {
-    cerr << "Cannot open file " << filename << ": " << strerror(errno) << endl;
-    exit(1);
-  }
-
-  std::shared_ptr<boost::progress_display> show_progress;
+    if (debug)
+      cerr << "UTC offset: " << res.second << "s (" << (res.second/3600)
+           << "h) " << res.first << endl;
 
-  long file_size = utxx::path::file_size(filename);
-  long file_pos  = 0;
+    return tz_cache.emplace(a_date.sec(), std::move(res)).first->second;
+  };
 
-  BaseSDBFileIO<3> output;
+  //----------------------------------------------------------------------------
+  // Single-file mode
+  //----------------------------------------------------------------------------
+  if (manifest.empty()) {
+    if (outdir.empty())  outdir = utxx::path::dirname(filename);
 
-  output.Debug(debug);
+    ConvertJob job;
+    job.filename = filename;
+    job.symbol   = symbol;
+    job.instr    = instr;
+    job.secid    = secid;
+    job.date     = date;
 
-  auto out_name = output.Filename(outdir, subdirs, xchg, symbol, instr, secid, date);
-  utxx::path::file_unlink(out_name);
+    auto tzres    = resolve_tz(date);
+    job.tz_name   = tzres.first;
+    job.tz_offset = tzres.second;
 
-  if (!quiet) {
-    cerr << filename << " -> " << out_name << endl;
-    if (file_size > 0)
-      show_progress.reset(new boost::progress_display(file_size, cerr));
+    BaseSDBFileIO<3> output;
+    Convert(output, job, xchg, outdir, subdirs, quiet, debug);
+    return 0;
   }
 
-  char buf[512];
-
-  while (fgets(buf, sizeof(buf), file)) {
-    if (buf[0] == '#') continue;  // This is a comment
-
-    vector<string> fields;
-
-    auto value = [&](MD a_fld) { return fields[int(a_fld)]; };
-
-    boost::split(fields, buf, boost::is_any_of(" |"),
-        boost::algorithm::token_compress_on);
-
-    if (fields.size() == 19) {
-      // This is the format containing 5 price levels rather than 3.
-      // Throw out the extra two levels
-      fields.erase(fields.begin()+11, fields.begin()+13); // Remove L4AVo,L5AVo
-      fields.erase(fields.begin()+5,  fields.begin()+7);  // Remove L4BVo,L5BVo
+  //----------------------------------------------------------------------------
+  // Bulk mode: parse the manifest, then convert the entries on a worker pool
+  //----------------------------------------------------------------------------
+  std::vector<ConvertJob> jobs;
+  {
+    ifstream in(manifest);
+    if (!in)
+      UTXX_THROW_IO_ERROR(errno, "Cannot open manifest ", manifest);
+
+    string line;
+    int    lineno = 0;
+    while (getline(in, line)) {
+      lineno++;
+      auto pos = line.find('#');
+      if (pos != string::npos)
+        line.erase(pos);
+
+      istringstream ls(line);
+      ConvertJob    job;
+      string        dt;
+      if (!(ls >> job.filename))
+        continue;                       // Empty line or a comment
+      if (!(ls >> job.symbol >> job.instr >> job.secid >> dt) ||
+          dt.size() != 8)
+        UTXX_THROW_RUNTIME_ERROR
+          ("Invalid manifest entry at ", manifest, ':', lineno,
+           " (expected: InputFile Symbol Instr SecID YYYYMMDD)");
+
+      int y = stoi(dt.substr(0, 4));
+      int m = stoi(dt.substr(4, 2));
+      int d = stoi(dt.substr(6, 2));
+      job.date = utxx::time_val::universal_time(y, m, d, 0, 0, 0, 0);
+
+      auto tzres    = resolve_tz(job.date);
+      job.tz_name   = tzres.first;
+      job.tz_offset = tzres.second;
+
+      jobs.emplace_back(std::move(job));
     }
-    else if (fields.size() != int(MD::SIZE)) {
-      cerr << "Invalid record format (expected " << int(MD::SIZE)
-           << " fields, got " << fields.size() << "):\n  " << buf
-           << endl;
-      continue;
-    }
-
-    auto msec = stol(value(MD::UTCTime));
-    time_val now(msec / 1000, (msec % 1000) * 1000);
+  }
 
-    if (!valid) {
-      time_val d = now - utxx::secs(now.sec() % 86400);
+  if (jobs.empty()) {
+    cerr << "Manifest " << manifest << " has no entries" << endl;
+    return 0;
+  }
 
-      if (d.sec() != date.sec()) {
-        cerr << "Invalid date (expected: "
-             << utxx::timestamp::to_string(date, utxx::DATE_TIME)
-             << ", got: "
-             << utxx::timestamp::to_string(now,  utxx::DATE_TIME) << ")\n";
-        exit(1);
+  threads = std::min<int>(threads, jobs.size());
+
+  std::atomic<size_t> next(0);
+  std::atomic<size_t> failed(0);
+  std::mutex          log_mtx;
+
+  auto worker = [&]() {
+    // One writer per worker: its encode buffer is allocated once and reused
+    // by every file this worker converts
+    BaseSDBFileIO<3> output;
+
+    while (true) {
+      auto i = next.fetch_add(1, std::memory_order_relaxed);
+      if (i >= jobs.size())
+        break;
+      auto& job = jobs[i];
+      try {
+        // The per-file progress bar is meaningless with concurrent workers
+        Convert(output, job, xchg, outdir, subdirs, true, debug);
+        if (!quiet) {
+          std::lock_guard<std::mutex> guard(log_mtx);
+          cerr << '[' << (i+1) << '/' << jobs.size() << "] "
+               << job.filename << endl;
+        }
+      } catch (std::exception const& e) {
+        failed++;
+        output.Close();        // Leave the writer reusable for the next job
+        std::lock_guard<std::mutex> guard(log_mtx);
+        cerr << "Error converting " << job.filename << ": " << e.what() << endl;
       }
-
-      valid = true;
-
-      output.Open<OpenMode::Write>
-        (outdir, subdirs, xchg, symbol, instr, secid, date, tz, tz_offset,
-         3,      0.05,    0664);
-
-      output.WriteStreamsMeta({StreamType::Quotes, StreamType::Trade});
-      // 1min candles from 9:00am to 15:00pm KST time
-      auto start_tm  =  9*3600 - output.TZOffset();
-      auto end_tm    = 15*3600 + 60 - output.TZOffset();
-      output.WriteCandlesMeta
-        ({CandleHeader(60, start_tm, end_tm)});
-
-      output.Flush();
     }
+  };
 
-    float bid =       stof(value(MD::Bid));
-    float ask =       stof(value(MD::Ask));
-
-    auto bids = PxLevels<3, float>
-    {{
-        {bid        , stoi(value(MD::L1BVo))}
-      , {bid - 0.05f, stoi(value(MD::L2BVo))}
-      , {bid - 0.10f, stoi(value(MD::L3BVo))}
-    }};
-    auto asks = PxLevels<3, float>
-    {{
-        {ask        , stoi(value(MD::L1AVo))}
-      , {ask + 0.05f, stoi(value(MD::L2AVo))}
-      , {ask + 0.10f, stoi(value(MD::L3AVo))}
-    }};
-
-    float last_px  = stof(value(MD::LstPx));
-    int   last_qty = stoi(value(MD::LstQty));
-
-    // Write the quote info
-    output.WriteQuotes<PriceUnit::DoubleVal>
-      (now, std::move(bids), 3, std::move(asks), 3);
-
-    if (last_qty != 0) {
-      // Write trade details
-      SideT side = last_qty < 0 ? SideT::Sell : SideT::Buy;
-      AggrT aggr = ((side == SideT::Buy  && abs(last_px - ask) < 0.001) ||
-                    (side == SideT::Sell && abs(last_px - bid) < 0.001))
-                 ? AggrT::Aggressor : AggrT::Passive;
-
-      output.WriteTrade<PriceUnit::DoubleVal>
-        (now, side, last_px, abs(last_qty), aggr, 0, 0);
-    }
-
-    if (show_progress) {
-      auto pos = ftell(file);
-      auto len = pos - file_pos;
-      *show_progress += len;
-      file_pos = pos;
-    }
-  }
+  std::vector<std::thread> pool;
+  for (int i = 0; i < threads; ++i)
+    pool.emplace_back(worker);
+  for (auto& t : pool)
+    t.join();
 
-  output.Close();
+  if (!quiet)
+    cerr << "Converted " << (jobs.size() - failed) << '/' << jobs.size()
+         << " files" << (failed ? " (with errors)" : "") << endl;
 
-  return 0;
+  return failed ? 1 : 0;
 }
@@ -14,9 +14,15 @@
 #include <utxx/get_option.hpp>
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/progress.hpp>
 #include <iostream>
 #include <fstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <cstring>
+#include <fnmatch.h>
 
 using namespace std;
 using namespace sdb;
@@ -38,8 +44,15 @@ void Usage(std::string const& a_text = "")
        << "Usage: " << utxx::path::program::name()
        << " -f MDFilename [-o|-O OutputFile] [-d] [-q]\n"
        << "\nOptions:\n"
-       << "  -f MDFilename         - Filename with KRX market data\n"
-       << "  -o|--output OutFile   - Output filename (def: stdout)\n"
+       << "  -f MDFilename         - Filename with KRX market data, or a\n"
+       << "                          database directory to be scanned\n"
+       << "  -o|--output OutFile   - Output filename (def: stdout);\n"
+       << "                          output directory when -f is a directory\n"
+       << "  -g|--glob Pattern     - Only scan files matching this glob\n"
+       << "                          (e.g. 'KRX/KR4101/2015/*') when -f is a\n"
+       << "                          directory\n"
+       << "  -j|--threads N        - Number of parallel scan threads when -f\n"
+       << "                          is a directory (def: hardware threads)\n"
        << "  -d                    - Enable debug printouts\n"
        << "  -q                    - Quiet mode (don't display a progress bar)\n"
        << "  -m|--max-depth Levels - Limit max book depth to number of Levels\n"
@@ -57,6 +70,18 @@ void Usage(std::string const& a_text = "")
        << "  -I|--instr            - Include instrument name in the output\n"
        << "  -Q|--quotes           - Print quotes\n"
        << "  -T|--trades           - Print trades\n"
+       << "  --orders              - Print order actions\n"
+       << "  --summaries           - Print market/trading summaries\n"
+       << "  --msgs                - Print string messages\n"
+       << "  -B|--binary           - Columnar binary output instead of text:\n"
+       << "                          quote/trade fields are written as packed\n"
+       << "                          little-endian column arrays in record\n"
+       << "                          batches (see BinWriter below), so the\n"
+       << "                          output loads with a single mmap and no\n"
+       << "                          parsing.  Applies to -Q and -T streams\n"
+       << "  --stats               - Report I/O statistics (decode counters and\n"
+       << "                          latency histograms) to stderr after the\n"
+       << "                          scan.  Requires a build with WITH_STATS\n"
        << "  -A|--aggr-qty Levels  - Print aggregated quantity of number of Levels\n"
        << "  -F|--fixed-cols       - Print fixed number of price/qty columns\n"
        << "  -C|--candles Resol    - Print candles of given resolution\n"
@@ -64,6 +89,11 @@ void Usage(std::string const& a_text = "")
        << "                               N - resolution interval\n"
        << "                               y - (s)econds, (m)inutes, (h)ours\n"
        << "                          Example: 10m - ten minutes, 1h - one hour\n"
+       << "  -R|--recompute-candles Resol\n"
+       << "                        - Rebuild and print candles of the given\n"
+       << "                          resolution (same Ny format) from the\n"
+       << "                          trade stream, regardless of resolutions\n"
+       << "                          configured at capture time\n"
        << "\n";
   exit(1);
 }
@@ -77,6 +107,67 @@ void UnhandledException() {
   exit(1);
 }
 
+//------------------------------------------------------------------------------
+/// Chunked output buffer: formatted records accumulate here and are written
+/// to the underlying stream in large blocks ('\n', not endl - no per-record
+/// flush), with integer fixed-point price formatting via FormatPx()
+//------------------------------------------------------------------------------
+struct OutBuf {
+  explicit OutBuf(ostream& a_out) : m_out(a_out) { m_buf.resize(CHUNK()); }
+  ~OutBuf() { Flush(); }
+
+  static constexpr size_t CHUNK() { return 256*1024; }
+
+  void Flush() {
+    if (m_size) { m_out.write(&m_buf[0], m_size); m_size = 0; }
+  }
+
+  void Put(char a) {
+    if (utxx::unlikely(m_size + 1 > m_buf.size())) Flush();
+    m_buf[m_size++] = a;
+  }
+
+  void Put(const char* a_str, size_t a_sz) {
+    if (m_size + a_sz > m_buf.size()) {
+      Flush();
+      if (utxx::unlikely(a_sz > m_buf.size())) { m_out.write(a_str,a_sz); return; }
+    }
+    memcpy(&m_buf[m_size], a_str, a_sz);
+    m_size += a_sz;
+  }
+
+  void Put(const char*        a_str) { Put(a_str, strlen(a_str));      }
+  void Put(std::string const& a_str) { Put(a_str.data(), a_str.size());}
+
+  void Int(long a_val) {
+    char tmp[24];
+    bool neg = a_val < 0;
+    auto v   = neg ? ulong(-a_val) : ulong(a_val);
+    int  n   = 0;
+    do    { tmp[n++] = char('0' + v % 10); v /= 10; } while (v);
+    if (neg) Put('-');
+    while (n) Put(tmp[--n]);
+  }
+
+  /// Price in integer price steps formatted as a fixed-point decimal
+  void Px(long a_px, int a_scale, int a_precision) {
+    if (utxx::unlikely(m_size + 32 > m_buf.size())) Flush();
+    m_size += FormatPx(&m_buf[m_size], a_px, a_scale, a_precision);
+  }
+
+  void Dbl(double a_val) {
+    char tmp[32];
+    Put(tmp, snprintf(tmp, sizeof(tmp), "%g", a_val));
+  }
+
+  void Eol() { Put('\n'); }
+
+private:
+  ostream&          m_out;
+  std::vector<char> m_buf;
+  size_t            m_size = 0;
+};
+
 //------------------------------------------------------------------------------
 struct Printer {
   Printer
@@ -116,25 +207,32 @@ struct Printer {
     auto       res = a_time_fmt == utxx::DATE_TIME_WITH_MSEC ? "(ms)" : "(us)";
 
     if (quotes) {
-      m_out << "#" << (m_tz_local ? "Local" : "UTC") << "Time" << res << m_delim;
-      if (m_qt_indicator   ) m_out << "Q"         << m_delim;
-      if (!m_xchg.empty()  ) m_out << "Xchg"      << m_delim;
-      if (!m_symbol.empty()) m_out << "Symbol"    << m_delim;
-      if (!m_instr.empty() ) m_out << "Insrument" << m_delim;
-      m_out << "Bids"   << m_delim << "Asks";
-      if (m_agg_qty > 0)     m_out << m_delim
-                                   << "Bid" << m_agg_qty << "Qty" << m_delim
-                                   << "Ask" << m_agg_qty << "Qty";
-      m_out << endl;
+      m_out.Put('#'); m_out.Put(m_tz_local ? "Local" : "UTC");
+      m_out.Put("Time"); m_out.Put(res); m_out.Put(m_delim);
+      if (m_qt_indicator   ) { m_out.Put('Q');         m_out.Put(m_delim); }
+      if (!m_xchg.empty()  ) { m_out.Put("Xchg");      m_out.Put(m_delim); }
+      if (!m_symbol.empty()) { m_out.Put("Symbol");    m_out.Put(m_delim); }
+      if (!m_instr.empty() ) { m_out.Put("Insrument"); m_out.Put(m_delim); }
+      m_out.Put("Bids"); m_out.Put(m_delim); m_out.Put("Asks");
+      if (m_agg_qty > 0) {
+        m_out.Put(m_delim);
+        m_out.Put("Bid"); m_out.Int(m_agg_qty); m_out.Put("Qty");
+        m_out.Put(m_delim);
+        m_out.Put("Ask"); m_out.Int(m_agg_qty); m_out.Put("Qty");
+      }
+      m_out.Eol();
     }
     if (trades) {
-      m_out << '#' << (m_tz_local ? "Local" : "UTC") << "Time" << res << m_delim;
-      if (m_qt_indicator   ) m_out << "T"         << m_delim;
-      if (!m_xchg.empty()  ) m_out << "Xchg"      << m_delim;
-      if (!m_symbol.empty()) m_out << "Symbol"    << m_delim;
-      if (!m_instr.empty() ) m_out << "Insrument" << m_delim;
-      m_out << "Side"   << m_delim << "Price"     << "Qty" << m_delim
-            << "TradeID"<< m_delim << "OrderID"   << endl;
+      m_out.Put('#'); m_out.Put(m_tz_local ? "Local" : "UTC");
+      m_out.Put("Time"); m_out.Put(res); m_out.Put(m_delim);
+      if (m_qt_indicator   ) { m_out.Put('T');         m_out.Put(m_delim); }
+      if (!m_xchg.empty()  ) { m_out.Put("Xchg");      m_out.Put(m_delim); }
+      if (!m_symbol.empty()) { m_out.Put("Symbol");    m_out.Put(m_delim); }
+      if (!m_instr.empty() ) { m_out.Put("Insrument"); m_out.Put(m_delim); }
+      m_out.Put("Side");    m_out.Put(m_delim); m_out.Put("Price");
+      m_out.Put("Qty");     m_out.Put(m_delim);
+      m_out.Put("TradeID"); m_out.Put(m_delim); m_out.Put("OrderID");
+      m_out.Eol();
     }
   }
 
@@ -144,45 +242,35 @@ struct Printer {
 
   bool operator()(QuoteSample<SDBFileIO::MAX_DEPTH(), int> const& a) {
     if ((m_stream_mask & (1 << int(StreamType::Quotes))) != 0) {
-      if (m_epoch)
-        m_out << (m_msec ? m_file.Time().milliseconds()
-                         : m_file.Time().microseconds());
-      else {
-        auto time = m_tz_local
-                  ? (m_file.Time() + utxx::secs(m_file.Info().TZOffset()))
-                  : m_file.Time();
-        m_out << utxx::timestamp::to_string(time, m_datefmt, true);
-      }
+      PrintTime();
 
-      m_out << m_delim;
-      if (m_qt_indicator)    m_out << "Q"      << m_delim;
-      if (!m_xchg.empty())   m_out << m_xchg   << m_delim;
-      if (!m_symbol.empty()) m_out << m_symbol << m_delim;
-      if (!m_instr.empty())  m_out << m_instr  << m_delim;
+      m_out.Put(m_delim);
+      if (m_qt_indicator)    { m_out.Put('Q');      m_out.Put(m_delim); }
+      if (!m_xchg.empty())   { m_out.Put(m_xchg);   m_out.Put(m_delim); }
+      if (!m_symbol.empty()) { m_out.Put(m_symbol); m_out.Put(m_delim); }
+      if (!m_instr.empty())  { m_out.Put(m_instr);  m_out.Put(m_delim); }
       int i = 0;
       auto eb = a.EndBid();
       auto ea = a.EndAsk();
       for (auto p = a.BestBid(); p != eb && i < m_max_depth; a.NextBid(p), ++i) {
-        if (i) m_out << m_px_delim;
-        if (!m_px_only) m_out << p->m_qty << m_qty_delim;
-        m_out << std::setprecision(m_file.PxPrecision()) << std::fixed
-              << (m_file.PxStep() * p->m_px);
+        if (i) m_out.Put(m_px_delim);
+        if (!m_px_only) { m_out.Int(p->m_qty); m_out.Put(m_qty_delim); }
+        m_out.Px(p->m_px, m_file.PxScale(), m_file.PxPrecision());
       }
       if (m_fixed_cols)
-        while (i++ < m_max_depth) m_out << m_px_delim;
+        while (i++ < m_max_depth) m_out.Put(m_px_delim);
 
-      m_out << m_delim;
+      m_out.Put(m_delim);
 
       i = 0;
       for (auto p = a.BestAsk(); p != ea && i < m_max_depth; a.NextAsk(p), ++i) {
-        if (i) m_out << m_px_delim;
-        if (!m_px_only) m_out << p->m_qty << m_qty_delim;
-        m_out << std::setprecision(m_file.PxPrecision()) << std::fixed
-              << (m_file.PxStep() * p->m_px);
+        if (i) m_out.Put(m_px_delim);
+        if (!m_px_only) { m_out.Int(p->m_qty); m_out.Put(m_qty_delim); }
+        m_out.Px(p->m_px, m_file.PxScale(), m_file.PxPrecision());
       }
 
       if (m_fixed_cols)
-        while (i++ < m_max_depth) m_out << m_px_delim;
+        while (i++ < m_max_depth) m_out.Put(m_px_delim);
 
       if (m_agg_qty) {
         long bid_qty = 0, ask_qty = 0;
@@ -192,38 +280,83 @@ struct Printer {
         i = 0;
         for (auto p = a.BestAsk(); p != ea && i < m_agg_qty; a.NextAsk(p), ++i)
           ask_qty += p->m_qty;
-        m_out << m_delim << bid_qty << m_delim << ask_qty;
+        m_out.Put(m_delim); m_out.Int(bid_qty);
+        m_out.Put(m_delim); m_out.Int(ask_qty);
       }
-      m_out << endl;
+      m_out.Eol();
     }
     return true;
   }
 
   bool operator()(TradeSample const& a_trade) {
     if ((m_stream_mask & (1 << int(StreamType::Trade))) != 0) {
-      if (m_epoch)
-        m_out << (m_msec ? m_file.Time().milliseconds()
-                         : m_file.Time().microseconds());
-      else {
-        auto time = m_tz_local
-                  ? (m_file.Time() + utxx::secs(m_file.Info().TZOffset()))
-                  : m_file.Time();
-        m_out << utxx::timestamp::to_string(time, m_datefmt, true);
-      }
+      PrintTime();
+
+      m_out.Put(m_delim);
+      if (m_qt_indicator)    { m_out.Put('T');      m_out.Put(m_delim); }
+      if (!m_symbol.empty()) { m_out.Put(m_symbol); m_out.Put(m_delim); }
+      if (!m_instr.empty())  { m_out.Put(m_instr);  m_out.Put(m_delim); }
+      m_out.Put(ToChar(a_trade.Side()));
+      m_out.Put(m_delim);
+      m_out.Px (a_trade.Price(), m_file.PxScale(), m_file.PxPrecision());
+      m_out.Put(m_delim);
+      m_out.Int(a_trade.Qty());
+      m_out.Put(m_delim);
+      m_out.Put(ToChar(a_trade.Aggr()));
+      m_out.Put(m_delim);
+      if (a_trade.HasTradeID()) m_out.Int(a_trade.TradeID());
+      m_out.Put(m_delim);
+      if (a_trade.HasOrderID()) m_out.Int(a_trade.OrderID());
+      m_out.Eol();
+    }
+    return true;
+  }
 
-      m_out << m_delim;
-      if (m_qt_indicator)    m_out << "T"      << m_delim;
-      if (!m_symbol.empty()) m_out << m_symbol << m_delim;
-      if (!m_instr.empty())  m_out << m_instr  << m_delim;
-      m_out << ToChar(a_trade.Side())          << m_delim
-            << std::setprecision(m_file.PxPrecision()) << std::fixed
-            << (m_file.PxStep() * a_trade.Price())
-            << m_delim << a_trade.Qty() << m_delim << ToChar(a_trade.Aggr())
-            << m_delim;
-      if (a_trade.HasTradeID()) m_out << a_trade.TradeID();
-      m_out << m_delim;
-      if (a_trade.HasOrderID()) m_out << a_trade.OrderID();
-      m_out << endl;
+  bool operator()(OrderSample const& a_order) {
+    if ((m_stream_mask & (1 << int(StreamType::Order))) != 0) {
+      PrintTime();
+      m_out.Put(m_delim); m_out.Put('O'); m_out.Put(m_delim);
+      if (!m_symbol.empty()) { m_out.Put(m_symbol); m_out.Put(m_delim); }
+      if (!m_instr.empty())  { m_out.Put(m_instr);  m_out.Put(m_delim); }
+      m_out.Put(ToChar(a_order.Action()));
+      m_out.Put(m_delim);
+      m_out.Put(ToChar(a_order.Side()));
+      m_out.Put(m_delim);
+      m_out.Int(a_order.OrderID());
+      m_out.Put(m_delim);
+      if (a_order.HasPx())
+        m_out.Px(a_order.Price(), m_file.PxScale(), m_file.PxPrecision());
+      m_out.Put(m_delim);
+      if (a_order.HasQty()) m_out.Int(a_order.Qty());
+      m_out.Eol();
+    }
+    return true;
+  }
+
+  bool operator()(SummarySample const& a_sum) {
+    if ((m_stream_mask & (1 << int(StreamType::Summary))) != 0) {
+      PrintTime();
+      m_out.Put(m_delim); m_out.Put('S'); m_out.Put(m_delim);
+      if (!m_symbol.empty()) { m_out.Put(m_symbol); m_out.Put(m_delim); }
+      if (!m_instr.empty())  { m_out.Put(m_instr);  m_out.Put(m_delim); }
+      if (a_sum.HasBidQty())  m_out.Int(a_sum.BidQty());
+      m_out.Put(m_delim);
+      if (a_sum.HasAskQty())  m_out.Int(a_sum.AskQty());
+      m_out.Put(m_delim);
+      if (a_sum.HasOpenPos()) m_out.Int(a_sum.OpenPos());
+      m_out.Put(m_delim);
+      if (a_sum.HasRisk())    m_out.Dbl(a_sum.Risk());
+      m_out.Eol();
+    }
+    return true;
+  }
+
+  bool operator()(MessageSample const& a_msg) {
+    if ((m_stream_mask & (1 << int(StreamType::Message))) != 0) {
+      PrintTime();
+      m_out.Put(m_delim); m_out.Put('M'); m_out.Put(m_delim);
+      m_out.Put(a_msg.Msg());
+      m_out.Eol();
     }
     return true;
   }
@@ -235,8 +368,20 @@ struct Printer {
   }
 
 private:
+  void PrintTime() {
+    if (m_epoch)
+      m_out.Int(m_msec ? m_file.Time().milliseconds()
+                       : m_file.Time().microseconds());
+    else {
+      auto time = m_tz_local
+                ? (m_file.Time() + utxx::secs(m_file.Info().TZOffset()))
+                : m_file.Time();
+      m_out.Put(utxx::timestamp::to_string(time, m_datefmt, true));
+    }
+  }
+
   SDBFileIO&        m_file;
-  ostream&          m_out;
+  OutBuf            m_out;
   uint              m_stream_mask;
   bool              m_msec;
   utxx::stamp_type  m_datefmt;
@@ -255,6 +400,176 @@ private:
   bool              m_fixed_cols;
 };
 
+//------------------------------------------------------------------------------
+/// Columnar binary export (option -B|--binary)
+///
+/// Decoded quote/trade fields are accumulated in column vectors and written
+/// as packed little-endian record batches, so the research side loads them
+/// with a single mmap (numpy.frombuffer et al) and zero parsing:
+///
+///   FileHeader (32 bytes):
+///     u32  magic      "SDBX" (0x58424453)
+///     u32  version    (1)
+///     i64  date       midnight UTC of the file, seconds since epoch
+///     f64  px_step    price step (px columns are in integer px steps)
+///     i32  tz_offset  local time zone offset, seconds
+///     u32  depth      book depth D of the quote batches
+///   Followed by record batches:
+///     u32  kind       1=quotes, 2=trades
+///     u32  count      number of rows N
+///     kind 1: u64 ts[N] (usec since epoch); u8 nbid[N]; u8 nask[N];
+///             i32 bid_px[N*D]; i32 bid_qty[N*D];
+///             i32 ask_px[N*D]; i32 ask_qty[N*D]
+///             (level arrays are row-major - reshape(N, D); unused levels 0)
+///     kind 2: u64 ts[N]; i32 px[N]; i32 qty[N];
+///             i8 side[N]; i8 aggr[N] (same ASCII codes as the text output);
+///             u64 trade_id[N]; u64 order_id[N] (0 when absent)
+///   Each column is zero-padded to an 8-byte boundary
+//------------------------------------------------------------------------------
+struct BinWriter {
+  static constexpr uint32_t MAGIC()   { return 0x58424453; }
+  static constexpr uint32_t VERSION() { return 1;          }
+  /// Rows buffered per record batch
+  static constexpr size_t   BATCH()   { return 64*1024;    }
+
+  BinWriter(SDBFileIO& a_file, ostream& a_out, uint a_stream_mask, int a_depth)
+    : m_file (a_file)
+    , m_out  (a_out)
+    , m_stream_mask(a_stream_mask)
+    , m_depth(std::min<int>(a_depth, a_file.Info().Depth()))
+  {
+    char  hdr[32];
+    char* p = hdr;
+    utxx::put32le(p, MAGIC());
+    utxx::put32le(p, VERSION());
+    utxx::put64le(p, uint64_t(m_file.Info().Date()));
+    double step = m_file.Info().PxStep();
+    memcpy(p, &step, sizeof(step));
+    p += sizeof(step);
+    utxx::put32le(p, uint32_t(m_file.Info().TZOffset()));
+    utxx::put32le(p, uint32_t(m_depth));
+    m_out.write(hdr, sizeof(hdr));
+  }
+
+  ~BinWriter() { FlushQuotes(); FlushTrades(); }
+
+  bool operator()(SecondsSample const& a_sec) { return true; }
+
+  bool operator()(QuoteSample<SDBFileIO::MAX_DEPTH(), int> const& a) {
+    if ((m_stream_mask & (1u << int(StreamType::Quotes))) == 0)
+      return true;
+
+    m_q_ts.push_back(uint64_t(m_file.Time().microseconds()));
+
+    auto base = m_q_bid_px.size();
+    m_q_bid_px .resize(base + m_depth, 0);
+    m_q_bid_qty.resize(base + m_depth, 0);
+    m_q_ask_px .resize(base + m_depth, 0);
+    m_q_ask_qty.resize(base + m_depth, 0);
+
+    int  nb = 0, na = 0;
+    auto eb = a.EndBid();
+    auto ea = a.EndAsk();
+    for (auto p = a.BestBid(); p != eb && nb < m_depth; a.NextBid(p), ++nb) {
+      m_q_bid_px [base + nb] = p->m_px;
+      m_q_bid_qty[base + nb] = p->m_qty;
+    }
+    for (auto p = a.BestAsk(); p != ea && na < m_depth; a.NextAsk(p), ++na) {
+      m_q_ask_px [base + na] = p->m_px;
+      m_q_ask_qty[base + na] = p->m_qty;
+    }
+    m_q_nbid.push_back(uint8_t(nb));
+    m_q_nask.push_back(uint8_t(na));
+
+    if (m_q_ts.size() >= BATCH())
+      FlushQuotes();
+    return true;
+  }
+
+  bool operator()(TradeSample const& a) {
+    if ((m_stream_mask & (1u << int(StreamType::Trade))) == 0)
+      return true;
+
+    m_t_ts  .push_back(uint64_t(m_file.Time().microseconds()));
+    m_t_px  .push_back(a.Price());
+    m_t_qty .push_back(a.Qty());
+    m_t_side.push_back(ToChar(a.Side()));
+    m_t_aggr.push_back(ToChar(a.Aggr()));
+    m_t_tid .push_back(a.HasTradeID() ? uint64_t(a.TradeID()) : 0);
+    m_t_oid .push_back(a.HasOrderID() ? uint64_t(a.OrderID()) : 0);
+
+    if (m_t_ts.size() >= BATCH())
+      FlushTrades();
+    return true;
+  }
+
+  template <typename T>
+  bool operator()(T const& a_other) { return true; }
+
+private:
+  void WriteCol(const void* a_data, size_t a_bytes) {
+    static const char s_pad[8] = {0};
+    m_out.write(static_cast<const char*>(a_data), a_bytes);
+    if (a_bytes & 7)
+      m_out.write(s_pad, 8 - (a_bytes & 7));
+  }
+
+  void WriteBatchHdr(uint32_t a_kind, size_t a_count) {
+    char  hdr[8];
+    char* p = hdr;
+    utxx::put32le(p, a_kind);
+    utxx::put32le(p, uint32_t(a_count));
+    m_out.write(hdr, sizeof(hdr));
+  }
+
+  void FlushQuotes() {
+    if (m_q_ts.empty())
+      return;
+    WriteBatchHdr(1, m_q_ts.size());
+    WriteCol(&m_q_ts     [0], m_q_ts     .size() * sizeof(uint64_t));
+    WriteCol(&m_q_nbid   [0], m_q_nbid   .size());
+    WriteCol(&m_q_nask   [0], m_q_nask   .size());
+    WriteCol(&m_q_bid_px [0], m_q_bid_px .size() * sizeof(int32_t));
+    WriteCol(&m_q_bid_qty[0], m_q_bid_qty.size() * sizeof(int32_t));
+    WriteCol(&m_q_ask_px [0], m_q_ask_px .size() * sizeof(int32_t));
+    WriteCol(&m_q_ask_qty[0], m_q_ask_qty.size() * sizeof(int32_t));
+    m_q_ts.clear();      m_q_nbid.clear();    m_q_nask.clear();
+    m_q_bid_px.clear();  m_q_bid_qty.clear();
+    m_q_ask_px.clear();  m_q_ask_qty.clear();
+  }
+
+  void FlushTrades() {
+    if (m_t_ts.empty())
+      return;
+    WriteBatchHdr(2, m_t_ts.size());
+    WriteCol(&m_t_ts  [0], m_t_ts .size() * sizeof(uint64_t));
+    WriteCol(&m_t_px  [0], m_t_px .size() * sizeof(int32_t));
+    WriteCol(&m_t_qty [0], m_t_qty.size() * sizeof(int32_t));
+    WriteCol(&m_t_side[0], m_t_side.size());
+    WriteCol(&m_t_aggr[0], m_t_aggr.size());
+    WriteCol(&m_t_tid [0], m_t_tid.size() * sizeof(uint64_t));
+    WriteCol(&m_t_oid [0], m_t_oid.size() * sizeof(uint64_t));
+    m_t_ts.clear();   m_t_px.clear();   m_t_qty.clear();
+    m_t_side.clear(); m_t_aggr.clear();
+    m_t_tid.clear();  m_t_oid.clear();
+  }
+
+  SDBFileIO&            m_file;
+  ostream&              m_out;
+  uint                  m_stream_mask;
+  int                   m_depth;
+
+  std::vector<uint64_t> m_q_ts;
+  std::vector<uint8_t>  m_q_nbid,   m_q_nask;
+  std::vector<int32_t>  m_q_bid_px, m_q_bid_qty;
+  std::vector<int32_t>  m_q_ask_px, m_q_ask_qty;
+
+  std::vector<uint64_t> m_t_ts;
+  std::vector<int32_t>  m_t_px,   m_t_qty;
+  std::vector<int8_t>   m_t_side, m_t_aggr;
+  std::vector<uint64_t> m_t_tid,  m_t_oid;
+};
+
 //------------------------------------------------------------------------------
 int main(int argc, char* argv[])
 //------------------------------------------------------------------------------
@@ -282,9 +597,15 @@ int main(int argc, char* argv[])
   char        px_delim    = ' ';
   char        qty_delim   = '@';
   bool        fixed_cols  = false;
+  bool        binary      = false;
+  bool        stats       = false;
   std::string outfile;
   std::string sresol;
+  std::string rresol;
+  std::string glob;
+  int         threads     = std::thread::hardware_concurrency();
   int         resol       = 0;
+  int         rc_resol    = 0;
   uint        stream_mask = 0;
 
   //----------------------------------------------------------------------------
@@ -301,6 +622,8 @@ int main(int argc, char* argv[])
       if (opts.match("-p", "--px-only",      &px_only)) continue;
       if (opts.match("-A", "--aggr-qty",     &agg_qty)) continue;
       if (opts.match("-o", "--output",       &outfile)) continue;
+      if (opts.match("-g", "--glob",            &glob)) continue;
+      if (opts.match("-j", "--threads",      &threads)) continue;
       if (opts.match("-S", "--symbol",   &with_symbol)) continue;
       if (opts.match("-X", "--xchg",       &with_xchg)) continue;
       if (opts.match("-I", "--instr",     &with_instr)) continue;
@@ -308,6 +631,8 @@ int main(int argc, char* argv[])
       if (opts.match("",   "--px-delim",    &px_delim)) continue;
       if (opts.match("",   "--qty-delim",  &qty_delim)) continue;
       if (opts.match("-F", "--fixed-cols",&fixed_cols)) continue;
+      if (opts.match("-B", "--binary",        &binary)) continue;
+      if (opts.match("",   "--stats",          &stats)) continue;
       if (opts.match("",   "--epoch",          &epoch)) continue;
       if (opts.match("-z", "--tz-local",    &tz_local)) continue;
       if (opts.match("-Z", "--tz-utc"))   { tz_local=0; continue; }
@@ -320,28 +645,162 @@ int main(int argc, char* argv[])
         stream_mask |= 1u << int(StreamType::Trade);
         continue;
       }
+      if (opts.match("", "--orders")) {
+        stream_mask |= 1u << int(StreamType::Order);
+        continue;
+      }
+      if (opts.match("", "--summaries")) {
+        stream_mask |= 1u << int(StreamType::Summary);
+        continue;
+      }
+      if (opts.match("", "--msgs")) {
+        stream_mask |= 1u << int(StreamType::Message);
+        continue;
+      }
       if (opts.match("-C", "--candles", &sresol))     continue;
+      if (opts.match("-R", "--recompute-candles", &rresol)) continue;
 
       if (opts.is_help()) Usage();
 
       Usage(string("Invalid option: ") + opts());
   }
 
+  auto parse_resol = [](std::string const& a_resol) {
+    int  res = 0;
+    auto s   = utxx::fast_atoi<int, false>
+               (a_resol.c_str(), a_resol.c_str()+a_resol.size(), res);
+    if (!s || res < 1 || res > 60)
+      UTXX_THROW_RUNTIME_ERROR("Invalid candle resolution requested: ", res);
+
+    if      (toupper(*s) == 'S') res *= 1;
+    else if (toupper(*s) == 'M') res *= 60;
+    else if (toupper(*s) == 'H') res *= 3600;
+    else UTXX_THROW_RUNTIME_ERROR("Invalid candle resolution: ", res);
+    return res;
+  };
+
   if (epoch && tz_local)  Usage("Epoch timestamps can't be in local time zone");
   if (filename.empty())   Usage("Missing required option -f");
+  if (binary && (info || !sresol.empty() || !rresol.empty()))
+    Usage("Option -B applies to sample output only (-Q|-T)");
+  if (binary && !stream_mask)
+    Usage("Option -B requires -Q and/or -T");
   if (!info) {
     if (!stream_mask && !sresol.empty())  Usage("Missing -Q|-T|-C");
-    if (!sresol.empty()) {
-      auto s =  utxx::fast_atoi<int, false>
-                (sresol.c_str(), sresol.c_str()+sresol.size(), resol);
-      if (!s || resol < 1 || resol > 60)
-        UTXX_THROW_RUNTIME_ERROR("Invalid candle resolution requested: ", resol);
-
-      if      (toupper(*s) == 'S') resol *= 1;
-      else if (toupper(*s) == 'M') resol *= 60;
-      else if (toupper(*s) == 'H') resol *= 3600;
-      else UTXX_THROW_RUNTIME_ERROR("Invalid candle resolution: ", resol);
+    if (!sresol.empty()) resol    = parse_resol(sresol);
+    if (!rresol.empty()) rc_resol = parse_resol(rresol);
+  }
+
+  //----------------------------------------------------------------------------
+  // Directory mode: enumerate matching .sdb files, scan them on a thread pool
+  //----------------------------------------------------------------------------
+  namespace fs = boost::filesystem;
+
+  if (fs::is_directory(filename)) {
+    if (outfile.empty() || outfile == "-")
+      Usage("Scanning a directory requires -o OutputDir");
+    if (info || resol)
+      Usage("Options -i and -C are not supported in directory mode");
+
+    auto root = filename;
+    while (!root.empty() && root.back() == '/') root.pop_back();
+
+    std::vector<std::string> files;
+
+    for (fs::recursive_directory_iterator it(root), end; it != end; ++it) {
+      if (!fs::is_regular_file(it->status()) ||
+          it->path().extension() != ".sdb")
+        continue;
+      auto rel = it->path().string().substr(root.size()+1);
+      if (!glob.empty() && fnmatch(glob.c_str(), rel.c_str(), 0) != 0)
+        continue;
+      files.push_back(it->path().string());
     }
+
+    std::sort(files.begin(), files.end());
+
+    if (!quiet)
+      cerr << "Scanning " << files.size() << " files using "
+           << threads << " threads" << endl;
+
+    if (threads < 1)
+      threads = 1;
+
+    std::atomic<size_t> next(0);
+    std::mutex          stats_mtx;  // Serializes the per-file --stats reports
+
+    auto worker = [&]() {
+      while (true) {
+        auto i = next.fetch_add(1);
+        if  (i >= files.size())
+          break;
+
+        auto& in  = files[i];
+        auto  rel = in.substr(root.size()+1);
+        auto  out_name = outfile + '/' + rel + (binary ? ".sdbx" : ".txt");
+        auto  dir = utxx::path::dirname(out_name);
+
+        if (!utxx::path::create_directories(dir))
+          UTXX_THROW_IO_ERROR(errno, "Cannot create directory ", dir);
+
+        auto  os_mode = std::ios_base::out | std::ios_base::trunc;
+        if (binary)
+          os_mode |= std::ios_base::binary;
+        ofstream os(out_name, os_mode);
+        if (!os.is_open())
+          UTXX_THROW_IO_ERROR(errno, "Cannot create output file ", out_name);
+
+        SDBFileIO input(in, debug);
+
+        if (rc_resol) {
+          // Candle recomputation parallelizes across files naturally:
+          // each worker makes its own streaming pass
+          input.RecomputeCandles(rc_resol);
+          input.PrintCandles(os, rc_resol);
+          continue;
+        }
+
+        if (binary) {
+          BinWriter writer(input, os, stream_mask, max_depth);
+          input.Read(writer);
+          if (stats) {
+            std::lock_guard<std::mutex> guard(stats_mtx);
+            cerr << rel << ":\n";
+            input.Stats().Print(cerr);
+          }
+          continue;
+        }
+
+        auto date_fmt =  fulldate &&  msec_time ? utxx::DATE_TIME_WITH_MSEC
+                      :  fulldate && !msec_time ? utxx::DATE_TIME_WITH_USEC
+                      : !fulldate &&  msec_time ? utxx::TIME_WITH_MSEC
+                      : utxx::TIME_WITH_USEC;
+
+        Printer printer
+        (
+          input, os, stream_mask, msec_time, date_fmt,
+          with_xchg   ? input.Info().Exchange()   : "",
+          with_symbol ? input.Info().Symbol()     : "",
+          with_instr  ? input.Info().Instrument() : "",
+          tz_local, epoch, max_depth, px_only, agg_qty, fixed_cols,
+          delim, px_delim, qty_delim
+        );
+        input.Read(printer);
+        if (stats) {
+          std::lock_guard<std::mutex> guard(stats_mtx);
+          cerr << rel << ":\n";
+          input.Stats().Print(cerr);
+        }
+      }
+    };
+
+    std::vector<std::thread> pool;
+    for (int i = 0; i < threads; ++i)
+      pool.emplace_back(worker);
+    for (auto& t : pool)
+      t.join();
+
+    return 0;
   }
 
   auto file = fopen(filename.c_str(), "r");
@@ -389,9 +848,15 @@ int main(int argc, char* argv[])
     if (info) {
       if (!debug)
         input.Info().Print(std::cout);
+    } else if (rc_resol) {
+      input.RecomputeCandles(rc_resol);
+      input.PrintCandles(cout, rc_resol);
     } else if (resol)
       input.PrintCandles(out, resol);
-    else {
+    else if (binary) {
+      BinWriter writer(input, cout, stream_mask, max_depth);
+      input.Read(writer);
+    } else {
       auto date_fmt =  fulldate &&  msec_time ? utxx::DATE_TIME_WITH_MSEC
                     :  fulldate && !msec_time ? utxx::DATE_TIME_WITH_USEC
                     : !fulldate &&  msec_time ? utxx::TIME_WITH_MSEC
@@ -408,6 +873,13 @@ int main(int argc, char* argv[])
       );
       input.Read(printer);
     }
+
+    if (stats) {
+#ifndef SDB_HAVE_STATS
+      cerr << "Warning: statistics support is not compiled in (WITH_STATS)\n";
+#endif
+      input.Stats().Print(cerr);
+    }
   }
 
   if (coutbuf)
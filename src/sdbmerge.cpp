@@ -0,0 +1,255 @@
+// vim:ts=2:sw=2:et
+//------------------------------------------------------------------------------
+/// \file  sdbmerge.cpp
+//------------------------------------------------------------------------------
+/// \brief Streaming k-way merge of SDB files into a consolidated tape
+///
+/// The same instrument captured on multiple venues lives in multiple .sdb
+/// files; a consolidated tape requires merging them by timestamp.  sdbmerge
+/// opens N inputs, pulls one sample at a time from each through an SDBCursor
+/// (the per-file decoder state - time and delta-price chains - stays inside
+/// the file objects) and emits the smallest timestamp first, re-encoding
+/// quotes and trades against the merged stream's own delta chains.  Memory
+/// is bounded by N cursors and one write buffer, so day-sized merges run at
+/// I/O speed.
+//------------------------------------------------------------------------------
+// Copyright (c) 2015 Omnibius, LLC
+// Author:  Serge Aleynikov <saleyn@gmail.com>
+// Created: 2015-10-15
+//------------------------------------------------------------------------------
+#include <sdb/sdb.hpp>
+#include <sdb/sdb_cursor.hpp>
+#include <utxx/get_option.hpp>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <vector>
+
+using namespace std;
+using namespace sdb;
+
+using SDBFileIO = BaseSDBFileIO<10>;
+using CursorT   = SDBCursor<10>;
+
+//------------------------------------------------------------------------------
+void Usage(std::string const& a_text = "")
+{
+  if (!a_text.empty())
+    cout << a_text << endl << endl;
+
+  cout << "SDB file merger: consolidate multiple captures of one instrument\n"
+       << "Copyright (c) 2015 Omnibius, LLC\n\n"
+       << "Usage: " << utxx::path::program::name()
+       << " -f File1 -f File2 [...] -o OutputDir [options]\n"
+       << "\nOptions:\n"
+       << "  -f MDFilename       - Input .sdb file (repeat per venue; the\n"
+       << "                        merge needs at least two inputs)\n"
+       << "  -o|--output OutDir  - Output database directory for the merged\n"
+       << "                        file\n"
+       << "  -x|--xchg Name      - Exchange name of the merged file\n"
+       << "                        (def: CONS)\n"
+       << "  -s|--symbol Name    - Symbol     (def: taken from first input)\n"
+       << "  -i|--instr  Name    - Instrument (def: taken from first input)\n"
+       << "  --secid N           - Security id(def: taken from first input)\n"
+       << "  -m|--depth Levels   - Book depth of the merged file\n"
+       << "                        (def: max depth of the inputs)\n"
+       << "  -D|--deep-dir       - Create the output inside a nested dir\n"
+       << "                        tree per the SDB file naming convention\n"
+       << "  -q                  - Quiet mode (don't print a summary)\n"
+       << "  -d                  - Enable debug printouts\n"
+       << "\nOnly the Quotes and Trade streams are merged; Order, Summary\n"
+       << "and Message samples of the inputs are skipped (reported at exit).\n"
+       << "All inputs must be files of the same UTC date.\n"
+       << "\n";
+  exit(1);
+}
+
+//------------------------------------------------------------------------------
+void UnhandledException() {
+  auto p = current_exception();
+  try    { rethrow_exception(p); }
+  catch  ( exception& e ) { cerr << e.what() << endl; }
+  catch  ( ... )          { cerr << "Unknown exception" << endl; }
+  exit(1);
+}
+
+//------------------------------------------------------------------------------
+int main(int argc, char* argv[])
+//------------------------------------------------------------------------------
+{
+  if (argc < 2)
+    Usage("Missing required option(s)");
+
+  set_terminate(&UnhandledException);
+
+  vector<string> inputs;
+  string         outdir;
+  string         xchg     = "CONS";
+  string         symbol;
+  string         instr;
+  long           secid    = 0;
+  int            depth    = 0;
+  bool           deep_dir = false;
+  bool           quiet    = false;
+  int            debug    = 0;
+
+  //----------------------------------------------------------------------------
+  // Parse options
+  //----------------------------------------------------------------------------
+  {
+    string file;
+    utxx::opts_parser opts(argc, argv);
+    while  (opts.next()) {
+      if (opts.match("-f", "",            &file))  { inputs.push_back(file);
+                                                     continue; }
+      if (opts.match("-o", "--output",    &outdir))  continue;
+      if (opts.match("-x", "--xchg",      &xchg))    continue;
+      if (opts.match("-s", "--symbol",    &symbol))  continue;
+      if (opts.match("-i", "--instr",     &instr))   continue;
+      if (opts.match("",   "--secid",     &secid))   continue;
+      if (opts.match("-m", "--depth",     &depth))   continue;
+      if (opts.match("-D", "--deep-dir",  &deep_dir))continue;
+      if (opts.match("-q", "--quiet",     &quiet))   continue;
+      if (opts.match("-d", "--debug"))    { debug++;  continue; }
+
+      if (opts.is_help()) Usage();
+
+      Usage(string("Invalid option: ") + opts());
+    }
+  }
+
+  if (inputs.size() < 2)  Usage("The merge requires at least two -f inputs");
+  if (outdir.empty())     Usage("Missing required option -o");
+  if (depth < 0 || depth > int(SDBFileIO::MAX_DEPTH()))
+    Usage("Invalid book depth requested");
+
+  //----------------------------------------------------------------------------
+  // Open the inputs and derive the merged file's header from them
+  //----------------------------------------------------------------------------
+  vector<unique_ptr<SDBFileIO>> files;
+  vector<unique_ptr<CursorT>>   cursors;
+
+  for (auto& name : inputs) {
+    auto f = unique_ptr<SDBFileIO>(new SDBFileIO());
+    f->Open(name, debug);
+    files.emplace_back(std::move(f));
+  }
+
+  auto& first = *files[0];
+
+  for (size_t i = 1; i < files.size(); ++i)
+    if (files[i]->Date() != first.Date())
+      UTXX_THROW_RUNTIME_ERROR
+        ("Input files have different dates: ", first.Filename(),
+         " vs ", files[i]->Filename());
+
+  if (symbol.empty()) symbol = first.Info().Symbol();
+  if (instr .empty()) instr  = first.Info().Instrument();
+  if (!secid)         secid  = first.Info().SecID();
+
+  // The merged book depth and price step must accommodate every input
+  double px_step = first.PxStep();
+  if (!depth)
+    for (auto& f : files) {
+      depth   = std::max(depth, f->Info().Depth());
+      px_step = std::min(px_step, f->PxStep());
+    }
+  depth = std::min(depth, int(SDBFileIO::MAX_DEPTH()));
+
+  //----------------------------------------------------------------------------
+  // Create the output and the input cursors
+  //----------------------------------------------------------------------------
+  SDBFileIO out;
+  out.Open<OpenMode::Write>
+    (outdir, deep_dir, xchg, symbol, instr, secid, first.Midnight(),
+     first.TZName(), first.TZOffset(), depth, px_step);
+
+  out.WriteStreamsMeta({StreamType::Quotes, StreamType::Trade});
+  out.WriteCandlesMeta({});
+
+  for (auto& f : files)
+    cursors.emplace_back(new CursorT(f->Cursor()));
+
+  //----------------------------------------------------------------------------
+  // K-way merge: a min-heap of input indexes keyed by the cursor's current
+  // sample time (ties broken by input order, so the merge is stable)
+  //----------------------------------------------------------------------------
+  struct HeapCmp {
+    vector<unique_ptr<CursorT>>* curs;
+    bool operator()(int a, int b) const {
+      auto& ta = (*curs)[a]->Time();
+      auto& tb = (*curs)[b]->Time();
+      return tb < ta || (!(ta < tb) && b < a);
+    }
+  };
+
+  priority_queue<int, vector<int>, HeapCmp> heap(HeapCmp{&cursors});
+
+  for (size_t i = 0; i < cursors.size(); ++i)
+    if (cursors[i]->Next())
+      heap.push(int(i));
+
+  size_t quotes  = 0;
+  size_t trades  = 0;
+  size_t skipped = 0;
+
+  while (!heap.empty()) {
+    int   i   = heap.top();
+    heap.pop();
+    auto& cur = *cursors[i];
+    auto& in  = *files[i];
+
+    switch (cur.Type()) {
+      case StreamType::Quotes: {
+        auto& q  = cur.AsQuote();
+
+        // Re-normalize to the merged file's price step by handing the
+        // writer double prices: inputs may differ in px_step
+        PxLevels<10, double> bids;
+        PxLevels<10, double> asks;
+        size_t nb = 0, na = 0;
+
+        for (auto p = q.BestBid(), e = q.EndBid();
+             p != e && nb < size_t(depth); CursorT::QuoteSampleT::NextBid(p))
+          bids[nb++].Set(p->m_px * in.PxStep(), p->m_qty);
+        for (auto p = q.BestAsk(), e = q.EndAsk();
+             p != e && na < size_t(depth); CursorT::QuoteSampleT::NextAsk(p))
+          asks[na++].Set(p->m_px * in.PxStep(), p->m_qty);
+
+        out.WriteQuotes<PriceUnit::DoubleVal>
+          (cur.Time(), std::move(bids), nb, std::move(asks), na);
+        quotes++;
+        break;
+      }
+      case StreamType::Trade: {
+        auto& t = cur.AsTrade();
+        out.WriteTrade<PriceUnit::DoubleVal>
+          (cur.Time(), t.Side(), t.Price() * in.PxStep(), t.Qty(),
+           t.Aggr(),   t.OrderID(), t.TradeID());
+        trades++;
+        break;
+      }
+      case StreamType::Seconds:
+        break;                  // The writer emits its own time spine
+      default:
+        skipped++;
+        break;
+    }
+
+    if (cur.Next())
+      heap.push(i);
+  }
+
+  auto outfile = out.Filename();
+  out.Close();
+
+  if (!quiet) {
+    cerr << "Merged " << inputs.size() << " files into " << outfile
+         << ": " << quotes << " quotes, " << trades << " trades";
+    if (skipped)
+      cerr << " (" << skipped << " samples of unmerged streams skipped)";
+    cerr << endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,255 @@
+// vim:ts=2:sw=2:et
+//------------------------------------------------------------------------------
+/// @file   benchmark_sdb.cpp
+/// @author Serge Aleynikov
+//------------------------------------------------------------------------------
+/// @brief Microbenchmarks for SDB codec and I/O hot paths.
+///
+/// Measures QuoteSample encode/decode at several book depths, the
+/// TradeSample round-trip, end-to-end BaseSDBFileIO::Read throughput and
+/// CandlesMeta::UpdateCandles, reporting ns/op and bytes/sec so that codec
+/// changes can be compared release to release.
+//------------------------------------------------------------------------------
+// Copyright (c) 2015 Omnibius, LLC
+// Created:  2015-10-05
+//------------------------------------------------------------------------------
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <utxx/path.hpp>
+#include <sdb/sdb_fmt_io.hxx>
+
+using namespace std;
+using namespace sdb;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+//------------------------------------------------------------------------------
+// Benchmark result reporting
+//------------------------------------------------------------------------------
+void Report(const char* a_name, long a_ops, double a_secs, long a_bytes)
+{
+  double ns_op = a_secs * 1e9 / a_ops;
+  printf("%-32s %12ld ops %10.1f ns/op", a_name, a_ops, ns_op);
+  if (a_bytes)
+    printf(" %10.1f MB/s", double(a_bytes) / a_secs / (1024*1024));
+  printf("\n");
+}
+
+//------------------------------------------------------------------------------
+// Synthetic book/trade generator: random-walk mid price with small deltas,
+// which is what the LEB128 codec sees on a liquid instrument
+//------------------------------------------------------------------------------
+struct Generator {
+  Generator(uint a_seed = 1) : m_rng(a_seed), m_px_dist(-2, 2) {}
+
+  int NextPx()  { m_px += m_px_dist(m_rng); return m_px;      }
+  int NextQty() { return 1 + int(m_rng() % 100);              }
+
+  template <uint MaxDepth>
+  QuoteSample<MaxDepth, int> NextQuote(int a_depth, bool a_delta)
+  {
+    auto book = typename QuoteSample<MaxDepth, int>::PxLevelsT();
+    int  mid  = NextPx();
+    for (int i = 0; i < a_depth; ++i) {
+      // Bids descend from mid, asks are appended after the bids
+      book[i].m_px            = i ? -1       : (a_delta ? mid - m_last : mid);
+      book[i].m_qty           = NextQty();
+      book[a_depth+i].m_px    = i ?  1       : 1;
+      book[a_depth+i].m_qty   = NextQty();
+    }
+    m_last = mid;
+    return QuoteSample<MaxDepth, int>
+      (a_delta, 1000, std::move(book), a_depth, a_depth);
+  }
+
+private:
+  std::mt19937            m_rng;
+  uniform_int_distribution<int> m_px_dist;
+  int                     m_px   = 10000;
+  int                     m_last = 10000;
+};
+
+//------------------------------------------------------------------------------
+template <uint MaxDepth>
+void BenchQuoteCodec(int a_depth, long a_iters)
+{
+  Generator gen;
+  auto      qt  = gen.template NextQuote<MaxDepth>(a_depth, false);
+
+  vector<char> buf(QuoteSample<MaxDepth, int>::MAX_SIZE());
+
+  char name[64];
+
+  // Encode
+  long  bytes = 0;
+  auto  t0    = Clock::now();
+  for (long i = 0; i < a_iters; ++i) {
+    char* p = &buf[0];
+    bytes  += qt.Encode(p);
+  }
+  auto  el    = chrono::duration<double>(Clock::now() - t0).count();
+  snprintf(name, sizeof(name), "QuoteSample::Encode depth=%d", a_depth);
+  Report(name, a_iters, el, bytes);
+
+  // Decode
+  char* p  = &buf[0];
+  auto  sz = qt.Encode(p);
+
+  QuoteSample<MaxDepth, int> out;
+  int   last_px = 0;
+
+  bytes = 0;
+  t0    = Clock::now();
+  for (long i = 0; i < a_iters; ++i) {
+    last_px = 0;
+    bytes  += out.Read(&buf[0], sz, false, last_px);
+  }
+  el = chrono::duration<double>(Clock::now() - t0).count();
+  snprintf(name, sizeof(name), "QuoteSample::Read   depth=%d", a_depth);
+  Report(name, a_iters, el, bytes);
+}
+
+//------------------------------------------------------------------------------
+void BenchTradeCodec(long a_iters)
+{
+  TradeSample tr(false, 1000, SideT::Buy, 2, 10, AggrT::Aggressor, 12345, 6789);
+
+  char buf[TradeSample::MAX_SIZE()];
+
+  long bytes = 0;
+  auto t0    = Clock::now();
+  for (long i = 0; i < a_iters; ++i) {
+    char* p = buf;
+    bytes  += tr.Encode(p);
+  }
+  auto el    = chrono::duration<double>(Clock::now() - t0).count();
+  Report("TradeSample::Encode", a_iters, el, bytes);
+
+  char* p  = buf;
+  auto  sz = tr.Encode(p);
+
+  TradeSample out;
+  int   last_px;
+
+  bytes = 0;
+  t0    = Clock::now();
+  for (long i = 0; i < a_iters; ++i) {
+    last_px = 0;
+    bytes  += out.Read(buf, sz, false, last_px);
+  }
+  el = chrono::duration<double>(Clock::now() - t0).count();
+  Report("TradeSample::Read", a_iters, el, bytes);
+}
+
+//------------------------------------------------------------------------------
+// End-to-end: write a synthetic file, then measure full-file Read() MB/s
+//------------------------------------------------------------------------------
+void BenchFileIO(long a_quotes)
+{
+  using SDBFileIO = BaseSDBFileIO<10>;
+
+  auto date = utxx::time_val::universal_time(2015, 10, 15, 0, 0, 0, 0);
+  auto dir  = std::string(P_tmpdir);
+
+  SDBFileIO   out;
+  std::string file;
+  {
+    utxx::path::file_unlink
+      (out.Filename(dir, false, "BENCH", "SYM", "INSTR", 1, date));
+
+    out.Open<OpenMode::Write>
+      (dir, false, "BENCH", "SYM", "INSTR", 1, date, "UTC", 0, 5, 0.01, 0640);
+    out.WriteStreamsMeta({StreamType::Quotes, StreamType::Trade});
+    out.WriteCandlesMeta({CandleHeader(60, 0, 86400)});
+
+    file = out.Filename();
+
+    Generator gen;
+    auto      now = date + utxx::secs(3600);
+
+    for (long i = 0; i < a_quotes; ++i) {
+      PxLevels<10, int> bids;
+      PxLevels<10, int> asks;
+      int px = gen.NextPx();
+      for (int j = 0; j < 5; ++j) {
+        bids[j].Set(px - j - 1, gen.NextQty());
+        asks[j].Set(px + j + 1, gen.NextQty());
+      }
+      out.WriteQuotes<PriceUnit::PriceSteps>
+        (now, std::move(bids), 5, std::move(asks), 5);
+
+      if ((i & 7) == 0)
+        out.WriteTrade<PriceUnit::PriceSteps>
+          (now, SideT::Buy, px, 10, AggrT::Aggressor, 0, 0);
+
+      now += utxx::usecs(250);
+    }
+    out.Close();
+  }
+
+  auto fsize = utxx::path::file_size(file);
+
+  SDBFileIO in;
+  in.Open(file);
+
+  long samples = 0;
+  auto visitor = [&samples](auto& sample) { ++samples; return true; };
+
+  auto t0 = Clock::now();
+  in.Read(visitor);
+  auto el = chrono::duration<double>(Clock::now() - t0).count();
+  in.Close();
+
+  Report("BaseSDBFileIO::Read (stdio)", samples, el, fsize);
+
+  SDBFileIO inm;
+  inm.Open(file, ReadMode::UseMmap);
+
+  samples = 0;
+  t0      = Clock::now();
+  inm.Read(visitor);
+  el      = chrono::duration<double>(Clock::now() - t0).count();
+  inm.Close();
+
+  Report("BaseSDBFileIO::Read (mmap)", samples, el, fsize);
+
+  utxx::path::file_unlink(file);
+}
+
+//------------------------------------------------------------------------------
+void BenchUpdateCandles(long a_iters)
+{
+  CandlesMeta meta({CandleHeader(60, 0, 86400)});
+
+  Generator gen;
+  auto t0 = Clock::now();
+  for (long i = 0; i < a_iters; ++i)
+    meta.UpdateCandles(int(i % 86400), gen.NextPx(), 10);
+  auto el = chrono::duration<double>(Clock::now() - t0).count();
+
+  Report("CandlesMeta::UpdateCandles", a_iters, el, 0);
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+int main(int argc, char* argv[])
+//------------------------------------------------------------------------------
+{
+  long iters  = argc > 1 ? atol(argv[1]) : 5000000;
+  long quotes = argc > 2 ? atol(argv[2]) : 1000000;
+
+  for (int depth : {1, 5, 10})
+    BenchQuoteCodec<10>(depth, iters);
+
+  BenchTradeCodec(iters);
+  BenchFileIO(quotes);
+  BenchUpdateCandles(iters);
+
+  return 0;
+}
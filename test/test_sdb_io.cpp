@@ -13,7 +13,11 @@
 #include <utxx/test_helper.hpp>
 #include <utxx/path.hpp>
 #include <stdio.h>
+#include <chrono>
+#include <thread>
 #include <sdb/sdb_fmt_io.hxx>
+#include <sdb/sdb_cursor.hpp>
+#include <sdb/sdb_container.hpp>
 
 using namespace std;
 using namespace sdb;
@@ -208,7 +212,9 @@ BOOST_AUTO_TEST_CASE( test_sdb )
     BOOST_CHECK_EQUAL(ToString(uuid),  ToString(sdb.Info().UUID()));
   }
 
-  BOOST_CHECK_EQUAL(2546, utxx::path::file_size(file));
+  // v2 layout: 64-bit DataOffset (+4), seek table slot (+8), 64-bit candle
+  // header offset (+4) and the (empty) seek table count at EOF (+4)
+  BOOST_CHECK_EQUAL(2566, utxx::path::file_size(file));
 
   utxx::path::file_unlink(file);
 }
@@ -265,9 +271,472 @@ BOOST_AUTO_TEST_CASE( test_sdb_no_candles )
     BOOST_CHECK_EQUAL(date, sdb.Info().Midnight());
 
     sdb.Read(printer);
+
+#ifdef SDB_HAVE_STATS
+    BOOST_CHECK_EQUAL(2u, sdb.Stats().m_rd[int(StreamType::Quotes)].m_samples);
+    BOOST_CHECK_EQUAL(2u, sdb.Stats().m_rd[int(StreamType::Seconds)].m_samples);
+    BOOST_CHECK_EQUAL(1u, sdb.Stats().m_rd_decode.Count());
+#endif
+  }
+
+  // v2 layout: 64-bit DataOffset (+4), seek table slot (+8) and a one-block
+  // seek table at EOF (4 + 24)
+  BOOST_CHECK_EQUAL(298, utxx::path::file_size(file));
+
+  utxx::path::file_unlink(file);
+}
+
+//------------------------------------------------------------------------------
+// Counts samples of one decoded extent (see test_sdb_v2_blocks)
+//------------------------------------------------------------------------------
+struct BlockCounter {
+  bool operator()(SecondsSample const& a_sec) {
+    m_seconds++;
+    m_last_sec = a_sec.Time();
+    return true;
+  }
+
+  bool operator()(QuoteSample<SDBFileIO::MAX_DEPTH(), int> const& a) {
+    m_quotes++;
+    return true;
+  }
+
+  bool operator()(TradeSample const& a_trade) {
+    m_trades++;
+    m_trade_px = a_trade.Price();
+    return true;
+  }
+
+  template <typename T>
+  bool operator()(T const& a_other) {
+    UTXX_THROW_RUNTIME_ERROR("Unsupported stream type");
+    return true;
+  }
+
+  int m_seconds  = 0;
+  int m_quotes   = 0;
+  int m_trades   = 0;
+  int m_last_sec = 0;
+  int m_trade_px = 0;
+};
+
+BOOST_AUTO_TEST_CASE( test_sdb_v2_blocks )
+{
+  auto  dir = TempPath();
+  std::string file;
+
+  auto date = utxx::time_val::universal_time(2015, 10, 15, 0, 0, 0, 0);
+  auto uuid = UUID("0f7f69c9-fc9d-4517-8318-706e3e58dadd");
+  {
+    SDBFileIO sdb;
+
+    utxx::path::file_unlink
+      (sdb.Filename(dir,false,"KRX","KR4101","KR4101K60008",1,date));
+
+    UTXX_CHECK_NO_THROW
+      (sdb.Open<OpenMode::Write>
+        (dir,  false, "KRX", "KR4101", "KR4101K60008", 1, date, "KST", 3600*9,
+         5,    0.01,  0640,  uuid));
+
+    file = sdb.Filename();
+
+    sdb.WriteStreamsMeta({StreamType::Quotes, StreamType::Trade});
+    sdb.WriteCandlesMeta({});
+
+    PxLevels<10, double> bids;
+    PxLevels<10, double> asks;
+
+    bids[0].Set(1.10, 30);  asks[0].Set(1.11, 20);
+
+    auto dt = date + utxx::secs(3600);
+
+    sdb.WriteQuotes<PriceUnit::DoubleVal>
+      (dt, std::move(bids), 1, std::move(asks), 1);
+
+    sdb.Flush();            // Ends the first data block
+
+    sdb.WriteTrade<PriceUnit::DoubleVal>
+      (date + utxx::secs(3605), SideT::Buy, 1.11, 5, AggrT::Aggressor);
+  }
+
+  {
+    SDBFileIO sdb;
+    UTXX_CHECK_NO_THROW(sdb.Open(file));
+
+    BOOST_CHECK_EQUAL(2u, sdb.Info().Version());
+    BOOST_CHECK_EQUAL(2u, sdb.BlockCount());
+
+    // The second block decodes on its own: it opens with an absolute-time
+    // SecondsSample and a full (non-delta) trade price
+    BlockCounter blk1;
+    UTXX_CHECK_NO_THROW(sdb.ReadBlock(1, std::ref(blk1)));
+
+    BOOST_CHECK_EQUAL(1,    blk1.m_seconds);
+    BOOST_CHECK_EQUAL(0,    blk1.m_quotes);
+    BOOST_CHECK_EQUAL(1,    blk1.m_trades);
+    BOOST_CHECK_EQUAL(3605, blk1.m_last_sec);
+    BOOST_CHECK_EQUAL(111,  blk1.m_trade_px);
+
+    BlockCounter blk0;
+    UTXX_CHECK_NO_THROW(sdb.ReadBlock(0, std::ref(blk0)));
+
+    BOOST_CHECK_EQUAL(1,    blk0.m_seconds);
+    BOOST_CHECK_EQUAL(1,    blk0.m_quotes);
+    BOOST_CHECK_EQUAL(0,    blk0.m_trades);
+    BOOST_CHECK_EQUAL(3600, blk0.m_last_sec);
+  }
+
+  {
+    // Sequential read still sees every sample and stops at the seek table
+    SDBFileIO sdb;
+    UTXX_CHECK_NO_THROW(sdb.Open(file));
+
+    BlockCounter all;
+    sdb.Read(std::ref(all));
+
+    BOOST_CHECK_EQUAL(2, all.m_seconds);
+    BOOST_CHECK_EQUAL(1, all.m_quotes);
+    BOOST_CHECK_EQUAL(1, all.m_trades);
   }
 
-  BOOST_CHECK_EQUAL(258, utxx::path::file_size(file));
+  utxx::path::file_unlink(file);
+}
+
+BOOST_AUTO_TEST_CASE( test_sdb_query )
+{
+  auto  dir = TempPath();
+  std::string file;
+
+  auto date = utxx::time_val::universal_time(2015, 10, 15, 0, 0, 0, 0);
+  auto uuid = UUID("0f7f69c9-fc9d-4517-8318-706e3e58dadd");
+  {
+    SDBFileIO sdb;
+
+    utxx::path::file_unlink
+      (sdb.Filename(dir,false,"KRX","KR4101","KR4101K60008",1,date));
+
+    UTXX_CHECK_NO_THROW
+      (sdb.Open<OpenMode::Write>
+        (dir,  false, "KRX", "KR4101", "KR4101K60008", 1, date, "KST", 3600*9,
+         5,    0.01,  0640,  uuid));
+
+    file = sdb.Filename();
+
+    sdb.WriteStreamsMeta({StreamType::Quotes, StreamType::Trade});
+    sdb.WriteCandlesMeta({});
+
+    PxLevels<10, double> bids;
+    PxLevels<10, double> asks;
+
+    bids[0].Set(1.10, 30);  asks[0].Set(1.11, 20);
+    bids[1].Set(1.05, 20);  asks[1].Set(1.16, 40);
+    bids[2].Set(1.00, 10);  asks[2].Set(1.20, 60);
+
+    auto dt = date + utxx::secs(3600);
+
+    sdb.WriteQuotes<PriceUnit::DoubleVal>
+      (dt, std::move(bids), 3, std::move(asks), 3);
+
+    sdb.WriteTrade<PriceUnit::DoubleVal>
+      (dt + utxx::usecs(500), SideT::Buy, 1.11, 5, AggrT::Aggressor);
+
+    bids[0].Set(1.11, 31);  asks[0].Set(1.12, 21);
+    bids[1].Set(1.06, 21);  asks[1].Set(1.16, 41);
+
+    dt = date + utxx::secs(3605);
+
+    sdb.WriteQuotes<PriceUnit::DoubleVal>
+      (dt, std::move(bids), 2, std::move(asks), 2);
+
+    sdb.WriteTrade<PriceUnit::DoubleVal>
+      (dt + utxx::usecs(500), SideT::Sell, 1.12, 15, AggrT::Passive);
+  }
+
+  {
+    SDBFileIO sdb;
+    UTXX_CHECK_NO_THROW(sdb.Open(file));
+
+    TimeGrid   grid(3600, 3610, 5);       // Two 5-second buckets
+    VWAPKernel vwap(grid);
+    sdb.Query(vwap);
+
+    BOOST_CHECK_EQUAL(2u,    grid.Count());
+    BOOST_CHECK_EQUAL(5,     vwap.Volume(0));
+    BOOST_CHECK_EQUAL(111.0, vwap.VWAP(0));
+    BOOST_CHECK_EQUAL(15,    vwap.Volume(1));
+    BOOST_CHECK_EQUAL(112.0, vwap.VWAP(1));
+
+    TopBookKernel top(grid);
+    sdb.Query(top);
+
+    BOOST_CHECK_EQUAL(1,   top.Count(0));
+    BOOST_CHECK_EQUAL(110, top.BidPx(0));
+    BOOST_CHECK_EQUAL(30,  top.BidQty(0));
+    BOOST_CHECK_EQUAL(111, top.AskPx(0));
+    BOOST_CHECK_EQUAL(20,  top.AskQty(0));
+    BOOST_CHECK_EQUAL(111, top.BidPx(1));
+    BOOST_CHECK_EQUAL(112, top.AskPx(1));
+
+    OHLCKernel ohlc(grid);
+    sdb.Query(ohlc);
+
+    BOOST_CHECK_EQUAL(1,   ohlc.Count(0));
+    BOOST_CHECK_EQUAL(111, ohlc.Open (0));
+    BOOST_CHECK_EQUAL(111, ohlc.Close(0));
+    BOOST_CHECK_EQUAL(112, ohlc.High (1));
+
+    ImbalanceKernel imb(grid);
+    sdb.Query(imb);
+
+    BOOST_CHECK_EQUAL(1, imb.Count(0));
+    // Bucket 0 is ask-heavy: 20+40/2+60/3 > 30+20/2+10/3
+    BOOST_CHECK(imb.Imbalance(0) < 0);
+    // Bucket 1 is balanced: 31+21/2 == 21+41/2
+    BOOST_CHECK_SMALL(imb.Imbalance(1), 1e-9);
+  }
+
+  utxx::path::file_unlink(file);
+}
+
+BOOST_AUTO_TEST_CASE( test_sdb_cursor )
+{
+  auto  dir = TempPath();
+  std::string file;
+
+  auto date = utxx::time_val::universal_time(2015, 10, 15, 0, 0, 0, 0);
+  auto uuid = UUID("0f7f69c9-fc9d-4517-8318-706e3e58dadd");
+  {
+    SDBFileIO sdb;
+
+    utxx::path::file_unlink
+      (sdb.Filename(dir,false,"KRX","KR4101","KR4101K60008",1,date));
+
+    UTXX_CHECK_NO_THROW
+      (sdb.Open<OpenMode::Write>
+        (dir,  false, "KRX", "KR4101", "KR4101K60008", 1, date, "KST", 3600*9,
+         5,    0.01,  0640,  uuid));
+
+    file = sdb.Filename();
+
+    sdb.WriteStreamsMeta({StreamType::Quotes, StreamType::Trade});
+    sdb.WriteCandlesMeta({});
+
+    PxLevels<10, double> bids;
+    PxLevels<10, double> asks;
+
+    bids[0].Set(1.10, 30);  asks[0].Set(1.11, 20);
+
+    auto dt = date + utxx::secs(3600);
+
+    sdb.WriteQuotes<PriceUnit::DoubleVal>
+      (dt, std::move(bids), 1, std::move(asks), 1);
+
+    sdb.WriteTrade<PriceUnit::DoubleVal>
+      (dt + utxx::usecs(500), SideT::Buy, 1.11, 5, AggrT::Aggressor);
+  }
+
+  {
+    SDBFileIO sdb;
+    UTXX_CHECK_NO_THROW(sdb.Open(file));
+
+    auto cur = sdb.Cursor();
+
+    BOOST_CHECK(cur.Next());
+    BOOST_CHECK(StreamType::Seconds == cur.Type());
+    BOOST_CHECK_EQUAL(3600, cur.AsSeconds().Time());
+
+    BOOST_CHECK(cur.Next());
+    BOOST_CHECK(StreamType::Quotes == cur.Type());
+    BOOST_CHECK_EQUAL(1,    cur.AsQuote().BidCount());
+    BOOST_CHECK_EQUAL(110,  cur.AsQuote().BestBid()->m_px);
+    BOOST_CHECK_EQUAL(30,   cur.AsQuote().BestBid()->m_qty);
+
+    BOOST_CHECK(cur.Next());
+    BOOST_CHECK(StreamType::Trade == cur.Type());
+    BOOST_CHECK_EQUAL(111,  cur.AsTrade().Price());
+    BOOST_CHECK_EQUAL(5,    cur.AsTrade().Qty());
+    BOOST_CHECK(date + utxx::secs(3600) + utxx::usecs(500) == cur.Time());
+
+    BOOST_CHECK(!cur.Next());
+    BOOST_CHECK(!cur.Next());
+  }
+
+  utxx::path::file_unlink(file);
+}
+
+BOOST_AUTO_TEST_CASE( test_sdb_cursor_follow )
+{
+  auto  dir = TempPath();
+  std::string file;
+
+  auto date = utxx::time_val::universal_time(2015, 10, 15, 0, 0, 0, 0);
+  auto uuid = UUID("0f7f69c9-fc9d-4517-8318-706e3e58dadd");
+
+  SDBFileIO wr;
+
+  utxx::path::file_unlink
+    (wr.Filename(dir,false,"KRX","KR4101","KR4101K60008",1,date));
+
+  UTXX_CHECK_NO_THROW
+    (wr.Open<OpenMode::Write>
+      (dir,  false, "KRX", "KR4101", "KR4101K60008", 1, date, "KST", 3600*9,
+       5,    0.01,  0640,  uuid));
+
+  file = wr.Filename();
+
+  wr.WriteStreamsMeta({StreamType::Quotes, StreamType::Trade});
+  wr.WriteCandlesMeta({});
+
+  PxLevels<10, double> bids;
+  PxLevels<10, double> asks;
+
+  bids[0].Set(1.10, 30);  asks[0].Set(1.11, 20);
+
+  wr.WriteQuotes<PriceUnit::DoubleVal>
+    (date + utxx::secs(3600), std::move(bids), 1, std::move(asks), 1);
+  wr.Flush();                   // Header and first block are on disk
+
+  SDBFileIO rd;
+  UTXX_CHECK_NO_THROW(rd.Open(file));
+
+  auto cur = rd.Cursor();
+  cur.Follow(true, 5000);
+
+  BOOST_CHECK(cur.Next());
+  BOOST_CHECK(StreamType::Seconds == cur.Type());
+  BOOST_CHECK_EQUAL(3600, cur.AsSeconds().Time());
+
+  BOOST_CHECK(cur.Next());
+  BOOST_CHECK(StreamType::Quotes == cur.Type());
+  BOOST_CHECK_EQUAL(110,  cur.AsQuote().BestBid()->m_px);
+
+  // Append a trade and close the writer while the follower waits at EOF
+  std::thread t([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    wr.WriteTrade<PriceUnit::DoubleVal>
+      (date + utxx::secs(3605), SideT::Buy, 1.11, 5, AggrT::Aggressor);
+    wr.Flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    wr.Close();                 // Appends the v2 seek table at EOF
+  });
+
+  BOOST_CHECK(cur.Next());
+  BOOST_CHECK(StreamType::Seconds == cur.Type());
+  BOOST_CHECK_EQUAL(3605, cur.AsSeconds().Time());
+
+  BOOST_CHECK(cur.Next());
+  BOOST_CHECK(StreamType::Trade == cur.Type());
+  BOOST_CHECK_EQUAL(111,  cur.AsTrade().Price());
+
+  t.join();
+
+  // The writer has closed: the follower must drain cleanly instead of
+  // decoding the seek table appended at the end of the data
+  BOOST_CHECK(!cur.Next());
+  BOOST_CHECK(!cur.Next());
+
+  utxx::path::file_unlink(file);
+}
+
+namespace {
+  struct ContainerCounter {
+    std::vector<std::pair<int,int>> m_seconds;  // (instr, sec) in visit order
+    int m_quotes   = 0;
+    int m_trades   = 0;
+    int m_quote_px = 0;
+    int m_trade_px = 0;
+
+    void operator()(int a_instr, SecondsSample const& a) {
+      m_seconds.emplace_back(a_instr, a.Time());
+    }
+    void operator()(int, QuoteSample<10, int> const& a) {
+      m_quotes++;
+      m_quote_px = a.BestBid()->m_px;
+    }
+    void operator()(int, TradeSample const& a) {
+      m_trades++;
+      m_trade_px = a.Price();
+    }
+  };
+}
+
+BOOST_AUTO_TEST_CASE( test_sdb_container )
+{
+  auto file = TempPath() + "/test-container.sdbc";
+
+  auto date = utxx::time_val::universal_time(2015, 10, 15, 0, 0, 0, 0);
+  auto uuid = UUID("0f7f69c9-fc9d-4517-8318-706e3e58dadd");
+
+  utxx::path::file_unlink(file);
+  {
+    ContainerWriter<10> w;
+    UTXX_CHECK_NO_THROW(w.Open(file, date));
+
+    auto a = w.AddInstrument("KRX","KR4101","KR4101K60008",1,"KST",3600*9,
+                             5, 0.01, uuid);
+    auto b = w.AddInstrument("KRX","KR4102","KR4102K60009",2,"KST",3600*9,
+                             5, 0.01);
+    BOOST_CHECK_EQUAL(0, a);
+    BOOST_CHECK_EQUAL(1, b);
+
+    PxLevels<10, double> bids;
+    PxLevels<10, double> asks;
+
+    bids[0].Set(1.10, 30);  asks[0].Set(1.11, 20);
+
+    w.WriteQuotes<PriceUnit::DoubleVal>
+      (a, date + utxx::secs(3600), std::move(bids), 1, std::move(asks), 1);
+
+    w.WriteTrade<PriceUnit::DoubleVal>
+      (b, date + utxx::secs(3602), SideT::Sell, 2.00, 7, AggrT::Passive);
+
+    w.WriteTrade<PriceUnit::DoubleVal>
+      (a, date + utxx::secs(3605), SideT::Buy, 1.11, 5, AggrT::Aggressor);
+
+    w.Close();
+  }
+
+  {
+    ContainerReader<10> r;
+    UTXX_CHECK_NO_THROW(r.Open(file));
+
+    BOOST_CHECK_EQUAL(2u,             r.Count());
+    BOOST_CHECK(date ==               r.Midnight());
+    BOOST_CHECK_EQUAL("KR4101K60008", r.Info(0).Instrument());
+    BOOST_CHECK_EQUAL("KR4102K60009", r.Info(1).Instrument());
+    BOOST_CHECK_EQUAL(2,              r.Info(1).SecID());
+    BOOST_CHECK_EQUAL(0.01,           r.Info(0).PxStep());
+    BOOST_CHECK_EQUAL(1u,             r.Extents(0).size());
+    BOOST_CHECK_EQUAL(3600u,          r.Extents(0)[0].m_first_sec);
+    BOOST_CHECK_EQUAL(3u,             r.Extents(0)[0].m_records);
+    BOOST_CHECK_EQUAL(3602u,          r.Extents(1)[0].m_first_sec);
+
+    // One instrument decodes without touching the other's blocks
+    ContainerCounter one;
+    UTXX_CHECK_NO_THROW(r.ReadInstrument(0, std::ref(one)));
+
+    BOOST_CHECK_EQUAL(2u,   one.m_seconds.size());
+    BOOST_CHECK_EQUAL(3600, one.m_seconds[0].second);
+    BOOST_CHECK_EQUAL(3605, one.m_seconds[1].second);
+    BOOST_CHECK_EQUAL(1,    one.m_quotes);
+    BOOST_CHECK_EQUAL(110,  one.m_quote_px);
+    BOOST_CHECK_EQUAL(1,    one.m_trades);
+    BOOST_CHECK_EQUAL(111,  one.m_trade_px);
+    BOOST_CHECK_EQUAL(3605, r.LastSec());
+
+    // Full-container replay merges the blocks by start time
+    ContainerCounter all;
+    UTXX_CHECK_NO_THROW(r.ReadAll(std::ref(all)));
+
+    BOOST_CHECK_EQUAL(3u,   all.m_seconds.size());
+    BOOST_CHECK_EQUAL(0,    all.m_seconds[0].first);
+    BOOST_CHECK_EQUAL(3600, all.m_seconds[0].second);
+    BOOST_CHECK_EQUAL(3605, all.m_seconds[1].second);
+    BOOST_CHECK_EQUAL(1,    all.m_seconds[2].first);
+    BOOST_CHECK_EQUAL(3602, all.m_seconds[2].second);
+    BOOST_CHECK_EQUAL(1,    all.m_quotes);
+    BOOST_CHECK_EQUAL(2,    all.m_trades);
+  }
 
   utxx::path::file_unlink(file);
 }